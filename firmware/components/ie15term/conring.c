@@ -0,0 +1,63 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include "conring.h"
+
+int conring_write(conring_t *r, const void *data, int len) {
+	uint32_t head=r->head;
+	uint32_t tail=__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	int space=CONRING_SIZE-(head-tail);
+	if (len>space) len=space;
+	if (len<=0) return 0;
+	//copy in at most two pieces, as the data can wrap around the end of the buffer
+	int pos=head&(CONRING_SIZE-1);
+	int n=CONRING_SIZE-pos;
+	if (n>len) n=len;
+	memcpy(&r->buf[pos], data, n);
+	memcpy(&r->buf[0], (const uint8_t*)data+n, len-n);
+	//Publish the data only after it's in. This has to be ordered against the load of
+	//'waiting' in conring_need_wake, hence seq_cst.
+	__atomic_store_n(&r->head, head+len, __ATOMIC_SEQ_CST);
+	return len;
+}
+
+int conring_read(conring_t *r, void *data, int len) {
+	uint32_t tail=r->tail;
+	uint32_t head=__atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	if (len>head-tail) len=head-tail;
+	if (len<=0) return 0;
+	int pos=tail&(CONRING_SIZE-1);
+	int n=CONRING_SIZE-pos;
+	if (n>len) n=len;
+	memcpy(data, &r->buf[pos], n);
+	memcpy((uint8_t*)data+n, &r->buf[0], len-n);
+	__atomic_store_n(&r->tail, tail+len, __ATOMIC_RELEASE);
+	return len;
+}
+
+int conring_used(conring_t *r) {
+	return __atomic_load_n(&r->head, __ATOMIC_SEQ_CST)-__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+int conring_space(conring_t *r) {
+	return CONRING_SIZE-conring_used(r);
+}
+
+int conring_prepare_sleep(conring_t *r) {
+	__atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+	if (conring_used(r)==0) return 1;
+	//something came in after all
+	__atomic_store_n(&r->waiting, 0, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int conring_need_wake(conring_t *r) {
+	if (!__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST)) return 0;
+	return __atomic_exchange_n(&r->waiting, 0, __ATOMIC_SEQ_CST);
+}
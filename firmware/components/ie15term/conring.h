@@ -0,0 +1,39 @@
+//Lock-free byte ring carrying console output from the emulator to whatever shows it.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+
+//Must be a power of two. A few screens' worth, so a burst of output from the PDP11 can be
+//taken in at once while the terminal catches up.
+#define CONRING_SIZE 4096
+
+//Exactly one task may write and exactly one may read.
+typedef struct {
+	uint8_t buf[CONRING_SIZE];
+	uint32_t head;		//only written by the producer
+	uint32_t tail;		//only written by the consumer
+	uint32_t waiting;	//set by a consumer that's about to sleep
+} conring_t;
+
+//Writes as much of data as fits; returns the number of bytes written.
+int conring_write(conring_t *r, const void *data, int len);
+//Reads up to len bytes; returns the number of bytes read.
+int conring_read(conring_t *r, void *data, int len);
+int conring_used(conring_t *r);
+int conring_space(conring_t *r);
+
+/*
+Sleeping and waking is left to the user of the ring, as it's different on FreeRTOS and on
+the host; these two make it race-free. A consumer that finds the ring empty calls
+conring_prepare_sleep, and only goes to sleep if that returns 1. A producer calls
+conring_need_wake after writing, and wakes the consumer if that returns 1.
+*/
+int conring_prepare_sleep(conring_t *r);
+int conring_need_wake(conring_t *r);
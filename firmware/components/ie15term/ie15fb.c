@@ -0,0 +1,47 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ie15fb.h"
+
+uint16_t ie15_fb[IE15_FB_H][IE15_FB_W];
+
+int ie15_fb_flush(ie15_screen_t *s) {
+	static uint16_t linebuf[IE15_FB_W*IE15_CHH];
+	ie15_rect_t r;
+	int areas=0;
+	while (ie15_scr_take_dirty(s, &r)) {
+		int w=(r.x1-r.x0)*IE15_CHW;
+		for (int y=r.y0; y<r.y1; y++) {
+			ie15_glyph_render_span(linebuf, ie15_scr_row(s, y)+r.x0, r.x1-r.x0);
+			for (int ly=0; ly<IE15_CHH; ly++) {
+				memcpy(&ie15_fb[y*IE15_CHH+ly][r.x0*IE15_CHW], &linebuf[ly*w], w*sizeof(uint16_t));
+			}
+		}
+		areas++;
+	}
+	return areas;
+}
+
+int ie15_fb_write_ppm(const char *path) {
+	FILE *f=fopen(path, "wb");
+	if (!f) return -1;
+	fprintf(f, "P6\n%d %d\n255\n", IE15_FB_W, IE15_FB_H);
+	for (int y=0; y<IE15_FB_H; y++) {
+		for (int x=0; x<IE15_FB_W; x++) {
+			//big-endian RGB565
+			const uint8_t *p=(const uint8_t*)&ie15_fb[y][x];
+			int v=(p[0]<<8)|p[1];
+			uint8_t rgb[3]={(v>>11)<<3, ((v>>5)&0x3f)<<2, (v&0x1f)<<3};
+			fwrite(rgb, 3, 1, f);
+		}
+	}
+	fclose(f);
+	return 0;
+}
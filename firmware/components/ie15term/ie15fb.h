@@ -0,0 +1,25 @@
+//Framebuffer 'LCD' for the IE15 terminal, for running and benchmarking it on the host.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+#include "ie15screen.h"
+#include "ie15glyph.h"
+
+#define IE15_FB_W (IE15_COLS*IE15_CHW)
+#define IE15_FB_H (IE15_ROWS*IE15_CHH)
+
+//Pixels in the same format the LCD gets
+extern uint16_t ie15_fb[IE15_FB_H][IE15_FB_W];
+
+//Like the LCD flush: draws what changed on the screen into the framebuffer. Returns the
+//number of areas drawn, which on the LCD would each be a window.
+int ie15_fb_flush(ie15_screen_t *s);
+//Writes the framebuffer as a binary PPM image. Returns 0 on success.
+int ie15_fb_write_ppm(const char *path);
@@ -0,0 +1,63 @@
+/*
+The character generator ROM has 8x8 glyphs, but a cell on the LCD is only 4 pixels wide:
+every LCD pixel is two ROM pixels, in one of three shades depending on if none, one or both
+of them are lit. Working that out per pixel for every character drawn is slow, so it's done
+once here. Per glyph line we keep the four shades packed in a byte, and a table that turns
+such a byte straight into the four pixels.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include "ie15glyph.h"
+
+//Only the first 8 lines of a cell come from the ROM; the rest stays black.
+#define ROM_LINES 8
+
+static uint8_t glyph[256][ROM_LINES];	//2 bits of shade per pixel, leftmost in the high bits
+static uint16_t linepix[256][IE15_CHW];	//packed glyph line -> pixels
+
+static uint16_t lcdrgb(int r, int g, int b) {
+	r=r>>3;
+	g=g>>2;
+	b=b>>3;
+	int rr=(r<<11)+(g<<5)+(b);
+	return ((rr&0xff)<<8)+(rr>>8);
+}
+
+void ie15_glyph_init(const uint8_t *chargen) {
+	uint16_t cols[4];
+	cols[0]=lcdrgb(0, 0, 0);
+	cols[1]=lcdrgb(13, 210, 13);
+	cols[2]=lcdrgb(16, 255, 16);
+	cols[3]=cols[2]; //not used
+	for (int c=0; c<256; c++) {
+		for (int ly=0; ly<ROM_LINES; ly++) {
+			uint8_t rom=chargen[c*8+ly];
+			uint8_t g=0;
+			for (int lx=0; lx<IE15_CHW; lx++) {
+				int p=((rom>>(7-lx*2))&1)+((rom>>(6-lx*2))&1);
+				g|=p<<(6-lx*2);
+			}
+			glyph[c][ly]=g;
+		}
+	}
+	for (int g=0; g<256; g++) {
+		for (int lx=0; lx<IE15_CHW; lx++) linepix[g][lx]=cols[(g>>(6-lx*2))&3];
+	}
+}
+
+void ie15_glyph_render_span(uint16_t *dst, const uint8_t *cells, int n) {
+	for (int ly=0; ly<ROM_LINES; ly++) {
+		for (int i=0; i<n; i++) {
+			memcpy(dst, linepix[glyph[cells[i]][ly]], sizeof(linepix[0]));
+			dst+=IE15_CHW;
+		}
+	}
+	memset(dst, 0, (IE15_CHH-ROM_LINES)*n*IE15_CHW*sizeof(uint16_t));
+}
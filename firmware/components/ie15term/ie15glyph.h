@@ -0,0 +1,22 @@
+//Turns screen cells into LCD pixels, using glyphs precomputed from the character generator ROM.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+
+//Size of a character cell on the LCD, in pixels
+#define IE15_CHW 4
+#define IE15_CHH 10
+
+//Builds the glyph cache from the 256x8-byte character generator ROM image.
+void ie15_glyph_init(const uint8_t *chargen);
+
+//Renders n cells of one text row into dst: IE15_CHH lines of n*IE15_CHW pixels each, as
+//RGB565 in the byte order the LCD wants (big-endian).
+void ie15_glyph_render_span(uint16_t *dst, const uint8_t *cells, int n);
@@ -11,7 +11,6 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/ringbuf.h"
 #include "esp_system.h"
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
@@ -19,6 +18,12 @@
 #include "esp_vfs.h"
 #include "esp_vfs_dev.h"
 #include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "conring.h"
+#include "ie15screen.h"
+#include "ie15glyph.h"
+#include "ie15term.h"
 /*
 Emulation of a Russian IE15-type terminal on a  ILI9341/ST7789V 320x240 LCD in landscape mode.
 */
@@ -272,109 +277,116 @@ static void lcd_init(spi_device_handle_t spi) {
 #endif
 }
 
-static inline int get_pix(int c, int x, int y) {
-	int p=c*8;
-	return (chargenrom[p+y]>>(7-x))&1;
+#define LCD_W (IE15_COLS*IE15_CHW)
+
+//Sends a command plus up to 4 bytes of arguments.
+static void lcd_cmd_data4(spi_device_handle_t spi, uint8_t cmd, const uint8_t *data, int len) {
+	spi_transaction_t t[2];
+	memset(t, 0, sizeof(t));
+	t[0].length=8;
+	t[0].user=(void*)0;
+	t[0].flags=SPI_TRANS_USE_TXDATA;
+	t[0].tx_data[0]=cmd;
+	t[1].length=len*8;
+	t[1].user=(void*)1;
+	t[1].flags=SPI_TRANS_USE_TXDATA;
+	if (len) memcpy(t[1].tx_data, data, len);
+	for (int i=0; i<(len?2:1); i++) {
+		esp_err_t ret=spi_device_polling_transmit(spi, &t[i]);
+		assert(ret==ESP_OK);
+	}
 }
 
-#define CHW 4
-#define CHH 10
-
-static const int lcdrgb(int r, int g, int b) {
-	r=r>>3;
-	g=g>>2;
-	b=b>>3;
-	int rr=(r<<11)+(g<<5)+(b);
-	return ((rr&0xff)<<8)+(rr>>8);
+//Sets the area the following pixel data goes into and starts a memory write.
+static void lcd_set_window(spi_device_handle_t spi, int x0, int y0, int x1, int y1) {
+	uint8_t col[4]={x0>>8, x0&0xff, x1>>8, x1&0xff};
+	uint8_t page[4]={y0>>8, y0&0xff, y1>>8, y1&0xff};
+	lcd_cmd_data4(spi, 0x2A, col, 4);		//Column Address Set
+	lcd_cmd_data4(spi, 0x2B, page, 4);		//Page address set
+	lcd_cmd_data4(spi, 0x2C, NULL, 0);		//memory write
 }
 
-static void draw_char(spi_device_handle_t spi,int c, int cx, int cy) {
-	int x=cx*CHW;
-	int y=cy*CHH;
-	int cols[3];
-	cols[0]=lcdrgb(0, 0, 0);
-	cols[1]=lcdrgb(13, 210, 13);
-	cols[2]=lcdrgb(16, 255, 16);
-
-	uint16_t chardata[CHW*CHH];
-	for (int ly=0; ly<CHH; ly++) {
-		for (int lx=0; lx<CHW; lx++) {
-			if (ly<8) {
-				int p;
-				p=get_pix(c, lx*2, ly);
-				p+=get_pix(c, lx*2+1, ly);
-				chardata[ly*CHW+lx]=cols[p];
-			} else {
-				chardata[ly*CHW+lx]=0;
-			}
-		}
-	}
+//Two line buffers, so one can be rendered while the other goes out over DMA.
+static uint16_t *linebuf[2];
 
-	spi_transaction_t trans[6];
-	for (int i=0; i<6; i++) {
-		memset(&trans[i], 0, sizeof(spi_transaction_t));
-		if ((i&1)==0) {
-			//Even transfers are commands
-			trans[i].length=8;
-			trans[i].user=(void*)0;
-		} else {
-			//Odd transfers are data
-			trans[i].length=8*4;
-			trans[i].user=(void*)1;
+/*
+Sends everything that changed on the screen to the LCD. Each dirty area gets one window,
+and the pixels for it go out one text row per DMA transfer, rendered while the previous
+row is still being sent.
+*/
+static void lcd_flush(spi_device_handle_t spi, ie15_screen_t *scr) {
+	ie15_rect_t r;
+	spi_transaction_t trans[2];
+	spi_transaction_t *done;
+	while (ie15_scr_take_dirty(scr, &r)) {
+		int w=r.x1-r.x0;
+		int queued=0;
+		lcd_set_window(spi, r.x0*IE15_CHW, r.y0*IE15_CHH, r.x1*IE15_CHW-1, r.y1*IE15_CHH-1);
+		for (int y=r.y0; y<r.y1; y++) {
+			int b=y&1;
+			if (queued==2) {
+				//wait for the transfer from this buffer to finish
+				spi_device_get_trans_result(spi, &done, portMAX_DELAY);
+				queued--;
+			}
+			ie15_glyph_render_span(linebuf[b], ie15_scr_row(scr, y)+r.x0, w);
+			memset(&trans[b], 0, sizeof(spi_transaction_t));
+			trans[b].tx_buffer=linebuf[b];
+			trans[b].length=w*IE15_CHW*IE15_CHH*2*8;
+			trans[b].user=(void*)1;
+			esp_err_t ret=spi_device_queue_trans(spi, &trans[b], portMAX_DELAY);
+			assert(ret==ESP_OK);
+			queued++;
 		}
-		trans[i].flags=SPI_TRANS_USE_TXDATA;
-	}
-
-	trans[0].tx_data[0]=0x2A;			//Column Address Set
-	trans[1].tx_data[0]=x>>8;				//Start Col High
-	trans[1].tx_data[1]=x&0xff;				//Start Col Low
-	trans[1].tx_data[2]=(x+CHW-1)>>8;		//End Col High
-	trans[1].tx_data[3]=(x+CHW-1)&0xff;		//End Col Low
-	trans[2].tx_data[0]=0x2B;			//Page address set
-	trans[3].tx_data[0]=y>>8;		//Start page high
-	trans[3].tx_data[1]=y&0xff;		//start page low
-	trans[3].tx_data[2]=(y+CHH-1)>>8;	 //end page high
-	trans[3].tx_data[3]=(y+CHH-1)&0xff;	 //end page low
-	trans[4].tx_data[0]=0x2C;			//memory write
-	trans[5].tx_buffer=chardata;		//finally send the line data
-	trans[5].length=(CHW*CHH)*2*8;			 //Data length, in bits
-	trans[5].flags=0; //undo SPI_TRANS_USE_TXDATA flag
-	
-	//Send all transactions.
-	for (x=0; x<6; x++) {
-		esp_err_t ret=spi_device_polling_transmit(spi, &trans[x]);
-		assert(ret==ESP_OK);
+		//polling transactions can't be mixed with queued ones that are still pending
+		while (queued--) spi_device_get_trans_result(spi, &done, portMAX_DELAY);
 	}
 }
 
+//Output from the emulator comes in through this ring. The task takes it out in chunks, so
+//there's no handoff per character, and sleeps when it runs dry.
+static conring_t ie15ring;
+static TaskHandle_t ie15_task_handle;
 
-//Enable for VT50 emulation... turns out this is not necessary, the KOI-7 character set used
-//by the IE15 seems to have the lower characters in place of the upper Ascii characters and 
-//vice versa...
-const int upper_only = 0;
+static spi_device_handle_t lcd_spi;
+static ie15_screen_t screen;
+static ie15_term_t term;
 
-static RingbufHandle_t ie15rb;
+//While output keeps streaming in, the LCD still gets updated this often (in us).
+#define FLUSH_INTERVAL 20000
 
-static int recv_char() {
-	char *c;
-	int r;
-	size_t sz=0;
-	c=xRingbufferReceiveUpTo(ie15rb, &sz, portMAX_DELAY, 1);
-	r=*c;
-	vRingbufferReturnItem(ie15rb, c);
-	return r;
+static void term_loop() {
+	static uint8_t rxbuf[256];
+	int64_t last_flush=esp_timer_get_time();
+	while(1) {
+		int len=conring_read(&ie15ring, rxbuf, sizeof(rxbuf));
+		if (len) {
+			//Echo to the UART console from here rather than from the emulator, so a slow
+			//UART shows up as a busy terminal instead of stalling the CPU.
+			fwrite(rxbuf, 1, len, stdout);
+			ie15_term_feed(&term, rxbuf, len);
+			if (esp_timer_get_time()-last_flush>FLUSH_INTERVAL) {
+				lcd_flush(lcd_spi, &screen);
+				last_flush=esp_timer_get_time();
+			}
+		} else {
+			//Nothing more to do for now; show what we have.
+			lcd_flush(lcd_spi, &screen);
+			last_flush=esp_timer_get_time();
+			if (conring_prepare_sleep(&ie15ring)) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+	}
 }
 
 static void ie15_task(void *ptr) {
 	esp_err_t ret;
-	spi_device_handle_t spi;
 	spi_bus_config_t buscfg={
 		.miso_io_num=PIN_NUM_MISO,
 		.mosi_io_num=PIN_NUM_MOSI,
 		.sclk_io_num=PIN_NUM_CLK,
 		.quadwp_io_num=-1,
 		.quadhd_io_num=-1,
-		.max_transfer_sz=4094
+		.max_transfer_sz=LCD_W*IE15_CHH*2		//one full text row
 	};
 	spi_device_interface_config_t devcfg={
 		.clock_speed_hz=10*1000*1000,			//Clock out at 20 MHz
@@ -387,143 +399,34 @@ static void ie15_task(void *ptr) {
 	ret=spi_bus_initialize(LCD_HOST, &buscfg, DMA_CHAN);
 	ESP_ERROR_CHECK(ret);
 	//Attach the LCD to the SPI bus
-	ret=spi_bus_add_device(LCD_HOST, &devcfg, &spi);
+	ret=spi_bus_add_device(LCD_HOST, &devcfg, &lcd_spi);
 	ESP_ERROR_CHECK(ret);
 	//Initialize the LCD
-	lcd_init(spi);
+	lcd_init(lcd_spi);
 
-	for (int y=0; y<240/CHH; y++) {
-		for (int x=0; x<320/CHW; x++) {
-			draw_char(spi, 0, x, y);
-		}
+	for (int i=0; i<2; i++) {
+		linebuf[i]=heap_caps_malloc(LCD_W*IE15_CHH*2, MALLOC_CAP_DMA);
+		assert(linebuf[i]);
 	}
+	ie15_glyph_init(chargenrom);
+	ie15_scr_init(&screen);
+	ie15_term_init(&term, &screen);
+	lcd_flush(lcd_spi, &screen);
 
-	int px=0;
-	int py=0;
-	int altchar=0;
-	char *dispmem;
-	dispmem=malloc(80*25);
-	memset(dispmem, 0, 80*25);
-	int need_redraw=0;
-	while(1) {
-		int c=recv_char();
-		if (c=='\r') { //\r\n
-			px=0;
-		} else if (c=='\n') {
-			py=py+1;
-		} else if (c=='\b' || c==127) {
-			//backspace / del
-			px=px-1;
-		} else if (c==0xe) {
-			//SO, change to Russian charset
-			altchar=1;
-		} else if (c==0xF) {
-			//SI, change to Latin charset
-			altchar=0;
-		} else if (c=='\t') {
-			int tabstops[]={8,16,24,32,40,48,56,64,72,-1}; //from dec vt-50 user manual
-			//janky, doesn't handle tab beyond 72
-			for (int i=0; tabstops[i]!=-1; i++) {
-				if (tabstops[i]>px) {
-					px=tabstops[i];
-					break;
-				}
-			}
-		} else if (c==27) { //escape
-			int ec=recv_char();
-			if (ec=='A') {
-				py=py-1;
-			} else if (ec=='B') {
-				py=py+1;
-			} else if (ec=='C') {
-				px=px-1;
-			} else if (ec=='D') {
-				px=px+1;
-			} else if (ec=='F') {
-				//enter gfx mode
-				altchar=1;
-			} else if (ec=='G') {
-				//exit gfx mode
-				altchar=0;
-			} else if (ec=='H') { 
-				//home
-				px=0; py=0;
-			} else if (ec=='I') {
-				//reverse line feed
-			} else if (ec=='J') {
-				//clear to end of screen
-				for (int i=(py*80)+px; i<80*24; i++) dispmem[i]=0;
-				need_redraw=1;
-			} else if (ec=='K') {
-				//clear to end of line
-				for (int i=px; i<80; i++) dispmem[py*80+i]=0;
-				need_redraw=1;
-			} else if (ec=='L') {
-				//insert a line
-			} else if (ec=='M') {
-				//delete a line
-			} else if (ec=='Y') {
-				//set cursor position
-				py=recv_char()-32;
-				px=recv_char()-32;
-			}
-		} else {
-			if (upper_only) {
-				//vt50 emulation
-#if 0 //IE15 does not do this mapping (real 'original' VT50 does)
-				if (c==96) c=64;
-				if (c=='{') c='[';
-				if (c=='|') c='\\';
-				if (c=='}') c=']';
-				if (c=='~') c='^';
-#endif
-				if (altchar) {
-					//cyrillic has more 'text' characters that need uppercasing
-					if (c>='a' && c<=0x7e) c-=32;
-				} else {
-					if (c>='a' && c<='z') c-=32;
-				}
-			}
-			if (altchar) c+=128;
-			draw_char(spi, c, px, py);
-			dispmem[py*80+px]=c;
-			px++;
-		}
-		if (px<0) {
-			px+=80;
-			py-=1;
-		}
-		if (py<0) {
-			//no scrollback implemented
-			py=0;
-		}
-		if (px>80) {
-			px=0;
-			py++;
-		}
-		if (py>23) {
-			for (int i=0; i<23; i++) memcpy(&dispmem[i*80], &dispmem[(i+1)*80], 80);
-			memset(&dispmem[23*80], 0, 80);
-			need_redraw=1;
-			py--;
-		}
-
-		if (need_redraw) {
-			for (int y=0; y<24; y++) {
-				for (int x=0; x<80; x++) {
-					draw_char(spi, dispmem[y*80+x], x, y);
-				}
-			}
-			need_redraw=0;
-		}
-	}
+	term_loop();
+	vTaskDelete(NULL); //not reached
 }
 
 void ie15_init(void) {
-	ie15rb=xRingbufferCreate(8, RINGBUF_TYPE_BYTEBUF);
-	xTaskCreatePinnedToCore(ie15_task, "ie15", 4096, NULL, 4, NULL, 1);
+	xTaskCreatePinnedToCore(ie15_task, "ie15", 4096, NULL, 4, &ie15_task_handle, 1);
+}
+
+int ie15_write(const char *buf, int len) {
+	int n=conring_write(&ie15ring, buf, len);
+	if (n && conring_need_wake(&ie15ring)) xTaskNotifyGive(ie15_task_handle);
+	return n;
 }
 
 void ie15_sendchar(char c) {
-	xRingbufferSend(ie15rb, &c, 1, portMAX_DELAY);
+	while (ie15_write(&c, 1)==0) vTaskDelay(1);
 }
@@ -1,4 +1,5 @@
-
 void ie15_init(void);
+//Queues up to len characters for the terminal without blocking; returns how many fit.
+int ie15_write(const char *buf, int len);
+//Queues one character, waiting for room if needed.
 void ie15_sendchar(char c);
-
@@ -0,0 +1,191 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include "ie15screen.h"
+
+//Setting up an LCD window (five small SPI transactions) costs about as much time as
+//sending the pixels of this many cells.
+#define WINDOW_COST 2
+
+void ie15_scr_mark_dirty(ie15_screen_t *s, int y, int x0, int x1) {
+	if (x0>=x1) return;
+	if (s->dirty_x1[y]==0) {
+		s->dirty_x0[y]=x0;
+		s->dirty_x1[y]=x1;
+		return;
+	}
+	if (x0<s->dirty_x0[y]) s->dirty_x0[y]=x0;
+	if (x1>s->dirty_x1[y]) s->dirty_x1[y]=x1;
+}
+
+void ie15_scr_invalidate(ie15_screen_t *s) {
+	for (int y=0; y<IE15_ROWS; y++) {
+		ie15_scr_mark_dirty(s, y, 0, IE15_COLS);
+		s->force[y]=1;
+	}
+}
+
+void ie15_scr_init(ie15_screen_t *s) {
+	memset(s, 0, sizeof(ie15_screen_t));
+	s->scroll_bottom=IE15_ROWS;
+	ie15_scr_invalidate(s);
+}
+
+void ie15_scr_scroll(ie15_screen_t *s, int y0, int y1, int n) {
+	int h=y1-y0;
+	if (h<=0 || n==0) return;
+	if (y0==0 && y1==IE15_ROWS && n>0 && n<IE15_ROWS) {
+		//The whole screen: the old top rows become the new bottom ones.
+		for (int i=0; i<n; i++) {
+			memset(ie15_scr_row(s, 0), 0, IE15_COLS);
+			s->top++;
+			if (s->top==IE15_ROWS) s->top=0;
+		}
+	} else if (n>0) {
+		if (n>h) n=h;
+		for (int y=y0; y<y1-n; y++) memcpy(ie15_scr_row(s, y), ie15_scr_row(s, y+n), IE15_COLS);
+		for (int y=y1-n; y<y1; y++) memset(ie15_scr_row(s, y), 0, IE15_COLS);
+	} else {
+		n=-n;
+		if (n>h) n=h;
+		for (int y=y1-1; y>=y0+n; y--) memcpy(ie15_scr_row(s, y), ie15_scr_row(s, y-n), IE15_COLS);
+		for (int y=y0; y<y0+n; y++) memset(ie15_scr_row(s, y), 0, IE15_COLS);
+	}
+	for (int y=y0; y<y1; y++) ie15_scr_mark_dirty(s, y, 0, IE15_COLS);
+}
+
+void ie15_scr_scroll_up(ie15_screen_t *s) {
+	ie15_scr_scroll(s, s->scroll_top, s->scroll_bottom, 1);
+}
+
+void ie15_scr_linefeed(ie15_screen_t *s) {
+	if (s->cy==s->scroll_bottom-1) {
+		ie15_scr_scroll_up(s);
+	} else if (s->cy<IE15_ROWS-1) {
+		s->cy++;
+	}
+}
+
+void ie15_scr_reverse_linefeed(ie15_screen_t *s) {
+	if (s->cy==s->scroll_top) {
+		ie15_scr_scroll(s, s->scroll_top, s->scroll_bottom, -1);
+	} else if (s->cy>0) {
+		s->cy--;
+	}
+}
+
+void ie15_scr_write(ie15_screen_t *s, const uint8_t *c, int n, uint8_t add) {
+	while (n>0) {
+		if (s->cx>=IE15_COLS) {
+			s->cx=0;
+			ie15_scr_linefeed(s);
+		}
+		int len=IE15_COLS-s->cx;
+		if (len>n) len=n;
+		uint8_t *row=ie15_scr_row(s, s->cy)+s->cx;
+		int x0=len, x1=0;
+		for (int i=0; i<len; i++) {
+			uint8_t v=c[i]+add;
+			if (row[i]!=v) {
+				row[i]=v;
+				if (x0==len) x0=i;
+				x1=i+1;
+			}
+		}
+		ie15_scr_mark_dirty(s, s->cy, s->cx+x0, s->cx+x1);
+		s->cx+=len;
+		c+=len;
+		n-=len;
+	}
+}
+
+void ie15_scr_put(ie15_screen_t *s, uint8_t c) {
+	ie15_scr_write(s, &c, 1, 0);
+}
+
+void ie15_scr_clear(ie15_screen_t *s, int y, int x0, int x1) {
+	if (x0>=x1) return;
+	memset(ie15_scr_row(s, y)+x0, 0, x1-x0);
+	ie15_scr_mark_dirty(s, y, x0, x1);
+}
+
+void ie15_scr_clear_eol(ie15_screen_t *s) {
+	if (s->cx>=IE15_COLS) return;
+	ie15_scr_clear(s, s->cy, s->cx, IE15_COLS);
+}
+
+void ie15_scr_clear_eos(ie15_screen_t *s) {
+	ie15_scr_clear_eol(s);
+	for (int y=s->cy+1; y<IE15_ROWS; y++) ie15_scr_clear(s, y, 0, IE15_COLS);
+}
+
+void ie15_scr_insert_chars(ie15_screen_t *s, int n) {
+	if (s->cx>=IE15_COLS) return;
+	uint8_t *row=ie15_scr_row(s, s->cy);
+	if (n>IE15_COLS-s->cx) n=IE15_COLS-s->cx;
+	memmove(row+s->cx+n, row+s->cx, IE15_COLS-s->cx-n);
+	memset(row+s->cx, 0, n);
+	ie15_scr_mark_dirty(s, s->cy, s->cx, IE15_COLS);
+}
+
+void ie15_scr_delete_chars(ie15_screen_t *s, int n) {
+	if (s->cx>=IE15_COLS) return;
+	uint8_t *row=ie15_scr_row(s, s->cy);
+	if (n>IE15_COLS-s->cx) n=IE15_COLS-s->cx;
+	memmove(row+s->cx, row+s->cx+n, IE15_COLS-s->cx-n);
+	memset(row+IE15_COLS-n, 0, n);
+	ie15_scr_mark_dirty(s, s->cy, s->cx, IE15_COLS);
+}
+
+//Finds the columns of screen row y that differ from what's shown. Returns 0 if none do.
+static int row_diff(ie15_screen_t *s, int y, int *x0, int *x1) {
+	if (s->dirty_x1[y]==0) return 0;
+	int a=s->dirty_x0[y];
+	int b=s->dirty_x1[y];
+	if (!s->force[y]) {
+		const uint8_t *row=ie15_scr_row(s, y);
+		while (a<b && row[a]==s->shown[y][a]) a++;
+		while (b>a && row[b-1]==s->shown[y][b-1]) b--;
+	}
+	*x0=a;
+	*x1=b;
+	return a!=b;
+}
+
+//Row y is going to be drawn (or doesn't need to be).
+static void row_done(ie15_screen_t *s, int y) {
+	if (s->dirty_x1[y]==0) return;
+	memcpy(s->shown[y], ie15_scr_row(s, y), IE15_COLS);
+	s->dirty_x1[y]=0;
+	s->force[y]=0;
+}
+
+int ie15_scr_take_dirty(ie15_screen_t *s, ie15_rect_t *r) {
+	int y=0;
+	int x0, x1;
+	while (y<IE15_ROWS && !row_diff(s, y, &x0, &x1)) row_done(s, y++);
+	if (y==IE15_ROWS) return 0;
+	r->y0=y;
+	r->x0=x0;
+	r->x1=x1;
+	row_done(s, y++);
+	while (y<IE15_ROWS && row_diff(s, y, &x0, &x1)) {
+		int n=y-r->y0;
+		int ux0=(x0<r->x0)?x0:r->x0;
+		int ux1=(x1>r->x1)?x1:r->x1;
+		int merged=(ux1-ux0)*(n+1);
+		int separate=(r->x1-r->x0)*n+WINDOW_COST+(x1-x0);
+		if (merged>separate) break;
+		r->x0=ux0;
+		r->x1=ux1;
+		row_done(s, y++);
+	}
+	r->y1=y;
+	return 1;
+}
@@ -0,0 +1,88 @@
+//Platform-independent model of the IE15 terminal screen: the characters on it, the cursor,
+//and which parts changed since they were last drawn.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+
+#define IE15_COLS 80
+#define IE15_ROWS 24
+
+/*
+The rows of cells are a ring: screen row y is cell[(top+y)%IE15_ROWS], so scrolling is
+moving 'top' instead of moving all the characters. Use ie15_scr_row() to get at them.
+
+For redrawing, the model keeps a copy of what the display shows. Changes mark the columns
+that may now differ from it; when the renderer asks what to draw, only the cells that
+really differ are handed out. After a scroll, the part of a line that's the same as the
+line that was above it (think of the columns of an 'ls -l') doesn't need to be sent.
+
+(The ILI9341 and ST7789V can scroll in hardware, but only along their long side, which is
+horizontal in the landscape mode used here, so that can't be used to scroll text.)
+*/
+typedef struct {
+	uint8_t cell[IE15_ROWS][IE15_COLS];	//character generator index per cell; 0 is blank
+	int top;							//ring index of screen row 0
+	uint8_t shown[IE15_ROWS][IE15_COLS];	//what the display shows, by screen row
+	//Per screen row, the columns that may differ from 'shown', x0 up to but not including
+	//x1; x1==0 means the row is the same. 'force' rows are drawn even if they look the same.
+	uint8_t dirty_x0[IE15_ROWS];
+	uint8_t dirty_x1[IE15_ROWS];
+	uint8_t force[IE15_ROWS];
+	//Cursor. cx can be IE15_COLS: the next character then goes on the next line.
+	int cx, cy;
+	//Scrolling region: line feeds on its last row only scroll the rows from scroll_top up
+	//to but not including scroll_bottom. Normally that's the whole screen.
+	int scroll_top, scroll_bottom;
+} ie15_screen_t;
+
+static inline uint8_t *ie15_scr_row(ie15_screen_t *s, int y) {
+	int r=s->top+y;
+	if (r>=IE15_ROWS) r-=IE15_ROWS;
+	return s->cell[r];
+}
+
+//An area of the screen in cells; y1 and x1 are exclusive.
+typedef struct {
+	int x0, y0, x1, y1;
+} ie15_rect_t;
+
+//Clears the screen and has all of it redrawn.
+void ie15_scr_init(ie15_screen_t *s);
+//Forgets what the display shows, so everything gets redrawn.
+void ie15_scr_invalidate(ie15_screen_t *s);
+//Puts a character at the cursor and moves the cursor right.
+void ie15_scr_put(ie15_screen_t *s, uint8_t c);
+//Same for a run of n characters, with 'add' added to each; wraps to the next line as needed.
+void ie15_scr_write(ie15_screen_t *s, const uint8_t *c, int n, uint8_t add);
+//Moves the cursor down a line, scrolling the scrolling region up if it's on its last row.
+void ie15_scr_linefeed(ie15_screen_t *s);
+//Moves the cursor up a line, scrolling the scrolling region down if it's on its first row.
+void ie15_scr_reverse_linefeed(ie15_screen_t *s);
+void ie15_scr_scroll_up(ie15_screen_t *s);
+//Scrolls rows y0 up to but not including y1 up by n rows, or down if n is negative. The
+//rows that come in are blank.
+void ie15_scr_scroll(ie15_screen_t *s, int y0, int y1, int n);
+//Clears from the cursor to the end of the line or of the screen.
+void ie15_scr_clear_eol(ie15_screen_t *s);
+void ie15_scr_clear_eos(ie15_screen_t *s);
+//Clears columns x0 up to but not including x1 of row y.
+void ie15_scr_clear(ie15_screen_t *s, int y, int x0, int x1);
+//Inserts n blanks at the cursor or deletes n characters there; the rest of the line moves.
+void ie15_scr_insert_chars(ie15_screen_t *s, int n);
+void ie15_scr_delete_chars(ie15_screen_t *s, int n);
+void ie15_scr_mark_dirty(ie15_screen_t *s, int y, int x0, int x1);
+
+/*
+Takes the next area that needs redrawing off the screen, and considers it drawn. An area
+is a run of rows with changes, plus all columns that changed in any of them; a row is only
+added to the run if drawing the extra unchanged cells is cheaper than setting up another
+LCD window. Returns 0 if nothing needs redrawing.
+*/
+int ie15_scr_take_dirty(ie15_screen_t *s, ie15_rect_t *r);
@@ -0,0 +1,378 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+/*
+The IE15 is a VT52 lookalike. On top of its escape sequences, this understands the part
+of the VT100 (ANSI) set that 2.11BSD curses and vi use with TERM=vt100: cursor addressing
+and movement, erasing, scrolling regions, index/reverse index, and inserting and deleting
+lines and characters. Attributes (SGR) and modes are accepted and ignored, and there's no
+way to answer status requests, so those are ignored as well.
+
+VT52 and VT100 disagree about ESC D and ESC M. A real VT100 is switched from VT52 mode
+with ESC <, but the vt100 termcap entry never sends that, so any CSI sequence also counts
+as a sign that the other side talks VT100.
+
+Everything is table driven: control characters, the character after an ESC and the final
+character of a CSI sequence are looked up to get an action. Printable characters are not
+looked at one by one; a run of them goes to the screen in one go.
+*/
+#include <string.h>
+#include "ie15term.h"
+
+//Enable for VT50 emulation... turns out this is not necessary, the KOI-7 character set used
+//by the IE15 seems to have the lower characters in place of the upper Ascii characters and 
+//vice versa...
+static const int upper_only = 0;
+
+enum {
+	ST_GROUND=0,	//normal characters
+	ST_ESC,			//had an ESC
+	ST_Y_ROW,		//ESC Y, row comes next
+	ST_Y_COL,		//ESC Y row, column comes next
+	ST_SKIP,		//ESC ( or ESC ) etc: skip the character set designator
+	ST_CSI,			//in ESC [ ... sequence
+};
+
+enum {
+	A_NONE=0,
+	A_CR, A_LF, A_BS, A_TAB, A_SO, A_SI, A_ESC, A_CANCEL,
+	//ESC x
+	A_UP, A_DOWN, A_LEFT, A_RIGHT, A_ALT_ON, A_ALT_OFF, A_HOME, A_RLF, A_CLR_EOS,
+	A_CLR_EOL, A_INS_LINE, A_DEL_LINE, A_CURPOS, A_INDEX_OR_RIGHT, A_RI_OR_DEL_LINE,
+	A_NEXT_LINE, A_SAVE, A_RESTORE, A_ANSI, A_RESET, A_SKIP, A_CSI,
+	//ESC [ ... x
+	A_CUU, A_CUD, A_CUF, A_CUB, A_CUP, A_ED, A_EL, A_IL, A_DL, A_ICH, A_DCH, A_STBM, A_RM,
+};
+
+//Bytes 0-31 and 127. Everything else is printable.
+static const uint8_t ctl_action[32]={
+	['\b']=A_BS, ['\t']=A_TAB, ['\n']=A_LF, ['\r']=A_CR,
+	[0x0e]=A_SO, [0x0f]=A_SI, [0x18]=A_CANCEL, [0x1a]=A_CANCEL, [0x1b]=A_ESC,
+};
+
+//The character after ESC. Note that C and D are swapped from what DEC's VT52 does;
+//this is how the IE15 code has always done it.
+static const uint8_t esc_action[128]={
+	['A']=A_UP, ['B']=A_DOWN, ['C']=A_LEFT, ['D']=A_INDEX_OR_RIGHT, ['E']=A_NEXT_LINE,
+	['F']=A_ALT_ON, ['G']=A_ALT_OFF, ['H']=A_HOME, ['I']=A_RLF, ['J']=A_CLR_EOS,
+	['K']=A_CLR_EOL, ['L']=A_INS_LINE, ['M']=A_RI_OR_DEL_LINE, ['Y']=A_CURPOS,
+	['7']=A_SAVE, ['8']=A_RESTORE, ['<']=A_ANSI, ['c']=A_RESET, ['[']=A_CSI,
+	['(']=A_SKIP, [')']=A_SKIP, ['#']=A_SKIP,
+};
+
+//Final character of a CSI sequence. Anything not in here (m, h, n, c...) is ignored.
+static const uint8_t csi_action[128]={
+	['A']=A_CUU, ['B']=A_CUD, ['C']=A_CUF, ['D']=A_CUB, ['H']=A_CUP, ['f']=A_CUP,
+	['J']=A_ED, ['K']=A_EL, ['L']=A_IL, ['M']=A_DL, ['@']=A_ICH, ['P']=A_DCH,
+	['r']=A_STBM, ['l']=A_RM, ['s']=A_SAVE, ['u']=A_RESTORE,
+};
+
+void ie15_term_init(ie15_term_t *t, ie15_screen_t *s) {
+	memset(t, 0, sizeof(ie15_term_t));
+	t->s=s;
+}
+
+static int clamp(int v, int min, int max) {
+	if (v<min) return min;
+	if (v>max) return max;
+	return v;
+}
+
+//Numeric CSI parameter i; missing and 0 both mean 'def'.
+static int param(ie15_term_t *t, int i, int def) {
+	if (i>=t->nparam || t->param[i]==0) return def;
+	return t->param[i];
+}
+
+//The VT52 way of keeping the cursor on the screen: moving off the left edge goes to the end
+//of the line above, off the right edge to the next line, and off the bottom scrolls.
+static void fix_cursor(ie15_screen_t *s) {
+	if (s->cx<0) {
+		s->cx+=IE15_COLS;
+		s->cy-=1;
+	}
+	if (s->cy<0) {
+		//no scrollback implemented
+		s->cy=0;
+	}
+	if (s->cx>IE15_COLS) {
+		s->cx=0;
+		s->cy++;
+	}
+	if (s->cy>IE15_ROWS-1) {
+		ie15_scr_scroll_up(s);
+		s->cy=IE15_ROWS-1;
+	}
+}
+
+static void print_run(ie15_term_t *t, const uint8_t *c, int n) {
+	uint8_t add=t->altchar?128:0;
+	if (!upper_only) {
+		ie15_scr_write(t->s, c, n, add);
+		return;
+	}
+	for (int i=0; i<n; i++) {
+		//vt50 emulation
+		uint8_t ch=c[i];
+#if 0 //IE15 does not do this mapping (real 'original' VT50 does)
+		if (ch==96) ch=64;
+		if (ch=='{') ch='[';
+		if (ch=='|') ch='\\';
+		if (ch=='}') ch=']';
+		if (ch=='~') ch='^';
+#endif
+		if (t->altchar) {
+			//cyrillic has more 'text' characters that need uppercasing
+			if (ch>='a' && ch<=0x7e) ch-=32;
+		} else {
+			if (ch>='a' && ch<='z') ch-=32;
+		}
+		ie15_scr_write(t->s, &ch, 1, add);
+	}
+}
+
+static void do_action(ie15_term_t *t, int a) {
+	ie15_screen_t *s=t->s;
+	int n=param(t, 0, 1);
+	//Cursor movement in CSI sequences doesn't wrap; a pending wrap is forgotten.
+	int cx=(s->cx<IE15_COLS)?s->cx:IE15_COLS-1;
+	switch (a) {
+	case A_CR:
+		s->cx=0;
+		break;
+	case A_LF:
+		ie15_scr_linefeed(s);
+		break;
+	case A_BS:
+		s->cx=s->cx-1;
+		break;
+	case A_TAB:
+		//tab stops from dec vt-50 user manual: every 8 chars up to 72
+		if (s->cx<72) s->cx=(s->cx/8+1)*8;
+		break;
+	case A_SO:
+	case A_ALT_ON:
+		//change to Russian charset / enter gfx mode
+		t->altchar=1;
+		break;
+	case A_SI:
+	case A_ALT_OFF:
+		t->altchar=0;
+		break;
+	case A_UP:
+		s->cy=s->cy-1;
+		break;
+	case A_DOWN:
+		s->cy=s->cy+1;
+		break;
+	case A_LEFT:
+		s->cx=s->cx-1;
+		break;
+	case A_INDEX_OR_RIGHT:
+		if (t->ansi) {
+			ie15_scr_linefeed(s);
+		} else {
+			s->cx=s->cx+1;
+		}
+		break;
+	case A_NEXT_LINE:
+		s->cx=0;
+		ie15_scr_linefeed(s);
+		break;
+	case A_HOME:
+		s->cx=0;
+		s->cy=0;
+		break;
+	case A_RLF:
+		ie15_scr_reverse_linefeed(s);
+		break;
+	case A_CLR_EOS:
+		ie15_scr_clear_eos(s);
+		break;
+	case A_CLR_EOL:
+		ie15_scr_clear_eol(s);
+		break;
+	case A_RI_OR_DEL_LINE:
+		if (t->ansi) {
+			ie15_scr_reverse_linefeed(s);
+			break;
+		}
+		//fall through
+	case A_DL:
+		if (s->cy>=s->scroll_top && s->cy<s->scroll_bottom) {
+			ie15_scr_scroll(s, s->cy, s->scroll_bottom, n);
+			s->cx=0;
+		}
+		break;
+	case A_INS_LINE:
+	case A_IL:
+		if (s->cy>=s->scroll_top && s->cy<s->scroll_bottom) {
+			ie15_scr_scroll(s, s->cy, s->scroll_bottom, -n);
+			s->cx=0;
+		}
+		break;
+	case A_SAVE:
+		t->saved_cx=s->cx;
+		t->saved_cy=s->cy;
+		break;
+	case A_RESTORE:
+		s->cx=t->saved_cx;
+		s->cy=t->saved_cy;
+		break;
+	case A_ANSI:
+		t->ansi=1;
+		break;
+	case A_RESET:
+		ie15_scr_init(s);
+		ie15_term_init(t, s);
+		break;
+	case A_CUU:
+		s->cx=cx;
+		s->cy=clamp(s->cy-n, (s->cy>=s->scroll_top)?s->scroll_top:0, IE15_ROWS-1);
+		break;
+	case A_CUD:
+		s->cx=cx;
+		s->cy=clamp(s->cy+n, 0, (s->cy<s->scroll_bottom)?s->scroll_bottom-1:IE15_ROWS-1);
+		break;
+	case A_CUF:
+		s->cx=clamp(cx+n, 0, IE15_COLS-1);
+		break;
+	case A_CUB:
+		s->cx=clamp(cx-n, 0, IE15_COLS-1);
+		break;
+	case A_CUP:
+		s->cy=clamp(param(t, 0, 1)-1, 0, IE15_ROWS-1);
+		s->cx=clamp(param(t, 1, 1)-1, 0, IE15_COLS-1);
+		break;
+	case A_ED:
+		n=param(t, 0, 0);
+		if (n==0) {
+			ie15_scr_clear_eos(s);
+		} else {
+			for (int y=0; y<s->cy; y++) ie15_scr_clear(s, y, 0, IE15_COLS);
+			ie15_scr_clear(s, s->cy, 0, (n==1)?cx+1:IE15_COLS);
+			if (n!=1) for (int y=s->cy+1; y<IE15_ROWS; y++) ie15_scr_clear(s, y, 0, IE15_COLS);
+		}
+		break;
+	case A_EL:
+		n=param(t, 0, 0);
+		if (n==0) {
+			ie15_scr_clear_eol(s);
+		} else {
+			ie15_scr_clear(s, s->cy, 0, (n==1)?cx+1:IE15_COLS);
+		}
+		break;
+	case A_ICH:
+		s->cx=cx;
+		ie15_scr_insert_chars(s, n);
+		break;
+	case A_DCH:
+		s->cx=cx;
+		ie15_scr_delete_chars(s, n);
+		break;
+	case A_STBM: {
+		int top=param(t, 0, 1)-1;
+		int bottom=param(t, 1, IE15_ROWS);
+		if (top<bottom-1 && bottom<=IE15_ROWS) {
+			s->scroll_top=top;
+			s->scroll_bottom=bottom;
+			s->cx=0;
+			s->cy=0;
+		}
+		break;
+	}
+	case A_RM:
+		//DECANM off: back to VT52 mode
+		if (t->priv && param(t, 0, 0)==2) t->ansi=0;
+		break;
+	}
+}
+
+void ie15_term_feed(ie15_term_t *t, const uint8_t *buf, int len) {
+	ie15_screen_t *s=t->s;
+	const uint8_t *end=buf+len;
+	while (buf<end) {
+		if (t->state==ST_GROUND) {
+			//Fast path: hand the whole run of printable characters to the screen.
+			const uint8_t *p=buf;
+			while (p<end && *p>=32 && *p!=127) p++;
+			if (p!=buf) {
+				print_run(t, buf, p-buf);
+				buf=p;
+				continue;
+			}
+		}
+		uint8_t c=*buf++;
+		int a=A_NONE;
+		if (c<32) {
+			a=ctl_action[c];
+			//Controls also work in the middle of an escape sequence, except for the ones
+			//that end or restart it.
+			if (a==A_ESC || a==A_CANCEL) t->state=ST_GROUND;
+		} else if (c==127) {
+			//del, handled as backspace
+			a=(t->state==ST_GROUND)?A_BS:A_NONE;
+		} else if (t->state==ST_ESC) {
+			a=(c<128)?esc_action[c]:A_NONE;
+			t->state=ST_GROUND;
+			if (a==A_CURPOS) {
+				t->state=ST_Y_ROW;
+				continue;
+			} else if (a==A_SKIP) {
+				t->state=ST_SKIP;
+				continue;
+			} else if (a==A_CSI) {
+				t->state=ST_CSI;
+				t->priv=0;
+				t->nparam=0;
+				memset(t->param, 0, sizeof(t->param));
+				continue;
+			}
+		} else if (t->state==ST_Y_ROW) {
+			s->cy=c-32;
+			t->state=ST_Y_COL;
+			continue;
+		} else if (t->state==ST_Y_COL) {
+			s->cx=c-32;
+			t->state=ST_GROUND;
+		} else if (t->state==ST_SKIP) {
+			t->state=ST_GROUND;
+			continue;
+		} else if (t->state==ST_CSI) {
+			if (c>='0' && c<='9') {
+				if (t->nparam==0) t->nparam=1;
+				int *p=&t->param[t->nparam-1];
+				if (*p<10000) *p=*p*10+(c-'0');
+				continue;
+			} else if (c==';') {
+				if (t->nparam==0) t->nparam=1;
+				if (t->nparam<IE15_TERM_MAXPARAM) t->nparam++;
+				continue;
+			} else if (c=='?') {
+				t->priv=1;
+				continue;
+			} else if (c<0x40) {
+				//other parameter and intermediate characters; nothing we need uses them
+				continue;
+			}
+			a=(c<128)?csi_action[c]:A_NONE;
+			t->ansi=1;
+			t->state=ST_GROUND;
+			if (t->priv && a!=A_RM) a=A_NONE;
+		}
+		if (a==A_ESC) {
+			t->state=ST_ESC;
+			t->nparam=0;
+			continue;
+		}
+		do_action(t, a);
+		//The VT52 sequences and the control characters can move the cursor anywhere;
+		//the CSI ones keep it on the screen by themselves.
+		fix_cursor(s);
+	}
+}
@@ -0,0 +1,31 @@
+//Interpretation of the character stream sent to the IE15 terminal.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+#include "ie15screen.h"
+
+#define IE15_TERM_MAXPARAM 8
+
+//Parser state. It's a push parser: escape sequences can be split over calls to
+//ie15_term_feed in any way.
+typedef struct {
+	ie15_screen_t *s;
+	uint8_t state;
+	uint8_t altchar;		//Russian (KOI-7 upper half) character set selected
+	uint8_t ansi;			//VT100 mode: ESC D and ESC M mean index and reverse index
+	uint8_t priv;			//CSI sequence had a '?'
+	int param[IE15_TERM_MAXPARAM];
+	int nparam;
+	int saved_cx, saved_cy;
+} ie15_term_t;
+
+void ie15_term_init(ie15_term_t *t, ie15_screen_t *s);
+//Applies len characters of terminal output to the screen.
+void ie15_term_feed(ie15_term_t *t, const uint8_t *buf, int len);
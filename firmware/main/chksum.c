@@ -0,0 +1,128 @@
+//Checksums for network packets, shared by sim_ether, wifid and the host network backends.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#include "chksum.h"
+
+#ifdef ESP_PLATFORM
+#include "esp32/rom/crc.h"
+
+//The ESP32 has no CRC hardware, but its ROM has a table-driven CRC32. Using that runs
+//from (cached) ROM and costs no RAM, which an 8K slice-by-8 table would.
+uint32_t chksum_crc32(uint32_t crc, const void *buf, size_t len) {
+	return crc32_le(crc, (const uint8_t*)buf, len);
+}
+
+#else
+
+#include <pthread.h>
+
+/*
+Slice-by-8: eight tables, where table n holds the CRC of a byte followed by n zero bytes,
+so eight input bytes can be folded in with eight independent lookups instead of a chain
+of eight dependent ones. (SSE4.2 has a CRC32 instruction, but it uses the Castagnoli
+polynomial, not the Ethernet one.)
+*/
+static uint32_t crc_table[8][256];
+//The emulator and the backend threads can both be the first to want a CRC
+static pthread_once_t crc_table_once=PTHREAD_ONCE_INIT;
+
+static void crc_make_tables() {
+	for (int i=0; i<256; i++) {
+		uint32_t c=i;
+		for (int j=0; j<8; j++) c=(c>>1)^((c&1)?0xEDB88320:0);
+		crc_table[0][i]=c;
+	}
+	for (int i=0; i<256; i++) {
+		for (int t=1; t<8; t++) {
+			crc_table[t][i]=(crc_table[t-1][i]>>8)^crc_table[0][crc_table[t-1][i]&0xff];
+		}
+	}
+}
+
+static uint32_t load_le32(const uint8_t *p) {
+	return p[0]|(p[1]<<8)|(p[2]<<16)|((uint32_t)p[3]<<24);
+}
+
+uint32_t chksum_crc32(uint32_t crc, const void *vbuf, size_t len) {
+	const uint8_t *buf=(const uint8_t*)vbuf;
+	pthread_once(&crc_table_once, crc_make_tables);
+	crc=~crc;
+	while (len>=8) {
+		uint32_t a=load_le32(buf)^crc;
+		uint32_t b=load_le32(buf+4);
+		crc=crc_table[7][a&0xff]^crc_table[6][(a>>8)&0xff]^
+			crc_table[5][(a>>16)&0xff]^crc_table[4][a>>24]^
+			crc_table[3][b&0xff]^crc_table[2][(b>>8)&0xff]^
+			crc_table[1][(b>>16)&0xff]^crc_table[0][b>>24];
+		buf+=8;
+		len-=8;
+	}
+	while (len--) crc=(crc>>8)^crc_table[0][(crc^*buf++)&0xff];
+	return ~crc;
+}
+
+#endif
+
+/*
+The Internet checksum doesn't care about the order in which the 16-bit words are added,
+nor (RFC 1071) about byte order, as long as it's swapped back at the end. So we add up
+native 32-bit words into a 64-bit accumulator, which can't overflow for anything that
+fits in a packet, and only fold and swap once.
+*/
+static int is_little_endian() {
+	const uint16_t one=1;
+	return *(const uint8_t*)&one;
+}
+
+uint16_t chksum_inet_sum(const void *vbuf, size_t len) {
+	const uint8_t *buf=(const uint8_t*)vbuf;
+	uint64_t sum=0;
+	uint32_t w;
+	while (len>=16) {
+		uint32_t v[4];
+		memcpy(v, buf, 16);
+		sum+=(uint64_t)v[0]+v[1]+v[2]+v[3];
+		buf+=16;
+		len-=16;
+	}
+	while (len>=4) {
+		memcpy(&w, buf, 4);
+		sum+=w;
+		buf+=4;
+		len-=4;
+	}
+	if (len>=2) {
+		uint16_t h;
+		memcpy(&h, buf, 2);
+		sum+=h;
+		buf+=2;
+		len-=2;
+	}
+	if (len) {
+		//pad the last byte with a zero, in memory order
+		uint16_t h=0;
+		memcpy(&h, buf, 1);
+		sum+=h;
+	}
+	while (sum>>16) sum=(sum&0xffff)+(sum>>16);
+	uint16_t r=sum;
+	if (is_little_endian()) r=(r>>8)|(r<<8);
+	return r;
+}
+
+uint16_t chksum_inet_add(uint16_t a, uint16_t b) {
+	uint32_t sum=(uint32_t)a+b;
+	return (sum&0xffff)+(sum>>16);
+}
+
+uint16_t chksum_inet(const void *buf, size_t len) {
+	return ~chksum_inet_sum(buf, len);
+}
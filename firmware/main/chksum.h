@@ -0,0 +1,26 @@
+//Checksums used on network packets: the Ethernet CRC32 and the Internet (IP/UDP/ICMP)
+//ones' complement checksum.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//IEEE 802.3 CRC32, zlib style: pass 0 to start, or the result of the previous call to
+//continue a CRC over more data.
+uint32_t chksum_crc32(uint32_t crc, const void *buf, size_t len);
+
+//Ones' complement sum of the data as big-endian 16-bit words, folded to 16 bits but not
+//inverted. Sums of pieces can be combined with chksum_inet_add; an odd-length piece
+//can only be the last one.
+uint16_t chksum_inet_sum(const void *buf, size_t len);
+uint16_t chksum_inet_add(uint16_t a, uint16_t b);
+
+//Internet checksum of the data, as a number: store it big-endian.
+uint16_t chksum_inet(const void *buf, size_t len);
@@ -0,0 +1,107 @@
+/*
+Checks the checksum routines in chksum.c against straightforward byte-at-a-time versions
+(the CRC32 table loop that used to live in sim_ether.c, and a plain 16-bit Internet
+checksum), then reports how fast both are.
+
+Usage: chksum_bench [megabytes]
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chksum.h"
+
+static uint32_t ref_table[256];
+
+static uint32_t ref_crc32(uint32_t crc, const uint8_t *buf, size_t len) {
+	crc^=0xFFFFFFFF;
+	while (len--) crc=(crc>>8)^ref_table[(crc^*buf++)&0xFF];
+	return crc^0xFFFFFFFF;
+}
+
+static uint16_t ref_inet(const uint8_t *p, size_t len) {
+	uint32_t sum=0;
+	while (len>1) {
+		sum+=(p[0]<<8)|p[1];
+		p+=2;
+		len-=2;
+	}
+	if (len) sum+=p[0]<<8;
+	while (sum>>16) sum=(sum&0xffff)+(sum>>16);
+	return ~sum;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//Runs fn over the buffer in packet-sized pieces until 'total' bytes are done; returns MB/s
+#define BENCH(expr, total, sink) ({ \
+	double t0=now(); \
+	for (size_t done=0; done<(total); done+=1514) { sink+=(expr); } \
+	(total)/1e6/(now()-t0); })
+
+int main(int argc, char **argv) {
+	size_t total=(argc>1?atoi(argv[1]):200)*1000000UL;
+	uint8_t *buf=malloc(4096+16);
+	int errors=0;
+	uint32_t sink=0;
+
+	for (int i=0; i<256; i++) {
+		uint32_t c=i;
+		for (int j=0; j<8; j++) c=(c>>1)^((c&1)?0xEDB88320:0);
+		ref_table[i]=c;
+	}
+	srand(1);
+	for (int i=0; i<4096+16; i++) buf[i]=rand();
+
+	if (chksum_crc32(0, "123456789", 9)!=0xCBF43926) {
+		printf("crc32 check value wrong: %08X\n", chksum_crc32(0, "123456789", 9));
+		errors++;
+	}
+	//all lengths and alignments, plus split computations
+	for (int off=0; off<8; off++) {
+		for (int len=0; len<=1600; len++) {
+			const uint8_t *p=buf+off;
+			if (chksum_crc32(0, p, len)!=ref_crc32(0, p, len)) {
+				printf("crc32 mismatch off %d len %d\n", off, len);
+				errors++;
+			}
+			int split=len/3;
+			if (chksum_crc32(chksum_crc32(0, p, split), p+split, len-split)!=ref_crc32(0, p, len)) {
+				printf("crc32 mismatch off %d len %d split %d\n", off, len, split);
+				errors++;
+			}
+			if (chksum_inet(p, len)!=ref_inet(p, len)) {
+				printf("inet mismatch off %d len %d: %04X vs %04X\n", off, len, chksum_inet(p, len), ref_inet(p, len));
+				errors++;
+			}
+			split&=~1;
+			if ((uint16_t)~chksum_inet_add(chksum_inet_sum(p, split), chksum_inet_sum(p+split, len-split))!=ref_inet(p, len)) {
+				printf("inet mismatch off %d len %d split %d\n", off, len, split);
+				errors++;
+			}
+		}
+	}
+	printf("%s\n", errors?"FAILED":"all checksums match the reference implementations");
+
+	printf("crc32, byte at a time:  %7.1f MB/s\n", BENCH(ref_crc32(0, buf, 1514), total, sink));
+	printf("crc32, chksum.c:        %7.1f MB/s\n", BENCH(chksum_crc32(0, buf, 1514), total, sink));
+	printf("inet, 16 bits at a time: %7.1f MB/s\n", BENCH(ref_inet(buf, 1514), total, sink));
+	printf("inet, chksum.c:          %7.1f MB/s\n", BENCH(chksum_inet(buf, 1514), total, sink));
+	if (sink==0x12345678) printf("\n"); //keeps the compiler from dropping the work
+	free(buf);
+	return errors?1:0;
+}
@@ -0,0 +1,179 @@
+/*
+Replays a disk request trace (as written by sim_disk with ESPPDP_DISK_TRACE set,
+or CONFIG_ESPPDP_DISK_TRACE on the ESP32) against a disk image, using the real
+sim_disk.c code, and reports how fast the selected storage backend handled it.
+
+Usage: disk_replay [-b file|cached|journal|mmap] [-u unit] [-w blocksize] trace image
+
+The image is written to; use a scratch copy.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "sim_defs.h"
+#include "sim_disk.h"
+#include <time.h>
+#include <unistd.h>
+
+#define SECTOR_SIZE 512
+
+//sim_disk.c is linked on its own; these stand in for the bits of scp it uses.
+FILE *sim_deb = NULL;
+int32 sim_end = 1;
+
+void _sim_debug_unit (uint32 dbits, UNIT *uptr, const char* fmt, ...) {
+}
+
+DEVICE *find_dev_from_unit (UNIT *uptr) {
+	return uptr->dptr;
+}
+
+const char *sim_uname (UNIT *uptr) {
+	return "DISK";
+}
+
+const char *sim_get_os_error_text (int Error) {
+	return strerror (Error);
+}
+
+double sim_gtime (void) {
+	return 0;
+}
+
+static t_uint64 now_nsec (void) {
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (t_uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint32 sim_os_msec (void) {
+	return (uint32)(now_nsec () / 1000000);
+}
+
+static UNIT replay_unit;
+static DEVICE replay_dev = {
+	"DISK", &replay_unit, NULL, NULL,
+	1, 16, 32, 2, 16, 16,
+};
+
+static int cmp_u64 (const void *a, const void *b) {
+	t_uint64 x = *(const t_uint64 *)a, y = *(const t_uint64 *)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+static double pct (t_uint64 *lat, size_t n, double p) {
+	size_t i = (size_t)(p * (n - 1));
+	return n ? lat[i] / 1000.0 : 0;
+}
+
+static void usage (void) {
+	fprintf (stderr, "Usage: disk_replay [-b file|cached|journal|mmap] [-u unit] [-w blocksize] trace image\n");
+	exit (1);
+}
+
+int main (int argc, char **argv) {
+	const char *backend = "cached";
+	int unit = -1, c;
+	struct sim_disk_trace_hdr hdr;
+	struct sim_disk_trace_rec rec;
+	uint8 *buf = NULL;
+	size_t bufsize = 0, n = 0, nalloc = 0;
+	t_uint64 *lat = NULL, bytes_rd = 0, bytes_wr = 0, nrd = 0, nwr = 0, nfl = 0;
+	t_uint64 t_start, t_end;
+	t_seccnt done;
+	FILE *f;
+
+	while ((c = getopt (argc, argv, "b:u:w:")) != -1) {
+		if (c == 'b') backend = optarg;
+		else if (c == 'u') unit = atoi (optarg);
+		else if (c == 'w') sim_disk_wc_block = atoi (optarg);
+		else usage ();
+	}
+	if (argc - optind != 2) usage ();
+
+	sim_disk_mmap = FALSE;
+	sim_disk_trace_path = NULL;
+	sim_disk_prefetch_kb = 0;		//no boot profile beside the scratch image
+	unsetenv ("ESPPDP_DISK_TRACE");
+	if (strcmp (backend, "file") == 0) {
+		sim_disk_wc_slots = 0;
+	} else if (strcmp (backend, "cached") == 0) {
+	} else if (strcmp (backend, "journal") == 0) {
+		sim_disk_journal = TRUE;
+	} else if (strcmp (backend, "mmap") == 0) {
+		sim_disk_mmap = TRUE;
+	} else {
+		usage ();
+	}
+
+	f = fopen (argv[optind], "rb");
+	if (f == NULL) {
+		perror (argv[optind]);
+		return 1;
+	}
+	if ((fread (&hdr, sizeof (hdr), 1, f) != 1) || (hdr.magic != DK_TRACE_MAGIC) ||
+			(hdr.version != DK_TRACE_VERSION) || (hdr.rec_size != sizeof (rec))) {
+		fprintf (stderr, "%s: not a disk trace\n", argv[optind]);
+		return 1;
+	}
+
+	replay_unit.flags = UNIT_ATTABLE;
+	replay_unit.dptr = &replay_dev;
+	if (sim_disk_attach (&replay_unit, argv[optind + 1], SECTOR_SIZE, sizeof (uint16), TRUE, 0, "RA92", 0, 0) != SCPE_OK) {
+		fprintf (stderr, "%s: can't attach\n", argv[optind + 1]);
+		return 1;
+	}
+
+	t_start = now_nsec ();
+	while (fread (&rec, sizeof (rec), 1, f) == 1) {
+		t_uint64 t0;
+		t_stat r = SCPE_OK;
+		if ((unit >= 0) && (rec.unit != unit)) continue;
+		if ((size_t)rec.sects * SECTOR_SIZE > bufsize) {
+			bufsize = (size_t)rec.sects * SECTOR_SIZE;
+			buf = (uint8 *)realloc (buf, bufsize);
+			memset (buf, 0xA5, bufsize);
+		}
+		if (n == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 4096;
+			lat = (t_uint64 *)realloc (lat, nalloc * sizeof (*lat));
+		}
+		t0 = now_nsec ();
+		if (rec.op == DK_TRACE_RD) {
+			r = sim_disk_rdsect (&replay_unit, rec.lba, buf, &done, rec.sects);
+			bytes_rd += (t_uint64)rec.sects * SECTOR_SIZE;
+			nrd++;
+		} else if (rec.op == DK_TRACE_WR) {
+			r = sim_disk_wrsect (&replay_unit, rec.lba, buf, &done, rec.sects);
+			bytes_wr += (t_uint64)rec.sects * SECTOR_SIZE;
+			nwr++;
+		} else if (rec.op == DK_TRACE_FLUSH) {
+			r = sim_disk_flush (&replay_unit);
+			nfl++;
+		}
+		sim_disk_tick (&replay_unit);
+		lat[n++] = now_nsec () - t0;
+		if (r != SCPE_OK) fprintf (stderr, "request %d (lba %d) failed: %d\n", (int)n, (int)rec.lba, r);
+	}
+	sim_disk_detach (&replay_unit);
+	t_end = now_nsec ();
+	fclose (f);
+
+	qsort (lat, n, sizeof (*lat), cmp_u64);
+	double secs = (t_end - t_start) / 1e9;
+	printf ("backend %s: %d requests (%d rd, %d wr, %d flush) in %.3f s\n", backend,
+			(int)n, (int)nrd, (int)nwr, (int)nfl, secs);
+	printf ("IOPS %.0f, read %.1f MB, written %.1f MB, %.1f MB/s\n", n / secs,
+			bytes_rd / 1e6, bytes_wr / 1e6, (bytes_rd + bytes_wr) / 1e6 / secs);
+	printf ("latency usec: p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+			pct (lat, n, 0.50), pct (lat, n, 0.90), pct (lat, n, 0.99), pct (lat, n, 1.0));
+	free (lat);
+	free (buf);
+	return 0;
+}
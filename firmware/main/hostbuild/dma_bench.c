@@ -0,0 +1,250 @@
+/*
+Benchmarks the DMA routines of pdp11_io.c (Map_ReadB/ReadW/WriteB/WriteW) against the way they
+used to move data, a byte or word at a time through the RdMem/WrMem lanes, with the Unibus map
+off and on. Also checks that both give the same data and residual counts for odd, page
+straddling and non-existent memory transfers.
+
+Usage: dma_bench [-n transfers]
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "pdp11_defs.h"
+#include <time.h>
+#include <unistd.h>
+
+#define MEM_BYTES (256*1024)
+#define XFER_BYTES 32768
+
+//pdp11_io.c is linked on its own; these stand in for the bits of the CPU and scp it uses.
+uint16 *M;
+int32 cpu_bme;
+uint32 cpu_opt;
+int32 int_req[IPL_HLVL];
+int32 ub_map[UBM_LNT_LW];
+int32 trap_req, ipl;
+int32 uba_last;
+int32 sim_end=1;
+UNIT cpu_unit={UDATA(NULL, UNIT_FIX, MEM_BYTES)};
+DEVICE cpu_dev={"CPU", &cpu_unit};
+DEVICE *sim_devices[]={&cpu_dev, NULL};
+
+t_stat cpu_build_dib(void) {
+	return SCPE_OK;
+}
+
+void init_mbus_tab(void) {
+}
+
+void init_ubus_tab(void) {
+}
+
+t_stat build_mbus_tab(DEVICE *dptr, DIB *dibp) {
+	return SCPE_OK;
+}
+
+t_stat build_ubus_tab(DEVICE *dptr, DIB *dibp) {
+	return SCPE_OK;
+}
+
+//Private to pdp11_io.c
+#define BUSMASK ((UNIBUS)? UNIMASK: PAMASK)
+uint32 Map_Addr(uint32 ba);
+
+//The memory part of the old Map_xxx routines, as the baseline.
+static int32 old_read_b(uint32 ba, int32 bc, uint8 *buf) {
+	uint32 alim, lim, ma;
+	ba=ba&BUSMASK;
+	lim=ba+bc;
+	if (cpu_bme) {
+		for ( ; ba<lim; ba++) {
+			ma=Map_Addr(ba);
+			if (!ADDR_IS_MEM(ma)) return lim-ba;
+			*buf++=(uint8)RdMemB(ma);
+		}
+		return 0;
+	}
+	if (ADDR_IS_MEM(lim)) alim=lim;
+	else if (ADDR_IS_MEM(ba)) alim=MEMSIZE;
+	else return bc;
+	for ( ; ba<alim; ba++) *buf++=(uint8)RdMemB(ba);
+	return lim-alim;
+}
+
+static int32 old_read_w(uint32 ba, int32 bc, uint16 *buf) {
+	uint32 alim, lim, ma;
+	ba=(ba&BUSMASK)&~01;
+	lim=ba+(bc&~01);
+	if (cpu_bme) {
+		for ( ; ba<lim; ba+=2) {
+			ma=Map_Addr(ba);
+			if (!ADDR_IS_MEM(ma)) return lim-ba;
+			*buf++=(uint16)RdMemW(ma);
+		}
+		return 0;
+	}
+	if (ADDR_IS_MEM(lim)) alim=lim;
+	else if (ADDR_IS_MEM(ba)) alim=MEMSIZE;
+	else return bc;
+	for ( ; ba<alim; ba+=2) *buf++=(uint16)RdMemW(ba);
+	return lim-alim;
+}
+
+static int32 old_write_b(uint32 ba, int32 bc, const uint8 *buf) {
+	uint32 alim, lim, ma;
+	ba=ba&BUSMASK;
+	lim=ba+bc;
+	if (cpu_bme) {
+		for ( ; ba<lim; ba++) {
+			ma=Map_Addr(ba);
+			if (!ADDR_IS_MEM(ma)) return lim-ba;
+			WrMemB(ma, ((uint16)*buf++));
+		}
+		return 0;
+	}
+	if (ADDR_IS_MEM(lim)) alim=lim;
+	else if (ADDR_IS_MEM(ba)) alim=MEMSIZE;
+	else return bc;
+	for ( ; ba<alim; ba++) WrMemB(ba, ((uint16)*buf++));
+	return lim-alim;
+}
+
+static int32 old_write_w(uint32 ba, int32 bc, const uint16 *buf) {
+	uint32 alim, lim, ma;
+	ba=(ba&BUSMASK)&~01;
+	lim=ba+(bc&~01);
+	if (cpu_bme) {
+		for ( ; ba<lim; ba+=2) {
+			ma=Map_Addr(ba);
+			if (!ADDR_IS_MEM(ma)) return lim-ba;
+			WrMemW(ma, *buf++);
+		}
+		return 0;
+	}
+	if (ADDR_IS_MEM(lim)) alim=lim;
+	else if (ADDR_IS_MEM(ba)) alim=MEMSIZE;
+	else return bc;
+	for ( ; ba<alim; ba+=2) WrMemW(ba, *buf++);
+	return lim-alim;
+}
+
+typedef struct {
+	int32 (*read_b)(uint32 ba, int32 bc, uint8 *buf);
+	int32 (*read_w)(uint32 ba, int32 bc, uint16 *buf);
+	int32 (*write_b)(uint32 ba, int32 bc, const uint8 *buf);
+	int32 (*write_w)(uint32 ba, int32 bc, const uint16 *buf);
+} dma_ops_t;
+
+static const dma_ops_t old_ops={old_read_b, old_read_w, old_write_b, old_write_w};
+static const dma_ops_t new_ops={Map_ReadB, Map_ReadW, Map_WriteB, Map_WriteW};
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//Map page that points past the end of memory
+#define NXM_PAGE 29
+
+//Physical, or through a Unibus map that scatters the pages over memory in reverse order.
+static void set_map(int on) {
+	cpu_bme=on;
+	cpu_opt=on?BUS_U:0;
+	for (int i=0; i<UBM_LNT_LW; i++) ub_map[i]=((UBM_LNT_LW-1-i)*UBM_PAGSIZE)%MEM_BYTES;
+	ub_map[NXM_PAGE]=2*MEM_BYTES;
+}
+
+static void fill_mem() {
+	for (int i=0; i<MEM_BYTES/2; i++) M[i]=i*7+3;
+}
+
+static uint32 sum(const void *data, int len) {
+	const uint8 *p=data;
+	uint32 s=0;
+	for (int i=0; i<len; i++) s=s*31+p[i];
+	return s;
+}
+
+//Runs transfers that start odd, straddle map pages or run into non-existent memory, and
+//returns a checksum over the data moved and the residuals. Only the memory part is compared;
+//the I/O page (and with the map on, everything from 760000 up is) didn't change.
+static uint32 edge_cases(const dma_ops_t *ops) {
+	static uint8 bb[65536];
+	static uint16 wb[32768];
+	uint32 nxm=cpu_bme?NXM_PAGE*UBM_PAGSIZE:MEM_BYTES;
+	uint32 s=0;
+	fill_mem();
+	memset(bb, 0, sizeof(bb));
+	memset(wb, 0, sizeof(wb));
+	s=s*31+ops->read_b(3, 60001, bb);
+	s=s*31+sum(bb, sizeof(bb));
+	s=s*31+ops->read_w(nxm-6*1024, 16384, wb);
+	s=s*31+sum(wb, sizeof(wb));
+	s=s*31+ops->read_b(nxm+1024, 100, bb);
+	for (int i=0; i<32768; i++) wb[i]=i^0x5a5a;
+	for (int i=0; i<65536; i++) bb[i]=i*13;
+	s=s*31+ops->write_w(nxm-1024+2, 5000, wb);
+	s=s*31+ops->write_b(UBM_PAGSIZE-5, 20011, bb);
+	s=s*31+ops->write_b(1, 7, bb);
+	s=s*31+sum(M, MEM_BYTES);
+	return s;
+}
+
+static double rate(int n, double t) {
+	return (double)n*XFER_BYTES/t/1e6;
+}
+
+int main(int argc, char **argv) {
+	static uint8 bb[XFER_BYTES];
+	static uint16 wb[XFER_BYTES/2];
+	int n=20000, opt, errors=0;
+	while ((opt=getopt(argc, argv, "n:"))!=-1) {
+		if (opt=='n') n=atoi(optarg);
+		else {
+			printf("Usage: %s [-n transfers]\n", argv[0]);
+			return 1;
+		}
+	}
+	M=calloc(MEM_BYTES, 1);
+
+	for (int map=0; map<2; map++) {
+		set_map(map);
+		uint32 s_old=edge_cases(&old_ops);
+		uint32 s_new=edge_cases(&new_ops);
+		if (s_old!=s_new) errors++;
+		printf("%s: edge cases %s\n", map?"mapped":"physical", (s_old==s_new)?"match":"DIFFER");
+	}
+
+	printf("%d transfers of %d bytes, MB/s      old       new\n", n, XFER_BYTES);
+	for (int map=0; map<2; map++) {
+		set_map(map);
+		const char *name[4]={"ReadB", "ReadW", "WriteB", "WriteW"};
+		double mbs[2][4];
+		for (int o=0; o<2; o++) {
+			const dma_ops_t *ops=o?&new_ops:&old_ops;
+			for (int k=0; k<4; k++) {
+				double t0=now();
+				for (int i=0; i<n; i++) {
+					uint32 ba=(i*XFER_BYTES)%(NXM_PAGE*UBM_PAGSIZE-XFER_BYTES);
+					if (k==0) ops->read_b(ba, XFER_BYTES, bb);
+					else if (k==1) ops->read_w(ba, XFER_BYTES, wb);
+					else if (k==2) ops->write_b(ba, XFER_BYTES, bb);
+					else ops->write_w(ba, XFER_BYTES, wb);
+				}
+				mbs[o][k]=rate(n, now()-t0);
+			}
+		}
+		for (int k=0; k<4; k++) {
+			printf("%-8s %-8s %23.0f %9.0f\n", map?"mapped":"physical", name[k], mbs[0][k], mbs[1][k]);
+		}
+	}
+	free(M);
+	return errors?1:0;
+}
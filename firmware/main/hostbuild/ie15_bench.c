@@ -0,0 +1,232 @@
+/*
+Runs the IE15 terminal (escape sequence parser, screen model, dirty tracking, glyph cache)
+against the framebuffer backend, checks after every flush that the framebuffer matches the
+screen as drawn pixel by pixel straight from the character generator ROM, and reports how
+fast it all goes, with and without drawing, and how many LCD windows and bytes the output
+would have cost.
+
+Usage: ie15_bench [-c chargen.bin] [-f chars_per_flush] [-o last_screen.ppm] [stream...]
+
+The streams are files with recorded terminal output; without them, a few MB of 'ls -l'-like
+output with some VT52 and VT100 full-screen updates mixed in is used.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ie15screen.h"
+#include "ie15glyph.h"
+#include "ie15term.h"
+#include "ie15fb.h"
+
+static uint8_t chargen[2048];
+
+static uint8_t *stream;
+static size_t stream_len, stream_pos;
+static int chars_per_flush=256;
+
+static ie15_screen_t screen;
+static ie15_term_t term;
+static long flushes, areas, rows_sent, bytes_sent, check_errors;
+static int check=1;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+//The way ie15lcd.c used to draw a cell: two ROM pixels per LCD pixel, looked up one by one.
+static int get_pix(int c, int x, int y) {
+	return (chargen[c*8+y]>>(7-x))&1;
+}
+
+static uint16_t lcdrgb(int r, int g, int b) {
+	int rr=((r>>3)<<11)+((g>>2)<<5)+(b>>3);
+	return ((rr&0xff)<<8)+(rr>>8);
+}
+
+static void ref_draw_char(uint16_t *fb, int c, int cx, int cy) {
+	uint16_t cols[3]={lcdrgb(0, 0, 0), lcdrgb(13, 210, 13), lcdrgb(16, 255, 16)};
+	for (int ly=0; ly<IE15_CHH; ly++) {
+		for (int lx=0; lx<IE15_CHW; lx++) {
+			uint16_t p=0;
+			if (ly<8) p=cols[get_pix(c, lx*2, ly)+get_pix(c, lx*2+1, ly)];
+			fb[(cy*IE15_CHH+ly)*IE15_FB_W+cx*IE15_CHW+lx]=p;
+		}
+	}
+}
+
+static void ref_draw_screen(uint16_t *fb, ie15_screen_t *s) {
+	for (int y=0; y<IE15_ROWS; y++) {
+		for (int x=0; x<IE15_COLS; x++) ref_draw_char(fb, ie15_scr_row(s, y)[x], x, y);
+	}
+}
+
+static void flush() {
+	static uint16_t ref[IE15_FB_H*IE15_FB_W];
+	ie15_rect_t r;
+	ie15_screen_t copy=screen;
+	//count what the LCD would get, from a copy as taking the dirty areas clears them
+	while (ie15_scr_take_dirty(&copy, &r)) {
+		rows_sent+=r.y1-r.y0;
+		bytes_sent+=(r.x1-r.x0)*IE15_CHW*(r.y1-r.y0)*IE15_CHH*2;
+	}
+	areas+=ie15_fb_flush(&screen);
+	flushes++;
+	if (check) {
+		ref_draw_screen(ref, &screen);
+		if (memcmp(ref, ie15_fb, sizeof(ref))!=0) {
+			if (check_errors==0) printf("framebuffer differs from screen after %zu chars\n", stream_pos);
+			check_errors++;
+		}
+	}
+}
+
+//Feeds the stream to the terminal, flushing every chars_per_flush characters like the LCD
+//task does while output keeps coming.
+static void run_stream(int flushing) {
+	ie15_scr_init(&screen);
+	ie15_term_init(&term, &screen);
+	for (stream_pos=0; stream_pos<stream_len; ) {
+		size_t n=stream_len-stream_pos;
+		if (n>chars_per_flush) n=chars_per_flush;
+		ie15_term_feed(&term, stream+stream_pos, n);
+		stream_pos+=n;
+		if (flushing) flush();
+	}
+}
+
+static void append(const void *data, size_t len) {
+	stream=realloc(stream, stream_len+len);
+	memcpy(stream+stream_len, data, len);
+	stream_len+=len;
+}
+
+static void append_str(const char *str) {
+	append(str, strlen(str));
+}
+
+static void make_stream(size_t size) {
+	const char *names[]={"README", "a.out", "boot", "etc", "libc.a", "unix", "vmunix.old", "wifid"};
+	char line[128];
+	srand(1);
+	int n=0;
+	while (stream_len<size) {
+		int len=sprintf(line, "-rw-r--r--  1 root  %8d Jan %2d 12:%02d %s%d\r\n",
+				rand()%100000, rand()%31+1, rand()%60, names[rand()%8], n++);
+		append(line, len);
+		if ((n%500)==0) {
+			//a full-screen program: home, clear, draw some status lines at fixed positions
+			append("\033H\033J", 4);
+			for (int i=0; i<10; i++) {
+				len=sprintf(line, "\033Y%c%cstatus %d\033K", 32+i*2, 32+i*3, i);
+				append(line, len);
+			}
+			append("\033Y7 ", 4);
+		}
+		if ((n%700)==0) {
+			//a VT100 full-screen program, like vi: scrolling region, reverse index, inserting
+			//and deleting lines and characters
+			append_str("\033[H\033[2J\033[1;23r");
+			for (int i=0; i<30; i++) {
+				len=sprintf(line, "\033[%d;1H\033[K~ line %d\033[%d;%dH\033[2P\033[1@x", i%23+1, i, i%23+1, i%40+1);
+				append(line, len);
+			}
+			append_str("\033[H\033M\033M\033[5;1H\033[3L\033[2M\033[23;1H\n\n");
+			append_str("\033[r\033[24;1H");
+		}
+	}
+}
+
+static int read_file(const char *path) {
+	FILE *f=fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	char buf[65536];
+	size_t n;
+	while ((n=fread(buf, 1, sizeof(buf), f))>0) append(buf, n);
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	const char *chargen_path="../../components/ie15term/chargen.bin";
+	const char *ppm=NULL;
+	int opt;
+	while ((opt=getopt(argc, argv, "c:f:o:"))!=-1) {
+		if (opt=='c') chargen_path=optarg;
+		else if (opt=='f') chars_per_flush=atoi(optarg);
+		else if (opt=='o') ppm=optarg;
+		else {
+			printf("Usage: %s [-c chargen.bin] [-f chars_per_flush] [-o last_screen.ppm] [stream...]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (chars_per_flush<1) chars_per_flush=1;
+	FILE *f=fopen(chargen_path, "rb");
+	if (!f || fread(chargen, 1, sizeof(chargen), f)!=sizeof(chargen)) {
+		printf("Can't read character generator ROM %s\n", chargen_path);
+		return 1;
+	}
+	fclose(f);
+	for (int i=optind; i<argc; i++) {
+		if (read_file(argv[i])!=0) return 1;
+	}
+	if (stream_len==0) make_stream(4*1000*1000);
+	ie15_glyph_init(chargen);
+
+	//Correctness: check the framebuffer after every flush
+	run_stream(1);
+	printf("%zu chars, %ld flushes: %s\n", stream_len, flushes, check_errors?"FRAMEBUFFER MISMATCH":"framebuffer matches");
+
+	//Speed, without the checks
+	check=0;
+	flushes=areas=rows_sent=bytes_sent=0;
+	double t0=now();
+	run_stream(1);
+	double t=now()-t0;
+	printf("terminal: %.1f Mchars/s, flush every %d chars\n", stream_len/t/1e6, chars_per_flush);
+	printf("LCD: %ld windows, %ld row transfers, %.1f MB of pixels (%.1f bytes/char)\n",
+			areas, rows_sent, bytes_sent/1e6, (double)bytes_sent/stream_len);
+	//Just the parser and screen model
+	int runs=10;
+	t0=now();
+	for (int i=0; i<runs; i++) run_stream(0);
+	t=now()-t0;
+	printf("parser: %.1f Mchars/s\n", stream_len*runs/t/1e6);
+
+	//Glyph cache against the old per-pixel lookup, drawing full screens
+	static uint16_t ref[IE15_FB_H*IE15_FB_W];
+	int screens=2000;
+	t0=now();
+	for (int i=0; i<screens; i++) {
+		ie15_scr_invalidate(&screen);
+		ie15_fb_flush(&screen);
+	}
+	double t_cache=now()-t0;
+	t0=now();
+	for (int i=0; i<screens; i++) ref_draw_screen(ref, &screen);
+	double t_ref=now()-t0;
+	printf("full screen redraw: glyph cache %.1f us, per-pixel lookup %.1f us\n",
+			t_cache/screens*1e6, t_ref/screens*1e6);
+
+	if (ppm && ie15_fb_write_ppm(ppm)!=0) {
+		printf("Can't write %s\n", ppm);
+		return 1;
+	}
+	return check_errors?1:0;
+}
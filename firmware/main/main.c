@@ -9,6 +9,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -90,15 +91,14 @@ void app_main(void) {
 	ESP_ERROR_CHECK(ret);
 
 	ie15_init();
-	//We cheat here: as the buffer in the IE15 emu is only 8 bytes, the following routine
-	//will only finish after the initialization is complete.
+	//This shows up as soon as the terminal task has initialized the LCD.
 	const char signon[]="Initializing emulator...\r\n";
-	for (const char *p=signon; *p!=0; p++) ie15_sendchar(*p);
+	ie15_write(signon, strlen(signon));
 
 	//Initialize SD-card, if possible
 	esp_vfs_fat_sdmmc_mount_config_t mount_config = {
 		.format_if_mount_failed = false,
-		.max_files = 2,
+		.max_files = 6,		//disk image, journal, trace, prefetch, boot profile, net.pcap capture
 		.allocation_unit_size = 16 * 1024
 	};
 	sdmmc_card_t* card;
@@ -118,7 +118,7 @@ void app_main(void) {
 	if (ret != ESP_OK) {
 		ESP_LOGE(TAG, "SD-card: Failed to mount filesystem.");
 		const char noflopstr[]="No SD card. Booting from built-in floppy.\r\n";
-		for (const char *p=noflopstr; *p!=0; p++) ie15_sendchar(*p);
+		ie15_write(noflopstr, strlen(noflopstr));
 	} else {
 		sdmmc_card_print_info(stdout, card);
 	}
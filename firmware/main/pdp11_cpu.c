@@ -231,7 +231,11 @@
 #include "pdp11_defs.h"
 #include "pdp11_cpumod.h"
 #include "sim_term.h"
+#ifdef ESP_PLATFORM
 #include "esp_attr.h"
+#else
+#define IRAM_ATTR
+#endif
 
 #define PCQ_SIZE        64                              /* must be 2**n */
 #define PCQ_MASK        (PCQ_SIZE - 1)
@@ -665,6 +669,10 @@ MTAB cpu_mod[] = {
       NULL, &show_iospace },
     { MTAB_XTD|MTAB_VDV, 0, "IDLE", "IDLE", &sim_set_idle, &sim_show_idle },
     { MTAB_XTD|MTAB_VDV, 0, NULL, "NOIDLE", &sim_clr_idle, NULL },
+    { MTAB_XTD|MTAB_VDV, 1, "TIMING", "FASTTIMING",
+      &cpu_set_timing, &cpu_show_timing, NULL, "Cut device delays below real hardware" },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NORMALTIMING",
+      &cpu_set_timing, NULL, NULL, "Real hardware device delays" },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP, 0, "HISTORY", "HISTORY",
       &cpu_set_hist, &cpu_show_hist },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP, 0, "VIRTUAL", NULL,
@@ -854,6 +854,11 @@ int32 Map_ReadB (uint32 ba, int32 bc, uint8 *buf);
 int32 Map_ReadW (uint32 ba, int32 bc, uint16 *buf);
 int32 Map_WriteB (uint32 ba, int32 bc, const uint8 *buf);
 int32 Map_WriteW (uint32 ba, int32 bc, const uint16 *buf);
+uint16 *Map_Direct (uint32 ba, int32 bc);
+void set_timing_profile (t_bool fast);
+t_stat cpu_set_timing (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_timing (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+void timing_backoff (const char *dev);
 
 int32 mba_rdbufW (uint32 mbus, int32 bc, uint16 *buf);
 int32 mba_wrbufW (uint32 mbus, int32 bc, const uint16 *buf);
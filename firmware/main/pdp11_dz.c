@@ -0,0 +1,451 @@
+/* pdp11_dz.c: DZ11 terminal multiplexer
+
+   dz           DZ11 terminal multiplexers, up to DZ_MUXES of 8 lines each
+
+   This is a new implementation on top of telmux (TCP connections on the loopback
+   interface) rather than SIMH's TMXR library, which this tree doesn't have. The
+   lines only exist in the host build; set ESPPDP_DZ to a port number to listen on
+   it, e.g. ESPPDP_DZ=2311, and telnet to 127.0.0.1 there to get a line. Without
+   it, the multiplexers are still there but nothing ever connects.
+
+   The register interface follows the DZ11 user's guide (EK-DZ110-UG):
+
+   CSR      <15> TRDY  <14> TIE  <13> SA  <12> SAE  <10:8> TLINE
+            <7> RDONE  <6> RIE  <5> MSE  <4> CLR  <3> MAINT
+   RBUF     <15> VALID  <14> OVRE  <13> FRME  <12> PARE  <10:8> line  <7:0> char
+   LPR      <12> RCVR ON  <11:8> speed  <7> odd par  <6> par enb  <5> stop  <4:3> len
+            <2:0> line  (write only, at the RBUF address)
+   TCR      <15:8> DTR  <7:0> line enable
+   MSR      <15:8> carrier detect  <7:0> ring  (read only)
+   TDR      <15:8> break  <7:0> char  (write only, at the MSR address)
+
+   A connected line has carrier. Dropping DTR on a connected line (what the guest does
+   on hangup, e.g. when a user logs out) closes the connection.
+
+   Received characters wait in telmux's per line buffers until there's room in the
+   64 character silo, so there are no overruns. The silo is refilled as soon as the
+   guest has emptied it, so a fast typist or a script isn't limited to a silo per
+   clock tick.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include "pdp11_defs.h"
+#include "telmux.h"
+
+#define DZ_LINES        8                               /* lines per mux */
+#define DZ_LNOMASK      (DZ_LINES - 1)
+#define DZ_SILO_SIZE    64
+#define DZ_SILO_ALM     16                              /* silo alarm level */
+#define IOLN_DZ         010
+
+#define CSR_MAINT       0000010                         /* maint - NI */
+#define CSR_CLR         0000020                         /* clear */
+#define CSR_MSE         0000040                         /* master scan enb */
+#define CSR_RIE         0000100                         /* rcv int enb */
+#define CSR_RDONE       0000200                         /* rcv done - RO */
+#define CSR_V_TLINE     8                               /* xmit line - RO */
+#define CSR_TLINE       (DZ_LNOMASK << CSR_V_TLINE)
+#define CSR_SAE         0010000                         /* silo alm enb */
+#define CSR_SA          0020000                         /* silo alm - RO */
+#define CSR_TIE         0040000                         /* xmit int enb */
+#define CSR_TRDY        0100000                         /* xmit rdy - RO */
+#define CSR_RW          (CSR_MAINT | CSR_MSE | CSR_RIE | CSR_SAE | CSR_TIE)
+
+#define RBUF_V_RLINE    8                               /* rcv line */
+#define RBUF_VALID      0100000                         /* data valid */
+
+#define LPR_V_LINE      0                               /* line */
+#define LPR_V_LEN       3                               /* character length */
+#define LPR_RCVE        0010000                         /* receive enb */
+
+#define TCR_V_DTR       8                               /* DTR bits */
+#define MSR_V_CD        8                               /* carrier detect */
+
+extern int32 tmxr_poll;
+
+uint16 dz_csr[DZ_MUXES] = { 0 };                        /* csr */
+uint16 dz_tcr[DZ_MUXES] = { 0 };                        /* xmit control */
+uint16 dz_silo[DZ_MUXES][DZ_SILO_SIZE];                 /* receive silo */
+int32 dz_silo_head[DZ_MUXES] = { 0 };                   /* next char out */
+int32 dz_silo_cnt[DZ_MUXES] = { 0 };                    /* chars in silo */
+int32 dz_sae[DZ_MUXES] = { 0 };                         /* silo alarm armed */
+int32 dz_rcve[DZ_MUXES * DZ_LINES] = { 0 };             /* receiver on */
+int32 dz_cmask[DZ_MUXES * DZ_LINES] = { 0 };            /* char mask from LPR */
+int32 dz_rxi = 0;                                       /* rcv interrupts */
+int32 dz_txi = 0;                                       /* xmt interrupts */
+telmux_t *dz_mux = NULL;
+
+t_stat dz_rd (int32 *data, int32 PA, int32 access);
+t_stat dz_wr (int32 data, int32 PA, int32 access);
+int32 dz_rxinta (void);
+int32 dz_txinta (void);
+t_stat dz_svc (UNIT *uptr);
+t_stat dz_reset (DEVICE *dptr);
+void dz_clear (int32 dz, t_bool flag);
+void dz_fill_silo (int32 dz);
+void dz_update_rcvi (int32 dz);
+void dz_update_xmti (int32 dz);
+void dz_clr_rxint (int32 dz);
+void dz_set_rxint (int32 dz);
+void dz_clr_txint (int32 dz);
+void dz_set_txint (int32 dz);
+
+/* DZ data structures
+
+   dz_dev       DZ device descriptor
+   dz_unit      DZ unit list, the poll unit
+   dz_reg       DZ register list
+*/
+
+DIB dz_dib = {
+    IOBA_AUTO, IOLN_DZ * DZ_MUXES, &dz_rd, &dz_wr,
+    2, IVCL (DZRX), VEC_AUTO, { &dz_rxinta, &dz_txinta }, IOLN_DZ, DZ_MUXES
+    };
+
+UNIT dz_unit = { UDATA (&dz_svc, UNIT_IDLE, 0) };
+
+const REG dz_reg[] = {
+    { BRDATAD (CSR,   dz_csr, DEV_RDX, 16, DZ_MUXES, "control/status register") },
+    { BRDATAD (TCR,   dz_tcr, DEV_RDX, 16, DZ_MUXES, "transmit control register") },
+    { ORDATAD (RXINT, dz_rxi, DZ_MUXES, "receive interrupts") },
+    { ORDATAD (TXINT, dz_txi, DZ_MUXES, "transmit interrupts") },
+    { FLDATAD (INT,   IREQ (DZRX), INT_V_DZRX, "receive interrupt pending") },
+    { NULL }
+    };
+
+MTAB dz_mod[] = {
+    { MTAB_XTD|MTAB_VDV, 0, "ADDRESS", NULL,
+      NULL, &show_addr, NULL },
+    { MTAB_XTD|MTAB_VDV, 0, "VECTOR", NULL,
+      NULL, &show_vec, NULL },
+    { 0 }
+    };
+
+DEVICE dz_dev = {
+    "DZ", &dz_unit, dz_reg, dz_mod,
+    1, DEV_RDX, 8, 1, DEV_RDX, 8,
+    NULL, NULL, &dz_reset,
+    NULL, NULL, NULL,
+    &dz_dib, DEV_UBUS | DEV_QBUS
+    };
+
+static int32 dz_connected (int32 ln)
+{
+return (dz_mux != NULL) && telmux_connected (dz_mux, ln);
+}
+
+/* I/O dispatch routines, I/O addresses 17760100 - 17760137 */
+
+t_stat dz_rd (int32 *data, int32 PA, int32 access)
+{
+int32 dz = ((PA - dz_dib.ba) >> 3) & (DZ_MUXES - 1);    /* get mux num */
+int32 j, cd;
+
+switch ((PA >> 1) & 03) {                               /* case on PA<2:1> */
+
+    case 00:                                            /* CSR */
+        *data = dz_csr[dz];
+        break;
+
+    case 01:                                            /* RBUF */
+        dz_csr[dz] = dz_csr[dz] & ~CSR_SA;              /* clr silo alarm */
+        *data = 0;
+        if ((dz_csr[dz] & CSR_MSE) && dz_silo_cnt[dz]) {
+            *data = dz_silo[dz][dz_silo_head[dz]];
+            dz_silo_head[dz] = (dz_silo_head[dz] + 1) % DZ_SILO_SIZE;
+            dz_silo_cnt[dz]--;
+            }
+        if (dz_silo_cnt[dz] == 0)                       /* emptied? refill */
+            dz_fill_silo (dz);
+        if (dz_silo_cnt[dz] == 0) {                     /* still empty? */
+            dz_csr[dz] = dz_csr[dz] & ~CSR_RDONE;
+            dz_sae[dz] = 1;                             /* re-arm alarm */
+            dz_clr_rxint (dz);
+            }
+        else dz_update_rcvi (dz);                       /* more: int again */
+        break;
+
+    case 02:                                            /* TCR */
+        *data = dz_tcr[dz];
+        break;
+
+    case 03:                                            /* MSR */
+        for (j = cd = 0; j < DZ_LINES; j++) {
+            if (dz_connected ((dz * DZ_LINES) + j))
+                cd = cd | (1 << (j + MSR_V_CD));
+            }
+        *data = cd;
+        break;
+        }
+
+return SCPE_OK;
+}
+
+t_stat dz_wr (int32 data, int32 PA, int32 access)
+{
+int32 dz = ((PA - dz_dib.ba) >> 3) & (DZ_MUXES - 1);    /* get mux num */
+int32 j, ln, old;
+
+switch ((PA >> 1) & 03) {                               /* case on PA<2:1> */
+
+    case 00:                                            /* CSR */
+        if (access == WRITEB)                           /* byte? merge */
+            data = (PA & 1)? (dz_csr[dz] & 0377) | (data << 8):
+                             (dz_csr[dz] & ~0377) | data;
+        if (data & CSR_CLR)                             /* clr? reset */
+            dz_clear (dz, FALSE);
+        old = dz_csr[dz];
+        dz_csr[dz] = (dz_csr[dz] & ~CSR_RW) | (data & CSR_RW);
+        if ((data & CSR_MSE) == 0)                      /* scanner off? */
+            dz_csr[dz] &= ~(CSR_SA | CSR_RDONE | CSR_TRDY);
+        if ((dz_csr[dz] & CSR_RIE) == 0)                /* RIE = 0? */
+            dz_clr_rxint (dz);
+        else if ((old & CSR_RIE) == 0)                  /* RIE 0->1? */
+            dz_update_rcvi (dz);
+        if ((dz_csr[dz] & CSR_TIE) == 0)                /* TIE = 0? */
+            dz_clr_txint (dz);
+        else if (((old & CSR_TIE) == 0) && (dz_csr[dz] & CSR_TRDY))
+            dz_set_txint (dz);
+        if ((dz_csr[dz] & CSR_MSE) && ((old & CSR_MSE) == 0)) {
+            dz_fill_silo (dz);                          /* scanner on */
+            dz_update_xmti (dz);
+            }
+        break;
+
+    case 01:                                            /* LPR */
+        if ((access == WRITEB) && (PA & 1))             /* high byte only? */
+            break;                                      /* can't tell line */
+        ln = (dz * DZ_LINES) + ((data >> LPR_V_LINE) & DZ_LNOMASK);
+        dz_rcve[ln] = (data & LPR_RCVE) != 0;
+        dz_cmask[ln] = (1 << (5 + ((data >> LPR_V_LEN) & 03))) - 1;
+        break;
+
+    case 02:                                            /* TCR */
+        if (access == WRITEB)                           /* byte? merge */
+            data = (PA & 1)? (dz_tcr[dz] & 0377) | (data << 8):
+                             (dz_tcr[dz] & ~0377) | data;
+        old = dz_tcr[dz];
+        dz_tcr[dz] = data & 0177777;
+        for (j = 0; j < DZ_LINES; j++) {                /* DTR dropped? hang up */
+            int32 bit = 1 << (j + TCR_V_DTR);
+            ln = (dz * DZ_LINES) + j;
+            if ((old & bit) && !(data & bit) && dz_connected (ln))
+                telmux_disconnect (dz_mux, ln);
+            }
+        dz_update_xmti (dz);
+        break;
+
+    case 03:                                            /* TDR */
+        if ((access == WRITEB) && (PA & 1))             /* break bits only */
+            break;
+        if (dz_csr[dz] & CSR_TRDY) {                    /* xmit ready? */
+            ln = (dz * DZ_LINES) + ((dz_csr[dz] & CSR_TLINE) >> CSR_V_TLINE);
+            if (dz_connected (ln))
+                telmux_putc (dz_mux, ln, data & (dz_cmask[ln]? dz_cmask[ln]: 0377));
+            dz_csr[dz] &= ~CSR_TRDY;
+            }
+        dz_update_xmti (dz);
+        break;
+        }
+
+return SCPE_OK;
+}
+
+/* Unit service routine
+
+   Does the socket I/O for all lines, moves received characters into the silos and
+   finds out which lines can transmit again.
+*/
+
+t_stat dz_svc (UNIT *uptr)
+{
+int32 dz, t;
+
+for (dz = t = 0; dz < DZ_MUXES; dz++)                   /* any scanner on? */
+    t = t | (dz_csr[dz] & CSR_MSE);
+if (t && dz_mux) {
+    telmux_poll (dz_mux);
+    for (dz = 0; dz < DZ_MUXES; dz++) {
+        if ((dz_csr[dz] & CSR_MSE) == 0)
+            continue;
+        dz_fill_silo (dz);
+        dz_update_xmti (dz);
+        }
+    }
+sim_clock_coschedule (uptr, tmxr_poll);                 /* reactivate */
+return SCPE_OK;
+}
+
+/* Move received characters into the silo, taking turns between the lines */
+
+void dz_fill_silo (int32 dz)
+{
+int32 j, ln, c, more, cnt_was;
+
+if ((dz_mux == NULL) || ((dz_csr[dz] & CSR_MSE) == 0))
+    return;
+cnt_was = dz_silo_cnt[dz];
+do {
+    more = 0;
+    for (j = 0; (j < DZ_LINES) && (dz_silo_cnt[dz] < DZ_SILO_SIZE); j++) {
+        ln = (dz * DZ_LINES) + j;
+        if (!dz_rcve[ln] || ((c = telmux_getc (dz_mux, ln)) < 0))
+            continue;
+        if (dz_cmask[ln])
+            c = c & dz_cmask[ln];
+        dz_silo[dz][(dz_silo_head[dz] + dz_silo_cnt[dz]) % DZ_SILO_SIZE] =
+            RBUF_VALID | (j << RBUF_V_RLINE) | c;
+        dz_silo_cnt[dz]++;
+        more = 1;
+        }
+    } while (more && (dz_silo_cnt[dz] < DZ_SILO_SIZE));
+if (dz_silo_cnt[dz] == cnt_was)                         /* nothing new? */
+    return;
+dz_csr[dz] |= CSR_RDONE;
+if ((dz_csr[dz] & CSR_SAE) && dz_sae[dz] &&             /* silo alarm? */
+    (dz_silo_cnt[dz] >= DZ_SILO_ALM)) {
+    dz_csr[dz] |= CSR_SA;
+    dz_sae[dz] = 0;
+    }
+dz_update_rcvi (dz);
+}
+
+/* Request a receive interrupt if the silo state calls for one */
+
+void dz_update_rcvi (int32 dz)
+{
+if ((dz_csr[dz] & CSR_RIE) &&
+    ((dz_csr[dz] & CSR_SAE)? (dz_csr[dz] & CSR_SA): (dz_csr[dz] & CSR_RDONE)))
+    dz_set_rxint (dz);
+}
+
+/* Find the next line, after the current one, that is enabled and can take a
+   character, and request a transmit interrupt if one turns up */
+
+void dz_update_xmti (int32 dz)
+{
+int32 linemask, i, j, ln, was_rdy;
+
+was_rdy = dz_csr[dz] & CSR_TRDY;
+linemask = dz_tcr[dz] & 0377;                           /* enabled lines */
+dz_csr[dz] &= ~CSR_TRDY;                                /* assume not rdy */
+j = (dz_csr[dz] & CSR_TLINE) >> CSR_V_TLINE;            /* start at current */
+if (dz_csr[dz] & CSR_MSE) {
+    for (i = 0; i < DZ_LINES; i++) {                    /* search for line */
+        j = (j + 1) & DZ_LNOMASK;                       /* next line */
+        ln = (dz * DZ_LINES) + j;
+        if ((linemask & (1 << j)) &&
+            (!dz_connected (ln) || (telmux_tx_space (dz_mux, ln) > 0))) {
+            dz_csr[dz] = (dz_csr[dz] & ~CSR_TLINE) | (j << CSR_V_TLINE);
+            dz_csr[dz] |= CSR_TRDY;                     /* set xmt rdy */
+            break;
+            }
+        }
+    }
+if (!(dz_csr[dz] & CSR_TRDY))
+    dz_clr_txint (dz);
+else if (!was_rdy && (dz_csr[dz] & CSR_TIE))            /* newly ready? */
+    dz_set_txint (dz);
+}
+
+/* Interrupt routines */
+
+void dz_clr_rxint (int32 dz)
+{
+dz_rxi = dz_rxi & ~(1 << dz);                           /* clr mux rcv int */
+if (dz_rxi == 0)                                        /* all clr? */
+    CLR_INT (DZRX);
+else SET_INT (DZRX);                                    /* no, set intr */
+}
+
+void dz_set_rxint (int32 dz)
+{
+dz_rxi = dz_rxi | (1 << dz);                            /* set mux rcv int */
+SET_INT (DZRX);                                         /* set master intr */
+}
+
+int32 dz_rxinta (void)
+{
+int32 dz;
+
+for (dz = 0; dz < DZ_MUXES; dz++) {                     /* find 1st mux */
+    if (dz_rxi & (1 << dz)) {
+        dz_clr_rxint (dz);                              /* clear intr */
+        return (dz_dib.vec + (dz * 010));               /* return vector */
+        }
+    }
+return 0;
+}
+
+void dz_clr_txint (int32 dz)
+{
+dz_txi = dz_txi & ~(1 << dz);                           /* clr mux xmt int */
+if (dz_txi == 0)                                        /* all clr? */
+    CLR_INT (DZTX);
+else SET_INT (DZTX);                                    /* no, set intr */
+}
+
+void dz_set_txint (int32 dz)
+{
+dz_txi = dz_txi | (1 << dz);                            /* set mux xmt int */
+SET_INT (DZTX);                                         /* set master intr */
+}
+
+int32 dz_txinta (void)
+{
+int32 dz;
+
+for (dz = 0; dz < DZ_MUXES; dz++) {                     /* find 1st mux */
+    if (dz_txi & (1 << dz)) {
+        dz_clr_txint (dz);                              /* clear intr */
+        return (dz_dib.vec + 4 + (dz * 010));           /* return vector */
+        }
+    }
+return 0;
+}
+
+/* Device reset. Master clear (CSR<CLR>) leaves the modem control (DTR) bits and the
+   connections alone; a bus reset (flag set) clears DTR too, but still doesn't hang
+   anybody up, so sessions survive the guest rebooting. */
+
+void dz_clear (int32 dz, t_bool flag)
+{
+int32 j;
+
+dz_csr[dz] = 0;
+dz_silo_head[dz] = dz_silo_cnt[dz] = 0;
+dz_sae[dz] = 1;
+dz_tcr[dz] = flag? 0: (dz_tcr[dz] & ~0377);
+dz_clr_rxint (dz);
+dz_clr_txint (dz);
+for (j = 0; j < DZ_LINES; j++) {
+    dz_rcve[(dz * DZ_LINES) + j] = 0;
+    dz_cmask[(dz * DZ_LINES) + j] = 0;
+    }
+}
+
+t_stat dz_reset (DEVICE *dptr)
+{
+int32 dz;
+const char *port;
+
+if ((dz_mux == NULL) && ((port = getenv ("ESPPDP_DZ")) != NULL))
+    dz_mux = telmux_open ("DZ", atoi (port), DZ_MUXES * DZ_LINES);
+for (dz = 0; dz < DZ_MUXES; dz++)
+    dz_clear (dz, TRUE);
+dz_rxi = dz_txi = 0;
+CLR_INT (DZRX);
+CLR_INT (DZTX);
+sim_cancel (&dz_unit);
+if (dz_mux)
+    sim_clock_coschedule (&dz_unit, tmxr_poll);
+return SCPE_OK;
+}
@@ -249,9 +249,35 @@ return uba_last;
      Device addresses are trimmed to 22b.
 */
 
+/* Map a run of bus addresses starting at ba (and ending before lim) to memory.
+   Returns the length in bytes of the run that maps to consecutive memory
+   starting at *ma, or 0 if ba itself is NXM. Runs end at Unibus map page
+   boundaries and at the end of memory, so each one can be moved in one go. */
+
+static uint32 Map_Run (uint32 ba, uint32 lim, uint32 *ma)
+{
+uint32 run;
+
+if (cpu_bme) {                                          /* map enabled? */
+    *ma = Map_Addr (ba);                                /* map addr */
+    run = UBM_PAGSIZE - UBM_GETOFF (ba);                /* rest of map page */
+    if (run > (lim - ba))
+        run = lim - ba;
+    }
+else {                                                  /* physical */
+    *ma = ba;
+    run = lim - ba;
+    }
+if (!ADDR_IS_MEM (*ma))                                 /* NXM? */
+    return 0;
+if (run > (MEMSIZE - *ma))                              /* trim to memory */
+    run = MEMSIZE - *ma;
+return run;
+}
+
 int32 Map_ReadB (uint32 ba, int32 bc, uint8 *buf)
 {
-uint32 alim, lim, ma;
+uint32 lim, ma, run, i;
 
 /* I/O Page DMA only on Unibus systems */
 if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
@@ -269,31 +295,22 @@ if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
     }
 ba = ba & BUSMASK;                                      /* trim address */
 lim = ba + bc;
-if (cpu_bme) {                                          /* map enabled? */
-    for ( ; ba < lim; ba++) {                           /* by bytes */
-        ma = Map_Addr (ba);                             /* map addr */
-        if (!ADDR_IS_MEM (ma))                          /* NXM? err */
-            return (lim - ba);
-        *buf++ = (uint8) RdMemB (ma);                   /* get byte */
-        }
-    return 0;
-    }
-else {                                                  /* physical */
-    if (ADDR_IS_MEM (lim))                              /* end ok? */
-        alim = lim;
-    else if (ADDR_IS_MEM (ba))                          /* no, strt ok? */
-        alim = MEMSIZE;
-    else return bc;                                     /* no, err */
-    for ( ; ba < alim; ba++) {                          /* by bytes */
-        *buf++ = (uint8) RdMemB (ba);                   /* get byte */
-        }
-    return (lim - alim);
+while (ba < lim) {
+    if ((run = Map_Run (ba, lim, &ma)) == 0)            /* NXM? err */
+        return (lim - ba);
+    if (sim_end)                                        /* little endian? */
+        memcpy (buf, ((uint8 *) M) + ma, run);          /* bytes match M */
+    else for (i = 0; i < run; i++)
+        buf[i] = (uint8) RdMemB (ma + i);               /* get byte */
+    ba += run;
+    buf += run;
     }
+return 0;
 }
 
 int32 Map_ReadW (uint32 ba, int32 bc, uint16 *buf)
 {
-uint32 alim, lim, ma;
+uint32 lim, ma, run;
 
 /* I/O Page DMA only on Unibus systems */
 if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
@@ -312,31 +329,19 @@ if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
     }
 ba = (ba & BUSMASK) & ~01;                              /* trim, align addr */
 lim = ba + (bc & ~01);
-if (cpu_bme) {                                          /* map enabled? */
-    for (; ba < lim; ba = ba + 2) {                     /* by words */
-        ma = Map_Addr (ba);                             /* map addr */
-        if (!ADDR_IS_MEM (ma))                          /* NXM? err */
-            return (lim - ba);
-        *buf++ = (uint16) RdMemW (ma);
-        }
-    return 0;
-    }
-else {                                                  /* physical */
-    if (ADDR_IS_MEM (lim))                              /* end ok? */
-        alim = lim;
-    else if (ADDR_IS_MEM (ba))                          /* no, strt ok? */
-        alim = MEMSIZE;
-    else return bc;                                     /* no, err */
-    for ( ; ba < alim; ba = ba + 2) {                   /* by words */
-        *buf++ = (uint16) RdMemW (ba);
-        }
-    return (lim - alim);
+while (ba < lim) {
+    if ((run = Map_Run (ba, lim, &ma)) == 0)            /* NXM? err */
+        return (lim - ba);
+    memcpy (buf, M + (ma >> 1), run);                   /* get words */
+    ba += run;
+    buf += (run >> 1);
     }
+return 0;
 }
 
 int32 Map_WriteB (uint32 ba, int32 bc, const uint8 *buf)
 {
-uint32 alim, lim, ma;
+uint32 lim, ma, run, i;
 
 /* I/O Page DMA only on Unibus systems */
 if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
@@ -351,31 +356,22 @@ if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
 }
 ba = ba & BUSMASK;                                      /* trim address */
 lim = ba + bc;
-if (cpu_bme) {                                          /* map enabled? */
-    for ( ; ba < lim; ba++) {                           /* by bytes */
-        ma = Map_Addr (ba);                             /* map addr */
-        if (!ADDR_IS_MEM (ma))                          /* NXM? err */
-            return (lim - ba);
-        WrMemB (ma, ((uint16) *buf++));
-        }
-    return 0;
-    }
-else {                                                  /* physical */
-    if (ADDR_IS_MEM (lim))                              /* end ok? */
-        alim = lim;
-    else if (ADDR_IS_MEM (ba))                          /* no, strt ok? */
-        alim = MEMSIZE;
-    else return bc;                                     /* no, err */
-    for ( ; ba < alim; ba++) {                          /* by bytes */
-        WrMemB (ba, ((uint16) *buf++));
-        }
-    return (lim - alim);
+while (ba < lim) {
+    if ((run = Map_Run (ba, lim, &ma)) == 0)            /* NXM? err */
+        return (lim - ba);
+    if (sim_end)                                        /* little endian? */
+        memcpy (((uint8 *) M) + ma, buf, run);          /* bytes match M */
+    else for (i = 0; i < run; i++)
+        WrMemB (ma + i, ((uint16) buf[i]));             /* put byte */
+    ba += run;
+    buf += run;
     }
+return 0;
 }
 
 int32 Map_WriteW (uint32 ba, int32 bc, const uint16 *buf)
 {
-uint32 alim, lim, ma;
+uint32 lim, ma, run;
 
 /* I/O Page DMA only on Unibus systems */
 if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
@@ -392,26 +388,39 @@ if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
 }
 ba = (ba & BUSMASK) & ~01;                              /* trim, align addr */
 lim = ba + (bc & ~01);
-if (cpu_bme) {                                          /* map enabled? */
-    for (; ba < lim; ba = ba + 2) {                     /* by words */
-        ma = Map_Addr (ba);                             /* map addr */
-        if (!ADDR_IS_MEM (ma))                          /* NXM? err */
-            return (lim - ba);
-        WrMemW (ma, *buf++);
-        }
-    return 0;
+while (ba < lim) {
+    if ((run = Map_Run (ba, lim, &ma)) == 0)            /* NXM? err */
+        return (lim - ba);
+    memcpy (M + (ma >> 1), buf, run);                   /* put words */
+    ba += run;
+    buf += (run >> 1);
     }
-else {                                                  /* physical */
-    if (ADDR_IS_MEM (lim))                              /* end ok? */
-        alim = lim;
-    else if (ADDR_IS_MEM (ba))                          /* no, strt ok? */
-        alim = MEMSIZE;
-    else return bc;                                     /* no, err */
-    for ( ; ba < alim; ba = ba + 2) {                   /* by words */
-        WrMemW (ba, *buf++);
-        }
-    return (lim - alim);
+return 0;
+}
+
+/* Locate a word transfer in memory, so a device can move it in place. Returns
+   a pointer into M[] if all of ba..ba+bc-1 maps onto one consecutive range of
+   memory, or NULL if the transfer is odd, hits the I/O page or NXM, or spans
+   map pages that are not contiguous; the caller then uses Map_ReadW/WriteW. */
+
+uint16 *Map_Direct (uint32 ba, int32 bc)
+{
+uint32 lim, pa, ma, nma, run;
+
+if ((bc <= 0) || ((ba | bc) & 01))                      /* odd or empty? */
+    return NULL;
+if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK)))   /* I/O page? */
+    return NULL;
+ba = ba & BUSMASK;                                      /* trim address */
+lim = ba + bc;
+if ((run = Map_Run (ba, lim, &pa)) == 0)                /* NXM? */
+    return NULL;
+for (ma = pa + run, ba = ba + run; ba < lim; ma += run, ba += run) {
+    if (((run = Map_Run (ba, lim, &nma)) == 0) ||       /* NXM or */
+        (nma != ma))                                    /* discontiguous? */
+        return NULL;
     }
+return M + (pa >> 1);
 }
 
 /* Build tables from device list */
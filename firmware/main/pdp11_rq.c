@@ -175,7 +175,10 @@ extern int32 MMR2;
 #define unit_plug       u4                              /* drive unit plug value */
 #define io_status       u5                              /* io status from callback */
 #define io_complete     u6                              /* io completion flag */
-#define rqxb            filebuf                         /* xfer buffer */
+#define rqxb            filebuf                         /* bounce buffer */
+#define rqdb            up7                             /* xfer buffer in use */
+#define rqhd            u3                              /* elevator head LBN */
+#define rqskp           hwmark                          /* times oldest pkt passed */
 #define UNIT_WPRT       (UNIT_WLK | UNIT_RO)            /* write prot */
 #define RQ_RMV(u)       ((drv_tab[GET_DTYPE (u->flags)].flgs & RQDF_RMV)? \
                         UF_RMV: 0)
@@ -821,6 +824,13 @@ int32 rq_itime = 450;                                   /* init time, except */
 int32 rq_itime4 = 10;                                   /* stage 4 */
 int32 rq_qtime = RQ_QTIME;                              /* queue time */
 int32 rq_xtime = RQ_XTIME;                              /* transfer time */
+int32 rq_elev = 1;                                      /* elevator sched */
+
+#define RQ_ELEV_SKIP    16                              /* max passes of oldest */
+#define RQ_XFER(op)     (((op) == OP_ACC) || ((op) == OP_CMP) || \
+                         ((op) == OP_ERS) || ((op) == OP_RD) || \
+                         ((op) == OP_WR))
+#define RQ_XFER_WR(op)  (((op) == OP_ERS) || ((op) == OP_WR))
 
 typedef struct {
     uint32              cnum;                           /* ctrl number */
@@ -880,7 +890,7 @@ static const char *rq_cmdname[] = {
     "ACC",                                              /* 16 b: access */
     "CCD",                                              /* 17 d: compare - nop */
     "ERS",                                              /* 18 b: erase */
-    "FLU",                                              /* 19 d: flush - nop */
+    "FLU",                                              /* 19 d: flush */
     "","",                                              /* 20-21 */
     "ERG",                                              /* 22 t: erase gap */
     "","","","","","","","","",                         /* 23-31 */
@@ -938,6 +948,7 @@ t_bool rq_deqf (MSC *cp, uint16 *pkt);
 uint16 rq_deqh (MSC *cp, uint16 *lh);
 void rq_enqh (MSC *cp, uint16 *lh, uint16 pkt);
 void rq_enqt (MSC *cp, uint16 *lh, uint16 pkt);
+uint16 rq_deq_elev (MSC *cp, UNIT *uptr);
 t_bool rq_getpkt (MSC *cp, uint16 *pkt);
 t_bool rq_putpkt (MSC *cp, uint16 pkt, t_bool qt);
 t_bool rq_getdesc (MSC *cp, struct uq_ring *ring, uint32 *desc);
@@ -1018,6 +1029,7 @@ const REG rq_reg[] = {
     { DRDATAD (I4TIME,  rq_itime4,                  24, "init stage 4 delay"), PV_LEFT + REG_NZ },
     { DRDATAD (QTIME,   rq_qtime,                   24, "response time for 'immediate' packets"), PV_LEFT + REG_NZ },
     { DRDATAD (XTIME,   rq_xtime,                   24, "response time for data transfers"), PV_LEFT + REG_NZ },
+    { FLDATAD (ELEV,    rq_elev,                     0, "elevator scheduling of queued transfers") },
     { BRDATAD (PKTS,    rq_ctx.pak,     DEV_RDX,    16, sizeof(rq_ctx.pak)/2, "packet buffers, 33W each, 32 entries") },
     { URDATAD (CPKT,    rq_unit[0].cpkt, 10, 5, 0, RQ_NUMDR, 0, "current packet, units 0 to 3") },
     { URDATAD (UCNUM,   rq_unit[0].cnum, 10, 5, 0, RQ_NUMDR, 0, "ctrl number, units 0 to 3") },
@@ -1418,6 +1430,7 @@ return SCPE_OK;
 t_stat rq_wr (int32 data, int32 PA, int32 access)
 {
 int32 cidx = rq_map_pa ((uint32) PA);
+int32 i;
 MSC *cp;
 DEVICE *dptr;
 
@@ -1431,6 +1444,14 @@ sim_debug(DBG_REG, dptr, "rq_wr(PA=0x%08X [%s], access=%d, data=0x%04X)\n", PA,
 switch ((PA >> 1) & 01) {                               /* decode PA<1> */
 
     case 0:                                             /* IP */
+        if (cp->csta == CST_UP) {                       /* reset while up */
+            for (i = 0; i < RQ_NUMDR; i++) {            /* with xfers out? */
+                if (dptr->units[i].cpkt) {
+                    timing_backoff ("RQ");              /* driver timeout */
+                    break;
+                    }
+                }
+            }
         rq_reset (rq_devmap[cidx]);                     /* init device */
         sim_debug (DBG_REQ, dptr, "initialization started\n");
         break;
@@ -1589,7 +1610,7 @@ for (i = 0; i < RQ_NUMDR; i++) {                        /* chk unit q's */
     nuptr = dptr->units + i;                            /* ptr to unit */
     if (nuptr->cpkt || (nuptr->pktq == 0))
         continue;
-    pkt = rq_deqh (cp, &nuptr->pktq);                   /* get top of q */
+    pkt = rq_deq_elev (cp, nuptr);                      /* get next from q */
     if (!rq_mscp (cp, pkt, FALSE))                      /* process */
         return SCPE_OK;
     }
@@ -1650,6 +1671,8 @@ for (i = 0; i < dptr->numunits - 2; i++) {                        /* poll */
             return SCPE_OK;
         }
     nuptr->flags = nuptr->flags & ~UNIT_ATP;
+    if (nuptr->flags & UNIT_ATT)                        /* write back */
+        sim_disk_tick (nuptr);
     }
 if ((cp->hat > 0) && (--cp->hat == 0))                  /* host timeout? */
     rq_fatal (cp, PE_HAT);                              /* fatal err */ 
@@ -1661,6 +1684,7 @@ return SCPE_OK;
 t_bool rq_mscp (MSC *cp, uint16 pkt, t_bool q)
 {
 uint16 sts, cmd = GETP (pkt, CMD_OPC, OPC);
+UNIT *uptr;
 
 sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_mscp - %s\n", q? "Queue" : "No Queue");
 
@@ -1697,9 +1721,16 @@ switch (cmd) {
     case OP_WR:                                         /* write */
         return rq_rw (cp, pkt, q);
 
+    case OP_FLU:                                        /* flush */
+        if ((uptr = rq_getucb (cp, cp->pak[pkt].d[CMD_UN])) &&
+            (uptr->flags & UNIT_ATT))                   /* commit writes */
+            sim_disk_flush (uptr);
+        cmd = cmd | OP_END;                             /* set end flag */
+        sts = ST_SUC;                                   /* success */
+        break;
+
     case OP_CCD:                                        /* nops */
     case OP_DAP:
-    case OP_FLU:
         cmd = cmd | OP_END;                             /* set end flag */
         sts = ST_SUC;                                   /* success */
         break;
@@ -2030,6 +2061,8 @@ if ((uptr = rq_getucb (cp, lu))) {                      /* unit exist? */
         cp->pak[pkt].d[RW_WBLH] = cp->pak[pkt].d[RW_LBNH];
         cp->pak[pkt].d[RW_WMPL] = cp->pak[pkt].d[RW_MAPL];
         cp->pak[pkt].d[RW_WMPH] = cp->pak[pkt].d[RW_MAPH];
+        uptr->rqhd = GETP32 (pkt, RW_LBNL) +            /* head ends up */
+            ((GETP32 (pkt, RW_BCL) + (RQ_NUMBY - 1)) / RQ_NUMBY);
         uptr->iostarttime = sim_grtime();
         sim_activate (uptr, 0);                         /* activate */
         sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_rw - started\n");
@@ -2190,6 +2223,25 @@ if (ba & RQ_MAPXFER) {                                  /* mapped xfer? */
 return Map_WriteW (ba, bc, buf);                        /* unmapped xfer */
 }
 
+/* Pick the buffer for a transfer. Reads and writes of whole sectors that map
+   onto consecutive memory go straight to or from M[]; everything else goes
+   through the bounce buffer, which is only allocated when first needed. */
+
+static uint16 *rq_xfer_buf (UNIT *uptr, uint32 cmd, uint32 ba, uint32 tbc)
+{
+#if defined (VM_PDP11)
+uint16 *xb;
+
+if (((cmd == OP_RD) || (cmd == OP_WR)) &&               /* rd/wr of */
+    ((tbc % RQ_NUMBY) == 0) &&                          /* whole sectors */
+    ((xb = Map_Direct (ba, tbc)) != NULL))              /* in memory? */
+    return xb;
+#endif
+if (uptr->rqxb == NULL)
+    uptr->rqxb = malloc ((RQ_MAXFR >> 1) * sizeof (uint16));
+return (uint16 *) uptr->rqxb;
+}
+
 /* Unit service for data transfer commands */
 
 t_stat rq_svc (UNIT *uptr)
@@ -2199,6 +2251,7 @@ uint32 i, t, tbc, abc, wwc;
 uint32 err = 0;
 int32 pkt = uptr->cpkt;                                 /* get packet */
 uint32 cmd, ba, bc, bl, ma;
+uint16 *xb;
 
 if ((cp == NULL) || (pkt == 0))                         /* what??? */
     return STOP_RQ;
@@ -2235,37 +2288,46 @@ if ((cmd == OP_ERS) || (cmd == OP_WR)) {                /* write op? */
     }
 
 if (!uptr->io_complete) { /* Top End (I/O Initiation) Processing */
+    xb = rq_xfer_buf (uptr, cmd, ba, tbc);              /* pick buffer */
+    if (xb == NULL)
+        return SCPE_MEM;
+    uptr->rqdb = xb;
     if (cmd == OP_ERS) {                                /* erase? */
         wwc = ((tbc + (RQ_NUMBY - 1)) & ~(RQ_NUMBY - 1)) >> 1;
-        memset (uptr->rqxb, 0, wwc * sizeof(uint16));   /* clr buf */
-        sim_disk_data_trace(uptr, (uint8 *)uptr->rqxb, bl, wwc << 1, "sim_disk_wrsect-ERS", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
-        err = sim_disk_wrsect_a (uptr, bl, (uint8 *)uptr->rqxb, NULL, (wwc << 1) / RQ_NUMBY, rq_io_complete);
+        memset (xb, 0, wwc * sizeof(uint16));           /* clr buf */
+        sim_disk_data_trace(uptr, (uint8 *)xb, bl, wwc << 1, "sim_disk_wrsect-ERS", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+        err = sim_disk_wrsect_a (uptr, bl, (uint8 *)xb, NULL, (wwc << 1) / RQ_NUMBY, rq_io_complete);
         }
 
     else if (cmd == OP_WR) {                            /* write? */
-        t = rq_readw (ba, tbc, ma, (uint16 *)uptr->rqxb);/* fetch buffer */
+        if (xb == uptr->rqxb)                           /* bounce buffer? */
+            t = rq_readw (ba, tbc, ma, xb);             /* fetch buffer */
+        else t = 0;                                     /* else in place */
         if ((abc = tbc - t)) {                          /* any xfer? */
             wwc = ((abc + (RQ_NUMBY - 1)) & ~(RQ_NUMBY - 1)) >> 1;
             for (i = (abc >> 1); i < wwc; i++)
-                ((uint16 *)(uptr->rqxb))[i] = 0;
-            sim_disk_data_trace(uptr, (uint8 *)uptr->rqxb, bl, wwc << 1, "sim_disk_wrsect-WR", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
-            err = sim_disk_wrsect_a (uptr, bl, (uint8 *)uptr->rqxb, NULL, (wwc << 1) / RQ_NUMBY, rq_io_complete);
+                xb[i] = 0;
+            sim_disk_data_trace(uptr, (uint8 *)xb, bl, wwc << 1, "sim_disk_wrsect-WR", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+            err = sim_disk_wrsect_a (uptr, bl, (uint8 *)xb, NULL, (wwc << 1) / RQ_NUMBY, rq_io_complete);
             }
         }
 
     else {  /* OP_RD & OP_CMP */
-        err = sim_disk_rdsect_a (uptr, bl, (uint8 *)uptr->rqxb, NULL, (tbc + RQ_NUMBY - 1) / RQ_NUMBY, rq_io_complete);
+        err = sim_disk_rdsect_a (uptr, bl, (uint8 *)xb, NULL, (tbc + RQ_NUMBY - 1) / RQ_NUMBY, rq_io_complete);
         }                                               /* end else read */
     return SCPE_OK;                                     /* done for now until callback */    
     }
 else { /* Bottom End (After I/O processing) */
     uptr->io_complete = 0;
     err = uptr->io_status;
+    xb = (uint16 *) uptr->rqdb;
     if (cmd == OP_ERS) {                                /* erase? */
         }
 
     else if (cmd == OP_WR) {                            /* write? */
-        t = rq_readw (ba, tbc, ma, (uint16 *)uptr->rqxb);/* fetch buffer */
+        if (xb == uptr->rqxb)                           /* bounce buffer? */
+            t = rq_readw (ba, tbc, ma, xb);             /* fetch buffer */
+        else t = 0;                                     /* else in place */
         abc = tbc - t;                                  /* any xfer? */
         if (t) {                                        /* nxm? */
             PUTP32 (pkt, RW_WBCL, bc - abc);            /* adj bc */
@@ -2277,9 +2339,10 @@ else { /* Bottom End (After I/O processing) */
         }
 
     else {
-        sim_disk_data_trace(uptr, (uint8 *)uptr->rqxb, bl, tbc, "sim_disk_rdsect", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
-        if ((cmd == OP_RD) && !err) {                   /* read? */
-            if ((t = rq_writew (ba, tbc, ma, (uint16 *)uptr->rqxb))) {/* store, nxm? */
+        sim_disk_data_trace(uptr, (uint8 *)xb, bl, tbc, "sim_disk_rdsect", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+        if ((cmd == OP_RD) && !err &&                   /* read via */
+            (xb == uptr->rqxb)) {                       /* bounce buffer? */
+            if ((t = rq_writew (ba, tbc, ma, xb))) {    /* store, nxm? */
                 PUTP32 (pkt, RW_WBCL, bc - (tbc - t));  /* adj bc */
                 PUTP32 (pkt, RW_WBAL, ba + (tbc - t));  /* adj ba */
                 if (rq_hbe (cp, uptr))                  /* post err log */
@@ -2297,7 +2360,7 @@ else { /* Bottom End (After I/O processing) */
                         rq_rw_end (cp, uptr, EF_LOG, ST_HST | SB_HST_NXM);
                     return SCPE_OK;
                     }
-                dby = (((uint16 *)(uptr->rqxb))[i >> 1] >> ((i & 1)? 8: 0)) & 0xFF;
+                dby = (xb[i >> 1] >> ((i & 1)? 8: 0)) & 0xFF;
                 if (mby != dby) {                       /* cmp err? */
                     PUTP32 (pkt, RW_WBCL, bc - i);      /* adj bc */
                     rq_rw_end (cp, uptr, 0, ST_CMP);    /* done */
@@ -2497,6 +2560,7 @@ return rq_putpkt (cp, pkt, TRUE);
    rq_deqh      -       dequeue head of list
    rq_enqh      -       enqueue at head of list
    rq_enqt      -       enqueue at tail of list
+   rq_deq_elev  -       dequeue next packet for unit, in elevator order
 */
 
 t_bool rq_deqf (MSC *cp, uint16 *pkt)
@@ -2544,6 +2608,74 @@ else {
 return;
 }
 
+/* Transfers queued for a unit ahead of its first non-transfer command may be
+   started out of order. The one with the lowest LBN at or past where the last
+   transfer left the head goes first; when there are none, the lowest LBN
+   overall (C-SCAN). A transfer never overtakes an earlier one it overlaps if
+   either of them writes, and the oldest packet is passed over at most
+   RQ_ELEV_SKIP times in a row, so nothing starves. */
+
+static t_bool rq_elev_dep (MSC *cp, uint16 first, uint16 pkt)
+{
+uint16 tpkt;
+uint32 lbn = GETP32 (pkt, RW_LBNL);
+uint32 end = lbn + ((GETP32 (pkt, RW_BCL) + (RQ_NUMBY - 1)) / RQ_NUMBY);
+t_bool wr = RQ_XFER_WR (GETP (pkt, CMD_OPC, OPC));
+
+for (tpkt = first; tpkt != pkt; tpkt = cp->pak[tpkt].link) {
+    uint32 tlbn = GETP32 (tpkt, RW_LBNL);
+    uint32 tend = tlbn + ((GETP32 (tpkt, RW_BCL) + (RQ_NUMBY - 1)) / RQ_NUMBY);
+
+    if ((wr || RQ_XFER_WR (GETP (tpkt, CMD_OPC, OPC))) &&
+        (lbn < tend) && (tlbn < end))                   /* conflict? */
+        return TRUE;
+    }
+return FALSE;
+}
+
+uint16 rq_deq_elev (MSC *cp, UNIT *uptr)
+{
+uint16 pkt, prv, best = 0, bprv = 0, low = 0, lprv = 0;
+uint32 lbn, blbn = 0, llbn = 0;
+
+pkt = uptr->pktq;
+if (!rq_elev || (pkt == 0) ||                           /* off, empty, */
+    !RQ_XFER (GETP (pkt, CMD_OPC, OPC)) ||              /* barrier first */
+    (uptr->rqskp >= RQ_ELEV_SKIP)) {                    /* or starving? */
+    uptr->rqskp = 0;
+    return rq_deqh (cp, &uptr->pktq);                   /* take head */
+    }
+for (prv = 0; pkt && RQ_XFER (GETP (pkt, CMD_OPC, OPC));
+    prv = pkt, pkt = cp->pak[pkt].link) {
+    if (prv && rq_elev_dep (cp, uptr->pktq, pkt))       /* must wait? */
+        continue;
+    lbn = GETP32 (pkt, RW_LBNL);
+    if (lbn >= (uint32)uptr->rqhd) {                    /* ahead of head? */
+        if ((best == 0) || (lbn < blbn)) {
+            best = pkt;
+            bprv = prv;
+            blbn = lbn;
+            }
+        }
+    else if ((low == 0) || (lbn < llbn)) {              /* behind, wrap */
+        low = pkt;
+        lprv = prv;
+        llbn = lbn;
+        }
+    }
+if (best == 0) {                                        /* none ahead? */
+    best = low;
+    bprv = lprv;
+    }
+if (bprv == 0) {                                        /* oldest? */
+    uptr->rqskp = 0;
+    return rq_deqh (cp, &uptr->pktq);
+    }
+cp->pak[bprv].link = cp->pak[best].link;                /* unlink */
+uptr->rqskp = uptr->rqskp + 1;
+return best;
+}
+
 /* Packet and descriptor handling */
 
 /* Get packet from command ring */
@@ -3080,9 +3212,7 @@ for (i = 0; i < dptr->numunits; i++) {                  /* init units */
     uptr->flags = uptr->flags & ~(UNIT_ONL | UNIT_ATP);
     uptr->uf = 0;                                       /* clr unit flags */
     uptr->cpkt = uptr->pktq = 0;                        /* clr pkt q's */
-    uptr->rqxb = (uint16 *) realloc (uptr->rqxb, (RQ_MAXFR >> 1) * sizeof (uint16));
-    if (uptr->rqxb == NULL)
-        return SCPE_MEM;
+    uptr->rqhd = uptr->rqskp = 0;                       /* clr elevator */
     }
 for (i=cp->max_plug = 0; i < (dptr->numunits - 2); i++)
     if ((0 == (dptr->units[i].flags & UNIT_DIS)) && (dptr->units[i].unit_plug > cp->max_plug))
@@ -148,9 +148,9 @@ DIB rx_dib = {
 
 UNIT rx_unit[] = {
     { UDATA (&rx_svc,
-             UNIT_FIX+UNIT_ATTABLE+UNIT_BUFABLE+UNIT_MUSTBUF, RX_SIZE) },
+             UNIT_FIX+UNIT_ATTABLE+UNIT_BUFABLE+UNIT_MUSTBUF+UNIT_PAGEBUF, RX_SIZE) },
     { UDATA (&rx_svc,
-             UNIT_FIX+UNIT_ATTABLE+UNIT_BUFABLE+UNIT_MUSTBUF, RX_SIZE) }
+             UNIT_FIX+UNIT_ATTABLE+UNIT_BUFABLE+UNIT_MUSTBUF+UNIT_PAGEBUF, RX_SIZE) }
     };
 
 const REG rx_reg[] = {
@@ -251,6 +251,8 @@ switch ((PA >> 1) & 1) {                                /* decode PA<1> */
         if (access == WRITEB) data = (PA & 1)?          /* write byte? */
             (rx_csr & 0377) | (data << 8): (rx_csr & ~0377) | data;
         if (data & RXCS_INIT) {                         /* initialize? */
+            if (rx_state != IDLE)                       /* abandoning a */
+                timing_backoff ("RX");                  /* function? */
             rx_reset (&rx_dev);                         /* reset device */
             return SCPE_OK;                             /* end if init */
             }
@@ -329,9 +331,8 @@ return SCPE_OK;
 
 t_stat rx_svc (UNIT *uptr)
 {
-int32 i, func;
+int32 func;
 uint32 da;
-int8 *fbuf = (int8 *) uptr->filebuf;
 
 func = RXCS_GETFNC (rx_csr);                            /* get function */
 switch (rx_state) {                                     /* case on state */
@@ -388,16 +389,20 @@ switch (rx_state) {                                     /* case on state */
         if (func == RXCS_WRDEL)                         /* del data? */
             rx_esr = rx_esr | RXES_DD;
         if (func == RXCS_READ) {                        /* read? */
-            for (i = 0; i < RX_NUMBY; i++)
-                rx_buf[i] = fbuf[da + i];
+            if (sim_buf_read (uptr, da, rx_buf, RX_NUMBY) != SCPE_OK) {
+                rx_done (0, 0110);                      /* done, error */
+                return SCPE_IOERR;
+                }
             }
         else {
             if (uptr->flags & UNIT_WPRT) {              /* write and locked? */
                 rx_done (RXES_WLK, 0100);               /* done, error */
                 break;
                 }
-            for (i = 0; i < RX_NUMBY; i++)              /* write */
-                fbuf[da + i] = rx_buf[i];
+            if (sim_buf_write (uptr, da, rx_buf, RX_NUMBY) != SCPE_OK) {
+                rx_done (0, 0110);                      /* done, error */
+                return SCPE_IOERR;
+                }
             da = da + RX_NUMBY;
             if (da > uptr->hwmark)
                 uptr->hwmark = da;
@@ -421,8 +426,7 @@ switch (rx_state) {                                     /* case on state */
             break;
             }
         da = CALC_DA (1, 1);                            /* track 1, sector 1 */
-        for (i = 0; i < RX_NUMBY; i++)                  /* read sector */
-            rx_buf[i] = fbuf[da + i];
+        sim_buf_read (&rx_unit[0], da, rx_buf, RX_NUMBY);/* read sector */
         rx_done (RXES_ID, 0);                           /* set done */
         if ((rx_unit[1].flags & UNIT_ATT) == 0)
             rx_ecode = 0020;
@@ -467,6 +471,8 @@ rx_track = rx_sector = 0;                               /* clear addr */
 rx_state = IDLE;                                        /* ctrl idle */
 CLR_INT (RX);                                           /* clear int req */
 sim_cancel (&rx_unit[1]);                               /* cancel drive 1 */
+sim_buf_flush (&rx_unit[0]);                            /* write back */
+sim_buf_flush (&rx_unit[1]);                            /* changed pages */
 if (dptr->flags & DEV_DIS)                              /* disabled? */
     sim_cancel (&rx_unit[0]);
 else if (rx_unit[0].flags & UNIT_BUF)  {                /* attached? */
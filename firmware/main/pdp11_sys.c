@@ -165,7 +165,9 @@ DEVICE *sim_devices[] = {
 //    &dlo_dev,
 //    &dci_dev,
 //    &dco_dev,
-//    &dz_dev,
+#ifndef ESP_PLATFORM
+    &dz_dev,
+#endif
 //    &vh_dev,
 //    &rc_dev,
 //    &rf_dev,
@@ -245,6 +247,88 @@ const char *sim_stop_messages[] = {
     "DECtape off reel"
     };
 
+/* Device timing profiles
+
+   The device models wait a fixed time before completing an operation, as old
+   drivers were written for real hardware and can fall over when it is much
+   faster. The fast profile cuts these delays to values RT-11 (on RX) and
+   2.11BSD (on RQ) run fine with. Should a driver still time out and reset its
+   controller, the device calls timing_backoff () and its delays are doubled,
+   up to the normal values. Only devices that can tell a driver timeout apart
+   from normal use are in here; the console and the network keep their normal
+   timing. The profile is selected with SET CPU FASTTIMING/NORMALTIMING.
+*/
+
+extern int32 rq_itime, rq_qtime, rq_xtime;
+extern int32 rx_cwait, rx_swait, rx_xwait;
+
+typedef struct {
+    const char          *dev;                           /* device name */
+    int32               *var;                           /* delay variable */
+    int32               fast;                           /* fast value */
+    int32               normal;                         /* saved normal value */
+    } TIMING;
+
+static TIMING timing_tab[] = {
+    { "RQ",  &rq_itime,       45 },                     /* init steps */
+    { "RQ",  &rq_qtime,       20 },                     /* imm. packets */
+    { "RQ",  &rq_xtime,       50 },                     /* transfers */
+    { "RX",  &rx_cwait,       10 },                     /* command */
+    { "RX",  &rx_swait,        0 },                     /* seek per track */
+    { "RX",  &rx_xwait,        0 },                     /* transfer step */
+    { NULL }
+    };
+
+static t_bool timing_fast = FALSE;
+
+void set_timing_profile (t_bool fast)
+{
+TIMING *tp;
+
+for (tp = timing_tab; tp->dev != NULL; tp++) {
+    if (fast && !timing_fast)                           /* remember normal */
+        tp->normal = *tp->var;
+    if (!fast && timing_fast)
+        *tp->var = tp->normal;
+    else if (fast)
+        *tp->var = tp->fast;
+    }
+timing_fast = fast;
+}
+
+t_stat cpu_set_timing (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+if (cptr != NULL)
+    return SCPE_ARG;
+set_timing_profile (val != 0);
+return SCPE_OK;
+}
+
+t_stat cpu_show_timing (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+fprintf (st, timing_fast? "fast timing": "normal timing");
+return SCPE_OK;
+}
+
+void timing_backoff (const char *dev)
+{
+TIMING *tp;
+t_bool slowed = FALSE;
+
+if (!timing_fast)
+    return;
+for (tp = timing_tab; tp->dev != NULL; tp++) {
+    if ((strcmp (tp->dev, dev) != 0) || (*tp->var >= tp->normal))
+        continue;
+    *tp->var = (*tp->var)? *tp->var * 2: 1;             /* double delay */
+    if (*tp->var > tp->normal)
+        *tp->var = tp->normal;
+    slowed = TRUE;
+    }
+if (slowed)
+    printf ("%s driver timed out, slowing down %s timing\n", dev, dev);
+}
+
 /* Binary loader.
 
    Loader format consists of blocks, optionally preceded, separated, and
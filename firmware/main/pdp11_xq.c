@@ -262,6 +262,7 @@ t_stat xq_tmrsvc(UNIT * uptr);
 t_stat xq_startsvc(UNIT * uptr);
 t_stat xq_receivesvc(UNIT * uptr);
 t_stat xq_srqrsvc(UNIT * uptr);
+t_stat xq_coalsvc(UNIT * uptr);
 t_stat xq_reset (DEVICE * dptr);
 t_stat xq_attach (UNIT * uptr, CONST char * cptr);
 t_stat xq_detach (UNIT * uptr);
@@ -301,11 +302,14 @@ void xq_setint (CTLR* xq);
 void xq_clrint (CTLR* xq);
 int32 xq_int (void);
 void xq_csr_set_clr(CTLR* xq, uint16 set_bits, uint16 clear_bits);
+void xq_csr_post(CTLR* xq, uint16 bits);
 void xq_show_debug_bdl(CTLR* xq, uint32 bdl_ba);
 t_stat xq_boot (int32 unitno, DEVICE *dptr);
 t_stat xq_help (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, const char *cptr);
 const char *xq_description (DEVICE *dptr);
 
+int32 xq_ltime = 400;                       /* setup/loopback receive delay, usecs */
+
 struct xq_device    xqa = {
   xqa_read_callback,                        /* read callback routine */
   xqa_write_callback,                       /* write callback routine */
@@ -351,6 +355,7 @@ UNIT xqa_unit[] = {
  { UDATA (&xq_startsvc, UNIT_DIS, 0) },
  { UDATA (&xq_receivesvc, UNIT_DIS, 0) },
  { UDATA (&xq_srqrsvc, UNIT_DIS, 0) },
+ { UDATA (&xq_coalsvc, UNIT_DIS, 0) },
 };
 
 BITFIELD xq_csr_bits[] = {
@@ -433,6 +438,7 @@ UNIT xqb_unit[] = {
  { UDATA (&xq_startsvc, UNIT_DIS, 0) },
  { UDATA (&xq_receivesvc, UNIT_DIS, 0) },
  { UDATA (&xq_srqrsvc, UNIT_DIS, 0) },
+ { UDATA (&xq_coalsvc, UNIT_DIS, 0) },
 };
 
 const REG xqb_reg[] = {
@@ -539,7 +545,7 @@ DEBTAB xq_debug[] = {
 
 DEVICE xq_dev = {
   "XQ", xqa_unit, xqa_reg, xq_mod,
-  5, XQ_RDX, 11, 1, XQ_RDX, 16,
+  6, XQ_RDX, 11, 1, XQ_RDX, 16,
   &xq_ex, &xq_dep, &xq_reset,
   &xq_boot, &xq_attach, &xq_detach,
   &xqa_dib, DEV_DISABLE | DEV_QBUS | DEV_DEBUG | DEV_ETHER,
@@ -549,7 +555,7 @@ DEVICE xq_dev = {
 
 DEVICE xqb_dev = {
   "XQB", xqb_unit, xqb_reg, xq_mod,
-  5, XQ_RDX, 11, 1, XQ_RDX, 16,
+  6, XQ_RDX, 11, 1, XQ_RDX, 16,
   &xq_ex, &xq_dep, &xq_reset,
   &xq_boot, &xq_attach, &xq_detach,
   &xqb_dib, DEV_DISABLE | DEV_DIS | DEV_QBUS | DEV_DEBUG | DEV_ETHER,
@@ -812,11 +818,10 @@ t_stat xq_show_poll (FILE* st, UNIT* uptr, int32 val, CONST void* desc)
   CTLR* xq = xq_unit2ctlr(uptr);
   if (xq->var->poll)
     fprintf(st, "poll=%d", xq->var->poll);
-  else {
+  else
     fprintf(st, "polling=disabled");
-    if (xq->var->coalesce_latency)
-      fprintf(st, ",latency=%d", xq->var->coalesce_latency);
-  }
+  if (xq->var->coalesce_latency)
+    fprintf(st, ",latency=%d", xq->var->coalesce_latency);
   return SCPE_OK;
 }
 
@@ -829,15 +834,16 @@ t_stat xq_set_poll (UNIT* uptr, int32 val, CONST char* cptr, void* desc)
   /* this assumes that the parameter has already been upcased */
   if (!strcmp(cptr, "DEFAULT"))
     xq->var->poll = XQ_SERVICE_INTERVAL;
-  else if ((!strcmp(cptr, "DISABLED")) || (!strncmp(cptr, "DELAY=", 6))) {
+  else if (!strcmp(cptr, "DISABLED"))
     xq->var->poll = 0;
-    if (!strncmp(cptr, "DELAY=", 6)) {
-      int delay = 0;
-      if (1 != sscanf(cptr+6, "%d", &delay))
-        return SCPE_ARG;
-      xq->var->coalesce_latency = delay;
-      xq->var->coalesce_latency_ticks = (tmr_poll * clk_tps * xq->var->coalesce_latency) / 1000000;
-      }
+  else if (!strncmp(cptr, "DELAY=", 6)) {
+    /* interrupt coalescing; the receiver keeps polling, as the WiFi layer
+       has no asynchronous reader to fall back on */
+    int delay = 0;
+    if ((1 != sscanf(cptr+6, "%d", &delay)) || (delay < 0))
+      return SCPE_ARG;
+    xq->var->coalesce_latency = delay;
+    xq->var->coalesce_latency_ticks = (tmr_poll * clk_tps * xq->var->coalesce_latency) / 1000000;
     }
   else {
     int newpoll = 0;
@@ -999,6 +1005,74 @@ t_stat xq_nxm_error(CTLR* xq)
   return SCPE_OK;
 }
 
+/*
+** buffer descriptor cache - see struct xq_bdl_cache
+*/
+int32 xq_bdl_flush(struct xq_bdl_cache* c)
+{
+  int32 status = 0;
+
+  if (c->dhi > c->dlo)
+    status = Map_WriteW(c->ba + c->dlo * 2, (c->dhi - c->dlo) * 2, &c->buf[c->dlo]);
+  c->len = 0;
+  c->dlo = c->dhi = 0;
+  return status;
+}
+
+/* read descriptor words, fetching the next XQ_BDL_PREFETCH descriptors if
+   they are not cached yet */
+int32 xq_bdl_read(struct xq_bdl_cache* c, uint32 ba, int32 bc, uint16* buf)
+{
+  int32 resid;
+
+  if ((ba < c->ba) || (ba + bc > c->ba + c->len * 2) || ((ba - c->ba) & 1)) {
+    if (xq_bdl_flush(c))
+      return bc;
+    resid = Map_ReadW(ba, sizeof(c->buf), c->buf);
+    c->ba = ba;
+    c->len = (sizeof(c->buf) - resid) / 2;
+    if (c->len * 2 < bc) {                  /* runs into non existent memory */
+      c->len = 0;
+      return Map_ReadW(ba, bc, buf);
+      }
+    }
+  memcpy(buf, &c->buf[(ba - c->ba) / 2], bc);
+  return 0;
+}
+
+/* write descriptor words; they reach host memory on the next flush */
+int32 xq_bdl_write(struct xq_bdl_cache* c, uint32 ba, int32 bc, const uint16* buf)
+{
+  int32 lo, hi;
+
+  if ((ba < c->ba) || (ba + bc > c->ba + c->len * 2) || ((ba - c->ba) & 1))
+    return Map_WriteW(ba, bc, (uint16*)buf);
+  lo = (ba - c->ba) / 2;
+  hi = lo + bc / 2;
+  memcpy(&c->buf[lo], buf, bc);
+  if (c->dhi == c->dlo) {
+    c->dlo = lo;
+    c->dhi = hi;
+  } else {
+    if (lo < c->dlo) c->dlo = lo;
+    if (hi > c->dhi) c->dhi = hi;
+  }
+  return 0;
+}
+
+/* receive data is about to be written to host memory; if it lands on
+   cached descriptors (which a sane driver never does), write those back
+   first and fetch them again afterwards */
+void xq_bdl_dma(CTLR* xq, uint32 ba, int32 bc)
+{
+  struct xq_bdl_cache* c[2] = {&xq->var->rbdl_cache, &xq->var->xbdl_cache};
+  int i;
+
+  for (i = 0; i < 2; i++)
+    if (c[i]->len && (ba < c[i]->ba + c[i]->len * 2) && (ba + bc > c[i]->ba))
+      xq_bdl_flush(c[i]);
+}
+
 /*
 ** write callback
 */
@@ -1016,11 +1090,11 @@ void xq_write_callback (CTLR* xq, int status)
   if (status == 0) { /* success */
     if (DBG_PCK & xq->dev->dctrl)
       eth_packet_trace_ex(xq->var->etherface, xq->var->write_buffer.msg, xq->var->write_buffer.len, "xq-write", DBG_DAT & xq->dev->dctrl, DBG_PCK);
-    wstatus = Map_WriteW(xq->var->xbdl_ba + 8, 4, write_success);
+    wstatus = xq_bdl_write(&xq->var->xbdl_cache, xq->var->xbdl_ba + 8, 4, write_success);
   } else { /* failure */
     sim_debug(DBG_WRN, xq->dev, "Packet Write Error!\n");
     xq->var->stats.fail += 1;
-    wstatus = Map_WriteW(xq->var->xbdl_ba + 8, 4, write_failure);
+    wstatus = xq_bdl_write(&xq->var->xbdl_cache, xq->var->xbdl_ba + 8, 4, write_failure);
   }
   if (wstatus) {
     xq_nxm_error(xq);
@@ -1028,7 +1102,7 @@ void xq_write_callback (CTLR* xq, int status)
   }
 
   /* update csr */
-  xq_csr_set_clr(xq, XQ_CSR_XI, 0);
+  xq_csr_post(xq, XQ_CSR_XI);
 
   /* reset sanity timer */
   xq_reset_santmr(xq);
@@ -1094,7 +1168,7 @@ t_stat xq_rd(int32* data, int32 PA, int32 access)
 /* dispatch ethernet read request
    procedure documented in sec. 3.2.2 */
 
-t_stat xq_process_rbdl(CTLR* xq)
+static t_stat xq_process_rbdl_list(CTLR* xq)
 {
   int32 rstatus, wstatus;
   uint16 b_length, w_length, rbl;
@@ -1103,9 +1177,6 @@ t_stat xq_process_rbdl(CTLR* xq)
   ETH_ITEM* item;
   uint8* rbuf;
 
-  if (xq->var->mode == XQ_T_DELQA_PLUS)
-    return xq_process_turbo_rbdl(xq);
-
   sim_debug(DBG_TRC, xq->dev, "xq_process_rbdl\n");
 
   if (xq->var->csr & XQ_CSR_RL)
@@ -1118,7 +1189,7 @@ t_stat xq_process_rbdl(CTLR* xq)
   while(1) {
 
     /* get receive bdl flags and descriptor bits from memory */
-    rstatus = Map_ReadW (xq->var->rbdl_ba,     4, &xq->var->rbdl_buf[0]);
+    rstatus = xq_bdl_read (&xq->var->rbdl_cache, xq->var->rbdl_ba, 4, &xq->var->rbdl_buf[0]);
     if (rstatus) return xq_nxm_error(xq);
     
     /* DEQNA stops processing if nothing in read queue */
@@ -1135,7 +1206,7 @@ t_stat xq_process_rbdl(CTLR* xq)
 
     /* set descriptor processed flag */
     xq->var->rbdl_buf[0] = 0xFFFF;
-    wstatus = Map_WriteW(xq->var->rbdl_ba,     2, &xq->var->rbdl_buf[0]);
+    wstatus = xq_bdl_write(&xq->var->rbdl_cache, xq->var->rbdl_ba, 2, &xq->var->rbdl_buf[0]);
     if (wstatus) return xq_nxm_error(xq);
 
     /* invalid buffer? */
@@ -1147,7 +1218,7 @@ t_stat xq_process_rbdl(CTLR* xq)
     /* explicit chain buffer? */
     if (xq->var->rbdl_buf[1] & XQ_DSC_C) {
       /* get low part of chain address */
-      rstatus = Map_ReadW (xq->var->rbdl_ba + 4, 2, &xq->var->rbdl_buf[2]);
+      rstatus = xq_bdl_read (&xq->var->rbdl_cache, xq->var->rbdl_ba + 4, 2, &xq->var->rbdl_buf[2]);
       if (rstatus) return xq_nxm_error(xq);
       xq->var->rbdl_ba = ((xq->var->rbdl_buf[1] & 0x3F) << 16) | xq->var->rbdl_buf[2];
       continue;
@@ -1157,7 +1228,7 @@ t_stat xq_process_rbdl(CTLR* xq)
     if (!xq->var->ReadQ.count) break;
 
     /* get address, length and status words */
-    rstatus = Map_ReadW(xq->var->rbdl_ba + 4, 8, &xq->var->rbdl_buf[2]);
+    rstatus = xq_bdl_read (&xq->var->rbdl_cache, xq->var->rbdl_ba + 4, 8, &xq->var->rbdl_buf[2]);
     if (rstatus) return xq_nxm_error(xq);
 
     /* get host memory address */
@@ -1184,9 +1255,7 @@ t_stat xq_process_rbdl(CTLR* xq)
 
     item = &xq->var->ReadQ.item[xq->var->ReadQ.head];
     rbl = (uint16)item->packet.len;
-    rbuf = item->packet.msg;
-    if (item->packet.oversize)
-      rbuf = item->packet.oversize;
+    rbuf = ETH_PACK_DATA(&item->packet);
 
     /* see if packet must be size-adjusted or is splitting */
     if (item->packet.used) {
@@ -1203,7 +1272,7 @@ t_stat xq_process_rbdl(CTLR* xq)
         sim_debug(DBG_RBL, xq->dev, "Runt detected, size = %d\n", rbl);
         /* pad runts with zeros up to minimum size - this allows "legal" (size - 60)
            processing of those weird short ARP packets that seem to occur occasionally */
-        memset(&item->packet.msg[rbl], 0, ETH_MIN_PACKET-rbl);
+        memset(&rbuf[rbl], 0, ETH_MIN_PACKET-rbl);
         rbl = ETH_MIN_PACKET;
         }
 
@@ -1225,6 +1294,7 @@ t_stat xq_process_rbdl(CTLR* xq)
     item->packet.used += rbl;
     
     /* send data to host */
+    xq_bdl_dma(xq, address, rbl);
     wstatus = Map_WriteB(address, rbl, rbuf);
     if (wstatus) return xq_nxm_error(xq);
 
@@ -1240,6 +1310,7 @@ t_stat xq_process_rbdl(CTLR* xq)
           uint16 qdtc_chip_extra = 0xC000;
 
           if (b_length <= rbl + 2) {
+            xq_bdl_dma(xq, address + rbl, 2);
             wstatus = Map_WriteW(address + rbl, 2, &qdtc_chip_extra);
             if (wstatus) return xq_nxm_error(xq);
             }
@@ -1278,7 +1349,7 @@ t_stat xq_process_rbdl(CTLR* xq)
       xq->var->rbdl_buf[4] |= XQ_RST_LASTERR;   /* set Error bit (LONG) */
 
     /* update read status words*/
-    wstatus = Map_WriteW(xq->var->rbdl_ba + 8, 4, &xq->var->rbdl_buf[4]);
+    wstatus = xq_bdl_write(&xq->var->rbdl_cache, xq->var->rbdl_ba + 8, 4, &xq->var->rbdl_buf[4]);
     if (wstatus) return xq_nxm_error(xq);
 
     sim_debug(DBG_TRC, xq->dev, "xq_process_rbdl(bd=0x%X, addr=0x%X, size=0x%X, len=0x%X, st1=0x%04X, st2=0x%04X)\n", 
@@ -1289,7 +1360,7 @@ t_stat xq_process_rbdl(CTLR* xq)
       ethq_remove(&xq->var->ReadQ);
 
       /* signal reception complete */
-      xq_csr_set_clr(xq, XQ_CSR_RI, 0);
+      xq_csr_post(xq, XQ_CSR_RI);
      }
 
     /* set to next bdl (implicit chain) */
@@ -1300,6 +1371,27 @@ t_stat xq_process_rbdl(CTLR* xq)
   return SCPE_OK;
 }
 
+t_stat xq_process_rbdl(CTLR* xq)
+{
+  t_stat status;
+
+  if (xq->var->mode == XQ_T_DELQA_PLUS)
+    status = xq_process_turbo_rbdl(xq);
+  else {
+    status = xq_process_rbdl_list(xq);
+    if (xq_bdl_flush(&xq->var->rbdl_cache))
+      return xq_nxm_error(xq);
+  }
+
+  /* packets left waiting in the network layer for lack of buffers can come
+     in now, rather than on the next fallback poll */
+  if (xq->var->rx_stalled && (xq->var->ReadQ.count < xq->var->ReadQ.max)) {
+    xq->var->rx_stalled = 0;
+    sim_activate_abs(xq->unit, xq->var->coalesce_latency_ticks);
+  }
+  return status;
+}
+
 t_stat xq_process_mop(CTLR* xq)
 {
   uint32 address;
@@ -1482,7 +1574,7 @@ t_stat xq_process_setup(CTLR* xq)
   until the end of the list is found.
 
 */
-t_stat xq_process_xbdl(CTLR* xq)
+static t_stat xq_process_xbdl_list(CTLR* xq)
 {
   const uint16  implicit_chain_status[2] = {XQ_DSC_V | XQ_DSC_C, 1};
   uint16  write_success[2] = {0x2000 /* Bit 13 Always Set */, 1 /*Non-Zero TDR*/};
@@ -1502,9 +1594,9 @@ t_stat xq_process_xbdl(CTLR* xq)
   while (1) {
 
     /* Get transmit bdl from memory */
-    rstatus = Map_ReadW (xq->var->xbdl_ba,    12, &xq->var->xbdl_buf[0]);
+    rstatus = xq_bdl_read (&xq->var->xbdl_cache, xq->var->xbdl_ba, 12, &xq->var->xbdl_buf[0]);
     xq->var->xbdl_buf[0] = 0xFFFF;
-    wstatus = Map_WriteW(xq->var->xbdl_ba,     2, &xq->var->xbdl_buf[0]);
+    wstatus = xq_bdl_write(&xq->var->xbdl_cache, xq->var->xbdl_ba, 2, &xq->var->xbdl_buf[0]);
     if (rstatus || wstatus) return xq_nxm_error(xq);
 
     /* compute host memory address */
@@ -1567,7 +1659,7 @@ t_stat xq_process_xbdl(CTLR* xq)
         }
 
         /* update write status */
-        wstatus = Map_WriteW(xq->var->xbdl_ba + 8, 4, (uint16*) write_success);
+        wstatus = xq_bdl_write(&xq->var->xbdl_cache, xq->var->xbdl_ba + 8, 4, write_success);
         if (wstatus) return xq_nxm_error(xq);
 
         /* clear write buffer */
@@ -1583,7 +1675,7 @@ t_stat xq_process_xbdl(CTLR* xq)
 
         /* now schedule "reading" of setup or loopback packet */
         if (~xq->var->csr & XQ_CSR_RL)
-          sim_activate_after_abs(xq->unit+3, 400);  /* 400usecs on real hardware */
+          sim_activate_after_abs(xq->unit+3, xq_ltime);  /* 400usecs on real hardware */
 
       } else { /* not loopback */
 
@@ -1602,7 +1694,7 @@ t_stat xq_process_xbdl(CTLR* xq)
 
       sim_debug(DBG_XBL, xq->dev, "implicitly chaining to buffer descriptor at: 0x%X\n", xq->var->xbdl_ba+12);
       /* update bdl status words */
-      wstatus = Map_WriteW(xq->var->xbdl_ba + 8, 4, implicit_chain_status);
+      wstatus = xq_bdl_write(&xq->var->xbdl_cache, xq->var->xbdl_ba + 8, 4, implicit_chain_status);
       if(wstatus) return xq_nxm_error(xq);
     }
 
@@ -1612,6 +1704,16 @@ t_stat xq_process_xbdl(CTLR* xq)
   } /* while */
 }
 
+t_stat xq_process_xbdl(CTLR* xq)
+{
+  t_stat status;
+
+  status = xq_process_xbdl_list(xq);
+  if (xq_bdl_flush(&xq->var->xbdl_cache))
+    return xq_nxm_error(xq);
+  return status;
+}
+
 void xq_show_debug_bdl(CTLR* xq, uint32 bdl_ba)
 {
   uint16 bdl_buf[6];
@@ -1767,13 +1869,13 @@ t_stat xq_process_turbo_rbdl(CTLR* xq)
 
     item = &xq->var->ReadQ.item[xq->var->ReadQ.head];
     rbl = (uint16)(item->packet.len + ETH_CRC_SIZE);
-    rbuf = item->packet.msg;
+    rbuf = ETH_PACK_DATA(&item->packet);
 
     /* see if packet must be size-adjusted or is splitting */
     if (item->packet.used) {
       uint16 used = (uint16)item->packet.used;
       rbl -= used;
-      rbuf = &item->packet.msg[used];
+      rbuf = &rbuf[used];
     } else {
       /* adjust non loopback runt packets */
       if ((item->type != ETH_ITM_LOOPBACK) && (rbl < ETH_MIN_PACKET)) {
@@ -1781,7 +1883,7 @@ t_stat xq_process_turbo_rbdl(CTLR* xq)
         sim_debug(DBG_RBL, xq->dev, "Runt detected, size = %d\n", rbl);
         /* pad runts with zeros up to minimum size - this allows "legal" (size - 60)
            processing of those weird short ARP packets that seem to occur occasionally */
-        memset(&item->packet.msg[rbl], 0, ETH_MIN_PACKET-rbl);
+        memset(&rbuf[rbl], 0, ETH_MIN_PACKET-rbl);
         rbl = ETH_MIN_PACKET;
       };
 
@@ -2077,12 +2179,14 @@ t_stat xq_process_local (CTLR* xq, ETH_PACK* pack)
   if (xq->var->type == XQ_T_DEQNA)
     return SCPE_NOFNC;
 
-  protocol = pack->msg[12] | (pack->msg[13] << 8);
+  protocol = ETH_PACK_DATA(pack)[12] | (ETH_PACK_DATA(pack)[13] << 8);
   switch (protocol) {
     case 0x0090:  /* ethernet loopback */
+      eth_pack_unshare(pack);               /* response is built in place */
       return xq_process_loopback(xq, pack);
       break;
     case 0x0260:  /* MOP remote console */
+      eth_pack_unshare(pack);
       return xq_process_remote_console(xq, pack);
       break;
   }
@@ -2094,7 +2198,7 @@ void xq_read_callback(CTLR* xq, int status)
   xq->var->stats.recv += 1;
 
   if (DBG_PCK & xq->dev->dctrl)
-    eth_packet_trace_ex(xq->var->etherface, xq->var->read_buffer.msg, xq->var->read_buffer.len, "xq-recvd", DBG_DAT & xq->dev->dctrl, DBG_PCK);
+    eth_packet_trace_ex(xq->var->etherface, ETH_PACK_DATA(&xq->var->read_buffer), xq->var->read_buffer.len, "xq-recvd", DBG_DAT & xq->dev->dctrl, DBG_PCK);
 
   xq->var->read_buffer.used = 0;  /* none processed yet */
 
@@ -2149,6 +2253,9 @@ void xq_sw_reset(CTLR* xq)
 
   /* clear interrupt unconditionally */
   xq_clrint(xq);
+  sim_cancel(&xq->unit[5]);
+  xq->var->coalesce_bits = 0;
+  xq->var->rx_stalled = 0;
 
   /* flush read queue */
   ethq_clear(&xq->var->ReadQ);
@@ -2335,20 +2442,17 @@ void xq_start_receiver(CTLR* xq)
     return;
 
   /* start the read service timer or enable asynch reading as appropriate */
-  if (xq->var->must_poll) {
+  /* with asynch reading, arriving packets activate the service routine
+     directly; the poll timer, unless disabled, only picks up anything that
+     was left behind */
+  if (!xq->var->must_poll)
+    xq->var->must_poll = (SCPE_OK != eth_set_async(xq->var->etherface, xq->var->coalesce_latency_ticks));
+  if (xq->var->must_poll || xq->var->poll) {
     if (sim_idle_enab)
       sim_clock_coschedule(xq->unit, tmxr_poll);
     else
-      sim_activate(xq->unit, (tmr_poll*clk_tps)/xq->var->poll);
+      sim_activate(xq->unit, (tmr_poll*clk_tps)/(xq->var->poll ? xq->var->poll : XQ_SERVICE_INTERVAL));
     }
-  else
-    if ((xq->var->poll == 0) || (xq->var->mode == XQ_T_DELQA_PLUS))
-      eth_set_async(xq->var->etherface, xq->var->coalesce_latency_ticks);
-    else
-      if (sim_idle_enab)
-        sim_clock_coschedule(xq->unit, tmxr_poll);
-      else
-        sim_activate(xq->unit, (tmr_poll*clk_tps)/xq->var->poll);
 }
 
 void xq_stop_receiver(CTLR* xq)
@@ -2568,6 +2672,8 @@ t_stat xq_reset(DEVICE* dptr)
     sim_set_uname (&dptr->units[3], uname);
     sprintf (uname, "%s-SRQRSVC", dptr->name);
     sim_set_uname (&dptr->units[4], uname);
+    sprintf (uname, "%s-COALSVC", dptr->name);
+    sim_set_uname (&dptr->units[5], uname);
     /* Set an initial MAC address in the DEC range */
     xq_setmac (dptr->units, 0, "08:00:2B:00:00:00/24", NULL);
     }
@@ -2619,6 +2725,11 @@ t_stat xq_reset(DEVICE* dptr)
   sim_cancel(xq->unit);
   sim_cancel(&xq->unit[2]);
 
+  /* drop any held back interrupt */
+  sim_cancel(&xq->unit[5]);
+  xq->var->coalesce_bits = 0;
+  xq->var->rx_stalled = 0;
+
   /* set hardware sanity controls */
   if (xq->var->sanity.enabled & XQ_SAN_HW_SW)
     xq->var->sanity.quarter_secs = XQ_HW_SANITY_SECS * 4/*qsec*/;
@@ -2751,8 +2862,20 @@ t_stat xq_svc(UNIT* uptr)
       xq_process_rbdl(xq);
 
     /* Now read and queue packets that have arrived */
-    /* This is repeated as long as they are available */
+    /* This is repeated as long as they are available and there is room for
+       them: when the read queue fills up, it is emptied into the host's
+       buffers, and if the host has no buffers left either, the rest of the
+       packets wait in the network layer until the next pass rather than
+       pushing queued ones out */
     do {
+      if (xq->var->ReadQ.count >= xq->var->ReadQ.max) {
+        if ((xq->var->mode == XQ_T_DELQA_PLUS) || (~xq->var->csr & XQ_CSR_RL))
+          xq_process_rbdl(xq);
+        if (xq->var->ReadQ.count >= xq->var->ReadQ.max) {
+          xq->var->rx_stalled = 1;                      /* resume when the host supplies buffers */
+          break;
+        }
+      }
       /* read a packet from the ethernet - processing is via the callback */
       status = eth_read (xq->var->etherface, &xq->var->read_buffer, xq->var->rcallback);
     } while (status);
@@ -2762,17 +2885,32 @@ t_stat xq_svc(UNIT* uptr)
       xq_process_rbdl(xq);
   }
 
-  /* resubmit service timer */
-  if ((xq->var->must_poll) || (xq->var->poll && (xq->var->mode != XQ_T_DELQA_PLUS))) {
+  /* resubmit service timer; with asynch reading this is only the fallback */
+  if ((xq->var->must_poll) || (xq->var->poll)) {
     if (sim_idle_enab)
       sim_clock_coschedule(uptr, tmxr_poll);
     else
-      sim_activate(uptr, (tmr_poll*clk_tps)/xq->var->poll);
+      sim_activate(uptr, (tmr_poll*clk_tps)/(xq->var->poll ? xq->var->poll : XQ_SERVICE_INTERVAL));
     }
 
   return SCPE_OK;
 }
 
+/*
+** service routine - raises receive/transmit interrupts held back by
+**                   interrupt coalescing
+*/
+t_stat xq_coalsvc(UNIT* uptr)
+{
+  CTLR* xq = xq_unit2ctlr(uptr);
+  uint16 bits = xq->var->coalesce_bits;
+
+  xq->var->coalesce_bits = 0;
+  if (bits)
+    xq_csr_set_clr(xq, bits, 0);
+  return SCPE_OK;
+}
+
 /*
 ** service routine - used for timer based activities
 */
@@ -2889,19 +3027,17 @@ t_stat xq_attach(UNIT* uptr, CONST char* cptr)
     return status;
   }
   eth_set_throttle (xq->var->etherface, xq->var->throttle_time, xq->var->throttle_burst, xq->var->throttle_delay);
-  if (xq->var->poll == 0) {
-    status = eth_set_async(xq->var->etherface, xq->var->coalesce_latency_ticks);
-    if (status != SCPE_OK) {
-      eth_close(xq->var->etherface);
-      free(tptr);
-      free(xq->var->etherface);
-      xq->var->etherface = NULL;
-      return status;
-    }
-    xq->var->must_poll = 0;
-  } else {
-    xq->var->must_poll = (SCPE_OK != eth_clr_async(xq->var->etherface));
+  /* receive asynchronously where possible, polling is then only a fallback;
+     without polling, asynch reading is a must */
+  status = eth_set_async(xq->var->etherface, xq->var->coalesce_latency_ticks);
+  if ((status != SCPE_OK) && (xq->var->poll == 0)) {
+    eth_close(xq->var->etherface);
+    free(tptr);
+    free(xq->var->etherface);
+    xq->var->etherface = NULL;
+    return status;
   }
+  xq->var->must_poll = (status != SCPE_OK);
   if (SCPE_OK != eth_check_address_conflict (xq->var->etherface, &xq->var->mac)) {
     eth_close(xq->var->etherface);
     free(tptr);
@@ -3061,6 +3197,22 @@ void xq_csr_set_clr (CTLR* xq, uint16 set_bits, uint16 clear_bits)
   } /* IE transitioning */
 }
 
+/* Signal receive (RI) and/or transmit (XI) completion. With interrupt
+   coalescing on (SET XQ POLL=DELAY=usecs) the bits, and with them the
+   interrupt, are held back for that long, so a burst of packets costs the
+   host one interrupt rather than one each. If the bits are already up
+   there is no interrupt to save. */
+void xq_csr_post(CTLR* xq, uint16 bits)
+{
+  if ((xq->var->coalesce_latency == 0) || ((xq->var->csr & bits) == bits)) {
+    xq_csr_set_clr(xq, bits, 0);
+    return;
+  }
+  xq->var->coalesce_bits |= bits;
+  if (!sim_is_active(&xq->unit[5]))
+    sim_activate_after(&xq->unit[5], xq->var->coalesce_latency);
+}
+
 /*==============================================================================
 /                               debugging routines
 /=============================================================================*/
@@ -3260,11 +3412,12 @@ const char helpString[] =
     " service polling is unnecessary and inefficient when asynchronous I/O is\n"
     " available, therefore the default setting is disabled.\n"
 #else /* !(defined(USE_READER_THREAD) && defined(SIM_ASYNCH_IO)) */
-    " The SET %D POLL command changes the service polling timer.  The polling\n"
-    " timer is calibrated to run the service thread on each simulated system clock\n"
-    " tick.  This should be sufficient for most situations, however if desired more\n"
-    " frequent polling can be specified.  Polling too frequent can seriously impact\n"
-    " the simulator's ability to execute instructions efficiently.\n"
+    " The SET %D POLL command changes the service polling timer.  Arriving\n"
+    " packets start the receive service right away, so polling is only a\n"
+    " fallback for packets that had to wait, and the default rate is low.\n"
+    " SET %D POLL=DISABLED turns it off altogether.  Polling too frequently can\n"
+    " seriously impact the simulator's ability to execute instructions\n"
+    " efficiently.\n"
 #endif /* defined(USE_READER_THREAD) && defined(SIM_ASYNCH_IO) */
      /****************************************************************************/
     "3 THROTTLE\n"
@@ -89,7 +89,7 @@
 #if defined(SIM_ASYNCH_IO) && defined(USE_READER_THREAD)
 #define XQ_SERVICE_INTERVAL  0                          /* polling interval - No Polling with Asynch I/O */
 #else
-#define XQ_SERVICE_INTERVAL  100                        /* polling interval - X per second */
+#define XQ_SERVICE_INTERVAL  10                         /* fallback polling interval - X per second; arriving packets wake the receiver */
 #endif
 #define XQ_SYSTEM_ID_SECS    540                        /* seconds before system ID timer expires */
 #define XQ_STARTUP_DELAY      20                        /* instruction delay before receiver starts */
@@ -97,6 +97,7 @@
 #define XQ_MAX_CONTROLLERS     2                        /* maximum controllers allowed */
 
 #define XQ_MAX_RCV_PACKET   1600                        /* Maximum receive packet data */
+#define XQ_BDL_PREFETCH        8                        /* buffer descriptors fetched per DMA read */
 
 enum xq_type {XQ_T_DEQNA, XQ_T_DELQA, XQ_T_DELQA_PLUS};
 
@@ -255,6 +256,17 @@ struct xq_meb {                                         /* MEB block */
   uint8   siz_hi;
 };
 
+/* Buffer descriptors are fetched from host memory a run at a time and the
+   status words are written back to the copy; it is written to host memory
+   in one go once the list has been processed. Only valid while a list is
+   being processed, as the host may change its descriptors at any other time. */
+struct xq_bdl_cache {
+  uint32            ba;                                 /* address of first cached word */
+  int32             len;                                /* words cached, 0 if empty */
+  int32             dlo, dhi;                           /* words changed, [dlo, dhi) */
+  uint16            buf[XQ_BDL_PREFETCH * 6];
+};
+
 struct xq_device {
                                                         /*+ initialized values - DO NOT MOVE */
   ETH_PCALLBACK     rcallback;                          /* read callback routine */
@@ -311,6 +323,10 @@ struct xq_device {
   int32             idtmr;                              /* countdown for ID Timer */
   uint32            must_poll;                          /* receiver must poll instead of counting on asynch polls */
   t_bool            initialized;                        /* flag for one time initializations */
+  struct xq_bdl_cache rbdl_cache;                       /* receive descriptors being processed */
+  struct xq_bdl_cache xbdl_cache;                       /* transmit descriptors being processed */
+  uint16            coalesce_bits;                      /* RI/XI held back by interrupt coalescing */
+  uint32            rx_stalled;                         /* received packets wait for host buffers */
 };
 
 struct xq_controller {
@@ -0,0 +1,111 @@
+//Pool of fixed-size, reference counted packet buffers, plus a lock-free ring to hand them
+//from the network receive side to the emulator.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+/*
+Received frames used to be malloc()ed one by one, which on the ESP32 chops up the heap
+over time. Instead, all packet buffers are allocated in one go and recycled. Buffers are
+taken from the pool by the rx side (WiFi task, tap reader thread, wifid) and given back
+by the emulator once the NIC has DMA'ed the frame into the guest, so the free list is
+shared and guarded by a short critical section. The rx ring itself has one producer and
+one consumer and needs no lock.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pktbuf.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+static portMUX_TYPE pool_mux=portMUX_INITIALIZER_UNLOCKED;
+#define POOL_LOCK() portENTER_CRITICAL(&pool_mux)
+#define POOL_UNLOCK() portEXIT_CRITICAL(&pool_mux)
+#else
+#include <pthread.h>
+static pthread_mutex_t pool_mux=PTHREAD_MUTEX_INITIALIZER;
+#define POOL_LOCK() pthread_mutex_lock(&pool_mux)
+#define POOL_UNLOCK() pthread_mutex_unlock(&pool_mux)
+#endif
+
+static pktbuf_t *pool=NULL;
+static pktbuf_t *free_list=NULL;
+static int free_count=0;
+
+void pktbuf_init() {
+	if (pool) return;
+	pool=calloc(PKTBUF_COUNT, sizeof(pktbuf_t));
+	if (!pool) {
+		printf("pktbuf: can't allocate %d packet buffers\n", PKTBUF_COUNT);
+		return;
+	}
+	POOL_LOCK();
+	for (int i=0; i<PKTBUF_COUNT; i++) {
+		pool[i].next=free_list;
+		free_list=&pool[i];
+	}
+	free_count=PKTBUF_COUNT;
+	POOL_UNLOCK();
+}
+
+pktbuf_t *pktbuf_alloc() {
+	POOL_LOCK();
+	pktbuf_t *pb=free_list;
+	if (pb) {
+		free_list=pb->next;
+		free_count--;
+	}
+	POOL_UNLOCK();
+	if (!pb) return NULL;
+	pb->next=NULL;
+	pb->refcnt=1;
+	pb->len=0;
+	return pb;
+}
+
+void pktbuf_ref(pktbuf_t *pb) {
+	__atomic_add_fetch(&pb->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+void pktbuf_unref(pktbuf_t *pb) {
+	if (!pb) return;
+	if (__atomic_sub_fetch(&pb->refcnt, 1, __ATOMIC_ACQ_REL)!=0) return;
+	POOL_LOCK();
+	pb->next=free_list;
+	free_list=pb;
+	free_count++;
+	POOL_UNLOCK();
+}
+
+int pktbuf_free_count() {
+	return free_count;
+}
+
+int pktring_put(pktring_t *r, pktbuf_t *pb) {
+	uint32_t head=r->head;
+	uint32_t tail=__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (head-tail>=PKTRING_SIZE) {
+		r->full++;
+		return 0;
+	}
+	r->slot[head&(PKTRING_SIZE-1)]=pb;
+	//publish the slot only after it's filled in
+	__atomic_store_n(&r->head, head+1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+pktbuf_t *pktring_get(pktring_t *r) {
+	uint32_t tail=r->tail;
+	uint32_t head=__atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	if (head==tail) return NULL;
+	pktbuf_t *pb=r->slot[tail&(PKTRING_SIZE-1)];
+	__atomic_store_n(&r->tail, tail+1, __ATOMIC_RELEASE);
+	return pb;
+}
@@ -0,0 +1,48 @@
+//Pool of fixed-size, reference counted packet buffers, plus a lock-free ring to hand them
+//from the network receive side to the emulator.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+
+//Room for the largest Ethernet frame plus its CRC
+#define PKTBUF_SIZE 1536
+//Enough to fill the rx ring and the XQ read queue, with a few to spare
+#define PKTBUF_COUNT 48
+//Must be a power of two
+#define PKTRING_SIZE 32
+
+typedef struct pktbuf {
+	int refcnt;
+	int len;
+	struct pktbuf *next; //free list link
+	uint8_t data[PKTBUF_SIZE];
+} pktbuf_t;
+
+//Ring of packet buffers. Exactly one task may put and exactly one may get.
+typedef struct {
+	pktbuf_t *slot[PKTRING_SIZE];
+	uint32_t head; //only written by the producer
+	uint32_t tail; //only written by the consumer
+	uint32_t full; //put failures, for statistics
+} pktring_t;
+
+//Allocates the pool; safe to call more than once
+void pktbuf_init();
+//Returns a buffer with a refcount of 1, or NULL if the pool is used up
+pktbuf_t *pktbuf_alloc();
+void pktbuf_ref(pktbuf_t *pb);
+//Drops a reference; the buffer goes back to the pool when the last one is gone
+void pktbuf_unref(pktbuf_t *pb);
+int pktbuf_free_count();
+
+//Returns 0 if the ring is full; the caller keeps its reference in that case
+int pktring_put(pktring_t *r, pktbuf_t *pb);
+//Returns NULL if the ring is empty. The reference the producer had passes to the caller.
+pktbuf_t *pktring_get(pktring_t *r);
@@ -49,6 +49,9 @@
 #include <setjmp.h>
 #include <sys/stat.h>
 #include "wifi_if.h"
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
 
 FILE *sim_deb = NULL;                                   /* debug file */
 
@@ -455,7 +458,12 @@ t_stat get_aval (t_addr addr, DEVICE *dptr, UNIT *uptr)	{
 			}
 			sz = SZ_D (dptr);
 			loc = j / dptr->aincr;
-			if (uptr->flags & UNIT_BUF) {
+			if (uptr->flags & UNIT_PAGEBUF) {
+				if (sim_buf_read (uptr, (t_addr)(sz * loc), &sim_eval[i], (uint32) sz) != SCPE_OK) {
+					reason = SCPE_IOERR;
+					break;
+				}
+			} else if (uptr->flags & UNIT_BUF) {
 				SZ_LOAD (sz, sim_eval[i], uptr->filebuf, loc);
 			} else {
 				if (sim_fseek (uptr->fileref, (t_addr)(sz * loc), SEEK_SET)) {
@@ -507,6 +515,149 @@ t_stat attach_err (UNIT *uptr, t_stat stat) {
 	return stat;
 }
 
+/* Paged unit buffers
+
+   A buffered unit with UNIT_PAGEBUF set does not get its whole file read into
+   memory on attach. Instead filebuf points to a sim_pagebuf, and the file is
+   read a page at a time when it's first accessed through sim_buf_read/write.
+   At most SIM_PAGEBUF_SLOTS pages are kept in memory; when another one is
+   needed, the page loaded longest ago is dropped, after writing it back if it
+   was changed.
+*/
+
+#define SIM_PAGEBUF_SIZE	4096
+#define SIM_PAGEBUF_SLOTS	16
+
+typedef struct {
+	t_addr size;				//file size in bytes
+	uint32 npages;
+	int32 *slot;				//per page: slot it's loaded in, or -1
+	uint32 nslots;
+	int32 *owner;				//per slot: page it holds, or -1
+	uint8 *dirty;				//per slot
+	uint8 *data;				//nslots pages
+	uint32 hand;				//next slot to reuse
+} sim_pagebuf;
+
+static void pagebuf_free (sim_pagebuf *pb) {
+	if (pb == NULL) return;
+	free (pb->slot);
+	free (pb->owner);
+	free (pb->dirty);
+	free (pb->data);
+	free (pb);
+}
+
+static sim_pagebuf *pagebuf_new (t_addr size) {
+	sim_pagebuf *pb = (sim_pagebuf *) calloc (1, sizeof (*pb));
+	uint32 i;
+	if (pb == NULL) return NULL;
+	pb->size = size;
+	pb->npages = (uint32)((size + SIM_PAGEBUF_SIZE - 1) / SIM_PAGEBUF_SIZE);
+	pb->nslots = (pb->npages < SIM_PAGEBUF_SLOTS) ? pb->npages : SIM_PAGEBUF_SLOTS;
+	pb->slot = (int32 *) malloc (pb->npages * sizeof (int32));
+	pb->owner = (int32 *) malloc (pb->nslots * sizeof (int32));
+	pb->dirty = (uint8 *) calloc (pb->nslots, 1);
+	pb->data = (uint8 *) malloc (pb->nslots * SIM_PAGEBUF_SIZE);
+	if (!pb->slot || !pb->owner || !pb->dirty || !pb->data) {
+		pagebuf_free (pb);
+		return NULL;
+	}
+	for (i = 0; i < pb->npages; i++) pb->slot[i] = -1;
+	for (i = 0; i < pb->nslots; i++) pb->owner[i] = -1;
+	return pb;
+}
+
+static t_stat pagebuf_writeback (UNIT *uptr, sim_pagebuf *pb, uint32 s) {
+	t_addr pos = (t_addr) pb->owner[s] * SIM_PAGEBUF_SIZE;
+	size_t len = (pb->size - pos < SIM_PAGEBUF_SIZE) ? (size_t)(pb->size - pos) : SIM_PAGEBUF_SIZE;
+	if (!pb->dirty[s]) return SCPE_OK;
+	if (sim_fseek (uptr->fileref, pos, SEEK_SET) ||
+			(fwrite (pb->data + s * SIM_PAGEBUF_SIZE, 1, len, uptr->fileref) != len)) {
+		clearerr (uptr->fileref);
+		return SCPE_IOERR;
+	}
+	pb->dirty[s] = 0;
+	return SCPE_OK;
+}
+
+//Returns the in-memory copy of a page, loading it if needed.
+static uint8 *pagebuf_get (UNIT *uptr, sim_pagebuf *pb, uint32 page) {
+	uint32 s;
+	size_t n = 0;
+	if (pb->slot[page] >= 0) return pb->data + pb->slot[page] * SIM_PAGEBUF_SIZE;
+	s = pb->hand;
+	pb->hand = (pb->hand + 1) % pb->nslots;
+	if (pb->owner[s] >= 0) {						//evict
+		if (pagebuf_writeback (uptr, pb, s) != SCPE_OK) return NULL;
+		pb->slot[pb->owner[s]] = -1;
+	}
+	if (sim_fseek (uptr->fileref, (t_addr) page * SIM_PAGEBUF_SIZE, SEEK_SET) == 0)
+		n = fread (pb->data + s * SIM_PAGEBUF_SIZE, 1, SIM_PAGEBUF_SIZE, uptr->fileref);
+	clearerr (uptr->fileref);
+	memset (pb->data + s * SIM_PAGEBUF_SIZE + n, 0, SIM_PAGEBUF_SIZE - n);	//past end of file reads as zero
+	pb->owner[s] = page;
+	pb->slot[page] = s;
+	return pb->data + s * SIM_PAGEBUF_SIZE;
+}
+
+//Copy len bytes at byte offset off out of a buffered unit.
+t_stat sim_buf_read (UNIT *uptr, t_addr off, void *buf, uint32 len) {
+	sim_pagebuf *pb = (sim_pagebuf *) uptr->filebuf;
+	uint8 *dst = (uint8 *) buf, *p;
+	if (!(uptr->flags & UNIT_BUF) || (pb == NULL)) return SCPE_UNATT;
+	if (!(uptr->flags & UNIT_PAGEBUF)) {
+		memcpy (dst, (uint8 *) uptr->filebuf + off, len);
+		return SCPE_OK;
+	}
+	while (len) {
+		uint32 o = (uint32)(off % SIM_PAGEBUF_SIZE);
+		uint32 n = (len < SIM_PAGEBUF_SIZE - o) ? len : SIM_PAGEBUF_SIZE - o;
+		if ((off >= pb->size) || ((p = pagebuf_get (uptr, pb, (uint32)(off / SIM_PAGEBUF_SIZE))) == NULL)) return SCPE_IOERR;
+		memcpy (dst, p + o, n);
+		dst += n;
+		off += n;
+		len -= n;
+	}
+	return SCPE_OK;
+}
+
+//Copy len bytes into a buffered unit at byte offset off.
+t_stat sim_buf_write (UNIT *uptr, t_addr off, const void *buf, uint32 len) {
+	sim_pagebuf *pb = (sim_pagebuf *) uptr->filebuf;
+	const uint8 *src = (const uint8 *) buf;
+	uint8 *p;
+	if (!(uptr->flags & UNIT_BUF) || (pb == NULL)) return SCPE_UNATT;
+	if (!(uptr->flags & UNIT_PAGEBUF)) {
+		memcpy ((uint8 *) uptr->filebuf + off, src, len);
+		return SCPE_OK;
+	}
+	while (len) {
+		uint32 o = (uint32)(off % SIM_PAGEBUF_SIZE);
+		uint32 n = (len < SIM_PAGEBUF_SIZE - o) ? len : SIM_PAGEBUF_SIZE - o;
+		if ((off >= pb->size) || ((p = pagebuf_get (uptr, pb, (uint32)(off / SIM_PAGEBUF_SIZE))) == NULL)) return SCPE_IOERR;
+		memcpy (p + o, src, n);
+		pb->dirty[pb->slot[off / SIM_PAGEBUF_SIZE]] = 1;
+		src += n;
+		off += n;
+		len -= n;
+	}
+	return SCPE_OK;
+}
+
+//Write changed pages of a paged unit back to its file.
+t_stat sim_buf_flush (UNIT *uptr) {
+	sim_pagebuf *pb = (sim_pagebuf *) uptr->filebuf;
+	t_stat r = SCPE_OK;
+	uint32 s;
+	if (!(uptr->flags & UNIT_BUF) || !(uptr->flags & UNIT_PAGEBUF) || (pb == NULL)) return SCPE_OK;
+	for (s = 0; s < pb->nslots; s++) {
+		if ((pb->owner[s] >= 0) && (pagebuf_writeback (uptr, pb, s) != SCPE_OK)) r = SCPE_IOERR;
+	}
+	fflush (uptr->fileref);
+	return r;
+}
+
 /* Attach unit to file */
 
 t_stat attach_unit (UNIT *uptr, CONST char *cptr) {
@@ -528,6 +679,14 @@ t_stat attach_unit (UNIT *uptr, CONST char *cptr) {
 	}
 	if (uptr->flags & UNIT_BUFABLE) {						/* buffer? */
 		uint32 cap = ((uint32) uptr->capac) / dptr->aincr;	/* effective size */
+		if (uptr->flags & UNIT_PAGEBUF) {					/* paged in on demand? */
+			uptr->filebuf = pagebuf_new ((t_addr) cap * SZ_D (dptr));
+			if (uptr->filebuf == NULL) return attach_err (uptr, SCPE_MEM);
+			uptr->hwmark = 0;
+			uptr->flags = uptr->flags | UNIT_BUF | UNIT_ATT;
+			uptr->pos = 0;
+			return SCPE_OK;
+		}
 	printf("Ref %p\n", uptr->fileref );
 		if (uptr->flags & UNIT_MUSTBUF) uptr->filebuf = calloc (cap, SZ_D (dptr));		/* allocate */
 	printf("Ref %p\n", uptr->fileref );
@@ -559,6 +718,12 @@ t_stat detach_unit (UNIT *uptr) {
 		}
 	}
 	if ((dptr = find_dev_from_unit (uptr)) == NULL) return SCPE_OK;
+	if ((uptr->flags & UNIT_BUF) && (uptr->flags & UNIT_PAGEBUF)) {
+		if (sim_buf_flush (uptr) != SCPE_OK) sim_printf ("%s: I/O error writing back buffer\n", sim_dname (dptr));
+		pagebuf_free ((sim_pagebuf *) uptr->filebuf);
+		uptr->filebuf = NULL;
+		uptr->flags = uptr->flags & ~UNIT_BUF;
+	}
 	if ((uptr->flags & UNIT_BUF) && (uptr->filebuf)) {
 		uint32 cap = (uptr->hwmark + dptr->aincr - 1) / dptr->aincr;
 		if (uptr->hwmark && ((uptr->flags & UNIT_RO) == 0)) {
@@ -900,14 +1065,10 @@ int main (int argc, char *argv[]) {
 	struct stat statbuf;
 	if (stat(RA92_DISK_PATH, &statbuf)!=0) has_bsd_dsk=0;
 
-	//Set main memory capacity...
+	//Set main memory capacity. The floppy is paged in on demand (UNIT_PAGEBUF), so
+	//it doesn't need to come out of guest memory.
 	DEVICE *cpudev=find_dev("CPU");
-	if (has_bsd_dsk) {
-		cpudev->units[0].capac=3.5*1024*1024;
-	} else {
-		//Assign less memory as the floppy needs to be read into memory entirely
-		cpudev->units[0].capac=512*1024;
-	}
+	cpudev->units[0].capac=3.5*1024*1024;
 
 	if ((status = reset_all (0)) != SCPE_OK) {
 		fprintf (stderr, "Fatal simulator initialization error\n%s\n",
@@ -946,6 +1107,17 @@ int main (int argc, char *argv[]) {
 		if (status!=SCPE_OK) printf("Attach failed...\n");
 		printf("Boot from RX\n");
 	}
+	//Don't make the guest wait for imaginary seeks and transfers, unless configured otherwise
+	const char *timing="FASTTIMING";
+#ifdef ESP_PLATFORM
+#ifndef CONFIG_ESPPDP_FAST_TIMING
+	timing="NORMALTIMING";
+#endif
+#else
+	const char *timing_env=getenv("ESPPDP_TIMING"); //"normal" for real hardware delays
+	if (timing_env && strcmp(timing_env, "normal")==0) timing="NORMALTIMING";
+#endif
+	set_mod(cpudev, cpudev->units, timing, NULL, NULL);
 	status=dev->boot(0, dev);
 	if (status!=SCPE_OK) printf("Boot failed...\n");
 
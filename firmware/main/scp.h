@@ -114,6 +114,9 @@ const char *sim_error_text (t_stat stat);
 
 t_stat attach_unit (UNIT *uptr, CONST char *cptr);
 t_stat detach_unit (UNIT *uptr);
+t_stat sim_buf_read (UNIT *uptr, t_addr off, void *buf, uint32 len);
+t_stat sim_buf_write (UNIT *uptr, t_addr off, const void *buf, uint32 len);
+t_stat sim_buf_flush (UNIT *uptr);
 const char *sim_set_uname (UNIT *uptr, const char *uname);
 
 CONST char *get_glyph (const char *iptr, char *optr, char mchar);
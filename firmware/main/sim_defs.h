@@ -636,6 +636,7 @@ struct UNIT {
 #define UNIT_ROABLE     0001000         /* read only ok */
 #define UNIT_DISABLE    0002000         /* disable-able */
 #define UNIT_DIS        0004000         /* disabled */
+#define UNIT_PAGEBUF    0010000         /* buffer paged in on demand */
 #define UNIT_IDLE       0040000         /* idle eligible */
 
 /* Unused/meaningless flags */
@@ -1314,7 +1315,14 @@ extern int32 sim_asynch_inst_latency;
 #define AIO_UPDATE_QUEUE
 #define AIO_ACTIVATE(caller, uptr, event_time)
 #define AIO_VALIDATE(uptr)
-#define AIO_CHECK_EVENT
+/* No asynchronous event queue; other threads can still ask for a unit to
+   be serviced through sim_wake (see sim_evtq.c), which is checked here */
+extern volatile uint32 sim_wake_pending;
+void sim_wake_process (void);
+#define AIO_CHECK_EVENT                                                \
+    if (sim_wake_pending)                                              \
+      sim_wake_process ();                                             \
+    else (void)0
 #define AIO_INIT
 #define AIO_MAIN_THREAD TRUE
 #define AIO_LOCK
@@ -41,6 +41,10 @@ Public routines:
    sim_disk_wrsect           write disk sectors
    sim_disk_wrsect_a         write disk sectors asynchronously
    sim_disk_unload           unload or detach a disk as needed
+   sim_disk_flush            commit written sectors to stable storage
+   sim_disk_tick             periodic write-back of buffered data
+   sim_disk_trace            log a request to the trace file
+   sim_disk_pf_xxx           boot profile learning and prefetch
    sim_disk_reset            reset unit
    sim_disk_wrp              TRUE if write protected
    sim_disk_isavailable      TRUE if available for I/O
@@ -79,9 +83,67 @@ Internal routines:
 #include "sim_ether.h"
 #include <ctype.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+/* On the host build, disk images are mmap()ed so reads are served straight from
+   the page cache instead of going through stdio. The ESP32 keeps using stdio on
+   top of FATFS. */
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+#define SIM_DISK_MMAP   1
+#include <sys/mman.h>
+#else
+#define SIM_DISK_MMAP   0
+#endif
+#include <unistd.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#define DK_WC_BLOCK     CONFIG_ESPPDP_DISK_WC_BLOCK_SIZE
+#define DK_WC_SLOTS     CONFIG_ESPPDP_DISK_WC_SLOTS
+#define DK_WC_FLUSH_MS  CONFIG_ESPPDP_DISK_WC_FLUSH_MS
+#ifdef CONFIG_ESPPDP_DISK_JOURNAL
+#define DK_JOURNAL      TRUE
+#define DK_JOURNAL_MAX  (CONFIG_ESPPDP_DISK_JOURNAL_MAX_KB * 1024)
+#endif
+#ifdef CONFIG_ESPPDP_DISK_TRACE
+#define DK_TRACE_PATH   "/sdcard/disk.trc"
+#endif
+#define DK_PREFETCH_KB  CONFIG_ESPPDP_DISK_PREFETCH_KB
+#else
+#define DK_WC_BLOCK     16384
+#define DK_WC_SLOTS     8
+#define DK_WC_FLUSH_MS  2000
+#define DK_PREFETCH_KB  4096
+#endif
+#ifndef DK_JOURNAL
+#define DK_JOURNAL      FALSE
+#define DK_JOURNAL_MAX  (2048 * 1024)
+#endif
+#ifndef DK_TRACE_PATH
+#define DK_TRACE_PATH   NULL
+#endif
 
 #define disk_ctx up8                        /* Field in Unit structure which points to the disk_context */
 
+#define DK_SEQ_THRESH   4                   /* sequential requests before switching to MADV_SEQUENTIAL */
+#define DK_RND_THRESH   16                  /* scattered requests before switching to MADV_RANDOM */
+#define DK_READAHEAD    (256*1024)          /* bytes to MADV_WILLNEED ahead of a sequential scan */
+
+int32 sim_disk_msync_policy = DK_MSYNC_PERIODIC;    /* when to msync() written data */
+uint32 sim_disk_msync_interval = 1000;              /* msec between syncs for DK_MSYNC_PERIODIC */
+uint32 sim_disk_wc_block = DK_WC_BLOCK;             /* write coalescing block size, bytes */
+uint32 sim_disk_wc_slots = DK_WC_SLOTS;             /* write coalescing blocks, 0 = write through */
+uint32 sim_disk_wc_interval = DK_WC_FLUSH_MS;       /* msec before dirty blocks are written back */
+t_bool sim_disk_journal = DK_JOURNAL;               /* keep a write-ahead journal beside the image */
+uint32 sim_disk_journal_max = DK_JOURNAL_MAX;       /* journal size that forces a checkpoint, bytes */
+const char *sim_disk_trace_path = DK_TRACE_PATH;    /* request trace file, NULL if not tracing */
+uint32 sim_disk_prefetch_kb = DK_PREFETCH_KB;       /* boot prefetch memory, 0 = off */
+#if SIM_DISK_MMAP
+t_bool sim_disk_mmap = TRUE;                        /* map images instead of using stdio */
+#endif
+
 static uint32
 NtoHl(uint32 value)
 {
@@ -92,16 +154,109 @@ if (sim_end)
 return value;
 }
 
+struct disk_wc_slot {
+    t_offset            base;               /* image offset of the block, -1 if free */
+    uint8               *data;              /* block contents */
+    uint8               *dirty;             /* per sector: written by the guest */
+    };
+
+struct disk_pf;
+
 struct disk_context {
     t_offset            container_size;     /* Size of the data portion (of the pseudo disk) */
+    t_offset            file_size;          /* Size of the image file in bytes */
     uint32              sector_size;        /* Disk Sector Size (of the pseudo disk) */
     uint32              capac_factor;       /* Units of Capacity (8 = quadword, 2 = word, 1 = byte) */
     uint32              xfer_element_size;  /* Disk Bus Transfer size (1 - byte, 2 - word, 4 - longword) */
     uint32              storage_sector_size;/* Sector size of the containing storage */
 	DEVICE              *dptr;              /* Device for unit (access to debug flags) */
     uint32              dbit;               /* debugging bit */
+    struct disk_wc_slot *wc;                /* write coalescing blocks, NULL if writing through */
+    uint32              wc_nslots;          /* number of blocks in wc */
+    uint32              wc_block;           /* bytes per block */
+    uint8               *wc_fill;           /* scratch for filling partially written blocks */
+    t_bool              wc_dirty;           /* any block holds unwritten data */
+    uint32              wc_first_dirty;     /* sim_os_msec() of oldest unwritten data */
+    FILE                *jnl;               /* write-ahead journal, NULL if not journalling */
+    uint32              jnl_size;           /* bytes in the journal since the last checkpoint */
+    uint32              jnl_first;          /* sim_os_msec() of the first record since then */
+    t_bool              jnl_unsynced;       /* records appended since the last fsync */
+    struct disk_pf      *pf;                /* boot profile being learned or prefetched, NULL if neither */
+#if SIM_DISK_MMAP
+    uint8               *map;               /* mapped image, NULL if using stdio */
+    size_t              map_size;           /* size of the mapping in bytes */
+    t_lba               next_lba;           /* lba following the previous request */
+    uint32              seq_count;          /* run of sequential requests */
+    uint32              rnd_count;          /* run of non-sequential requests */
+    int                 advice;             /* current madvise() advice for the mapping */
+    t_bool              dirty;              /* mapping written since last msync */
+    uint32              last_sync;          /* sim_os_msec() of last msync */
+#endif
     };
 
+#if SIM_DISK_MMAP
+/* Pick madvise() hints from the request stream: long sequential runs (fsck, dump,
+   dd) get kernel readahead plus an explicit prefetch of the next window, scattered
+   access turns readahead off so we don't drag in pages nobody asked for. */
+
+static void sim_disk_mmap_advise (struct disk_context *ctx, t_lba lba, t_seccnt sects) {
+	int advice = ctx->advice;
+	if (lba == ctx->next_lba) {
+		ctx->seq_count++;
+		ctx->rnd_count = 0;
+		if (ctx->seq_count >= DK_SEQ_THRESH) advice = MADV_SEQUENTIAL;
+	} else {
+		ctx->rnd_count++;
+		ctx->seq_count = 0;
+		if (ctx->rnd_count >= DK_RND_THRESH) advice = MADV_RANDOM;
+		else if (advice == MADV_SEQUENTIAL) advice = MADV_NORMAL;
+	}
+	ctx->next_lba = lba + sects;
+	if (advice != ctx->advice) {
+		madvise (ctx->map, ctx->map_size, advice);
+		ctx->advice = advice;
+	}
+	if (advice == MADV_SEQUENTIAL) {
+		size_t off = ((size_t)ctx->next_lba * ctx->sector_size) & ~((size_t)sysconf (_SC_PAGESIZE) - 1);
+		if (off < ctx->map_size) {
+			size_t len = ctx->map_size - off;
+			if (len > DK_READAHEAD) len = DK_READAHEAD;
+			madvise (ctx->map + off, len, MADV_WILLNEED);
+		}
+	}
+}
+
+static void sim_disk_mmap_sync (struct disk_context *ctx, int flags) {
+	if (!ctx->dirty) return;
+	if (msync (ctx->map, ctx->map_size, flags) != 0) perror ("sim_disk: msync");
+	ctx->dirty = FALSE;
+	ctx->last_sync = sim_os_msec ();
+}
+
+static void sim_disk_mmap_open (UNIT *uptr, struct disk_context *ctx, t_offset bytes) {
+	int fd = fileno (uptr->fileref);
+	void *map;
+	if (bytes <= 0) return;
+	map = mmap (NULL, (size_t)bytes, PROT_READ | ((uptr->flags & UNIT_RO) ? 0 : PROT_WRITE), MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror ("sim_disk: mmap, falling back to stdio");
+		return;
+	}
+	ctx->map = (uint8 *)map;
+	ctx->map_size = (size_t)bytes;
+	ctx->advice = MADV_NORMAL;
+	ctx->next_lba = 0;
+	ctx->last_sync = sim_os_msec ();
+}
+
+static void sim_disk_mmap_close (struct disk_context *ctx) {
+	if (ctx->map == NULL) return;
+	sim_disk_mmap_sync (ctx, MS_SYNC);
+	munmap (ctx->map, ctx->map_size);
+	ctx->map = NULL;
+}
+#endif
+
 
 t_stat sim_disk_set_fmt (UNIT *uptr, int32 val, CONST char *cptr, void *desc) {
 	printf("sim_disk_set_fmt %s\n", cptr);
@@ -171,18 +326,623 @@ t_stat sim_disk_clr_async (UNIT *uptr) {
 	return SCPE_NOFNC;
 }
 
+/* Write coalescing. SD cards program whole flash pages internally, so every
+   scattered 512-byte write that FATFS hands them turns into a read-modify-write
+   of a much larger page. Instead, dirty sectors are gathered into aligned blocks
+   of sim_disk_wc_block bytes and written back as whole blocks, sorted by offset,
+   when all buffers are in use, when the oldest dirty data is older than
+   sim_disk_wc_interval msec, or when the guest asks for a flush. */
+
+static t_stat sim_os_disk_rdsect (UNIT *uptr, t_offset da, uint8 *buf, t_seccnt *sectsread, uint32 tbc);
+static t_stat sim_os_disk_wrsect (UNIT *uptr, t_offset da, uint8 *buf, t_seccnt *sectswritten, uint32 tbc);
+static t_stat sim_disk_jnl_sync (struct disk_context *ctx);
+
+static t_stat sim_disk_wc_open (struct disk_context *ctx) {
+	uint32 i, nsect;
+	if ((sim_disk_wc_slots == 0) || (sim_disk_wc_block < ctx->sector_size) ||
+			(sim_disk_wc_block % ctx->sector_size)) return SCPE_OK;
+	nsect = sim_disk_wc_block / ctx->sector_size;
+	ctx->wc = (struct disk_wc_slot *)calloc (sim_disk_wc_slots, sizeof (struct disk_wc_slot));
+	ctx->wc_fill = (uint8 *)malloc (sim_disk_wc_block);
+	if ((ctx->wc == NULL) || (ctx->wc_fill == NULL)) goto nomem;
+	ctx->wc_nslots = sim_disk_wc_slots;
+	ctx->wc_block = sim_disk_wc_block;
+	for (i = 0; i < ctx->wc_nslots; i++) {
+		ctx->wc[i].base = -1;
+		ctx->wc[i].data = (uint8 *)malloc (ctx->wc_block);
+		ctx->wc[i].dirty = (uint8 *)calloc (nsect, 1);
+		if ((ctx->wc[i].data == NULL) || (ctx->wc[i].dirty == NULL)) goto nomem;
+	}
+	return SCPE_OK;
+nomem:
+	printf("sim_disk: no memory for write coalescing buffers, writing through\n");
+	if (ctx->wc) {
+		for (i = 0; i < sim_disk_wc_slots; i++) {
+			free (ctx->wc[i].data);
+			free (ctx->wc[i].dirty);
+		}
+	}
+	free (ctx->wc);
+	free (ctx->wc_fill);
+	ctx->wc = NULL;
+	ctx->wc_fill = NULL;
+	ctx->wc_nslots = 0;
+	return SCPE_MEM;
+}
+
+static void sim_disk_wc_close (struct disk_context *ctx) {
+	uint32 i;
+	if (ctx->wc == NULL) return;
+	for (i = 0; i < ctx->wc_nslots; i++) {
+		free (ctx->wc[i].data);
+		free (ctx->wc[i].dirty);
+	}
+	free (ctx->wc);
+	free (ctx->wc_fill);
+	ctx->wc = NULL;
+	ctx->wc_fill = NULL;
+	ctx->wc_nslots = 0;
+}
+
+static int sim_disk_wc_cmp (const void *a, const void *b) {
+	const struct disk_wc_slot *sa = (const struct disk_wc_slot *)a;
+	const struct disk_wc_slot *sb = (const struct disk_wc_slot *)b;
+	if (sa->base == sb->base) return 0;
+	if (sa->base == -1) return 1;						/* free slots sort last */
+	if (sb->base == -1) return -1;
+	return (sa->base < sb->base) ? -1 : 1;
+}
+
+/* Write one block back as a single aligned write. Sectors the guest did not
+   write are filled in from the image first. */
+
+static t_stat sim_disk_wc_writeback (UNIT *uptr, struct disk_context *ctx, struct disk_wc_slot *slot) {
+	uint32 nsect = ctx->wc_block / ctx->sector_size;
+	uint32 i, last = 0, clean = 0;
+	size_t len;
+
+	for (i = 0; i < nsect; i++) {
+		if (slot->dirty[i]) last = i + 1;
+		else clean++;
+	}
+	len = ctx->wc_block;
+	if (slot->base + (t_offset)len > ctx->file_size) {	/* don't grow the image past the last dirty sector */
+		len = (ctx->file_size > slot->base) ? (size_t)(ctx->file_size - slot->base) : 0;
+		if (len < (size_t)last * ctx->sector_size) len = (size_t)last * ctx->sector_size;
+	}
+	if (clean) {
+		if (sim_os_disk_rdsect (uptr, slot->base, ctx->wc_fill, NULL, (uint32)len) != SCPE_OK) return SCPE_IOERR;
+		for (i = 0; i < nsect; i++) {
+			if (!slot->dirty[i]) memcpy (slot->data + i * ctx->sector_size, ctx->wc_fill + i * ctx->sector_size, ctx->sector_size);
+		}
+	}
+	if (fseek (uptr->fileref, slot->base, SEEK_SET)) return SCPE_IOERR;
+	if (fwrite (slot->data, 1, len, uptr->fileref) != len) return SCPE_IOERR;
+	if (slot->base + (t_offset)len > ctx->file_size) ctx->file_size = slot->base + len;
+	memset (slot->dirty, 0, nsect);
+	slot->base = -1;
+	return SCPE_OK;
+}
+
+static t_stat sim_disk_wc_flush (UNIT *uptr, struct disk_context *ctx) {
+	t_stat r = SCPE_OK;
+	uint32 i;
+	if ((ctx->wc == NULL) || !ctx->wc_dirty) return SCPE_OK;
+	if (sim_disk_jnl_sync (ctx) != SCPE_OK) return SCPE_IOERR;	/* journal first, then the image */
+	qsort (ctx->wc, ctx->wc_nslots, sizeof (struct disk_wc_slot), sim_disk_wc_cmp);
+	for (i = 0; (i < ctx->wc_nslots) && (ctx->wc[i].base != -1); i++) {
+		if (sim_disk_wc_writeback (uptr, ctx, &ctx->wc[i]) != SCPE_OK) {
+			printf("ERROR: write back of disk block at %d failed\n", (int)ctx->wc[i].base);
+			r = SCPE_IOERR;
+		}
+	}
+	fflush (uptr->fileref);
+	ctx->wc_dirty = (r != SCPE_OK);						/* failed blocks are still dirty */
+	return r;
+}
+
+static t_stat sim_disk_wc_write (UNIT *uptr, struct disk_context *ctx, t_offset da, const uint8 *buf, uint32 tbc) {
+	t_stat r = SCPE_OK;
+	struct disk_wc_slot *slot;
+	uint32 i, off, n;
+	t_offset base;
+
+	if (!ctx->wc_dirty) {
+		ctx->wc_dirty = TRUE;
+		ctx->wc_first_dirty = sim_os_msec ();
+	}
+	while (tbc) {
+		base = da - (da % ctx->wc_block);
+		off = (uint32)(da - base);
+		n = ctx->wc_block - off;
+		if (n > tbc) n = tbc;
+		slot = NULL;
+		for (i = 0; i < ctx->wc_nslots; i++) {
+			if (ctx->wc[i].base == base) {
+				slot = &ctx->wc[i];
+				break;
+			}
+			if ((slot == NULL) && (ctx->wc[i].base == -1)) slot = &ctx->wc[i];
+		}
+		if (slot == NULL) {								/* out of buffers: flush the lot */
+			r = sim_disk_wc_flush (uptr, ctx);
+			ctx->wc_dirty = TRUE;
+			ctx->wc_first_dirty = sim_os_msec ();
+			for (i = 0; i < ctx->wc_nslots; i++) {		/* blocks that failed to write back stay put */
+				if (ctx->wc[i].base == -1) {
+					slot = &ctx->wc[i];
+					break;
+				}
+			}
+			if (slot == NULL) return SCPE_IOERR;
+		}
+		slot->base = base;
+		memcpy (slot->data + off, buf, n);
+		memset (slot->dirty + off / ctx->sector_size, 1, n / ctx->sector_size);
+		da += n;
+		buf += n;
+		tbc -= n;
+	}
+	if ((sim_os_msec () - ctx->wc_first_dirty) >= sim_disk_wc_interval) {
+		if (sim_disk_wc_flush (uptr, ctx) != SCPE_OK) r = SCPE_IOERR;
+	}
+	return r;
+}
+
+/* Copy sectors that are still sitting in the coalescing buffers over data just
+   read from the image. */
+
+static void sim_disk_wc_overlay (struct disk_context *ctx, t_offset da, uint8 *buf, uint32 tbc) {
+	uint32 i, s, nsect = ctx->wc_block / ctx->sector_size;
+	if (!ctx->wc_dirty) return;
+	for (i = 0; i < ctx->wc_nslots; i++) {
+		struct disk_wc_slot *slot = &ctx->wc[i];
+		if ((slot->base == -1) || (slot->base >= da + tbc) || (slot->base + ctx->wc_block <= da)) continue;
+		for (s = 0; s < nsect; s++) {
+			t_offset sa = slot->base + (t_offset)s * ctx->sector_size;
+			if (slot->dirty[s] && (sa >= da) && (sa < da + tbc)) {
+				memcpy (buf + (sa - da), slot->data + s * ctx->sector_size, ctx->sector_size);
+			}
+		}
+	}
+}
+
+/* Write-ahead journal. Every guest write is appended to a journal file next to
+   the image (rq.dsk -> rq.jnl) before the data goes anywhere else, and the journal
+   is fsync()ed before anything in the image is overwritten: before the coalescing
+   buffers are written back, or before each write when writing through. FATFS only
+   makes data durable on f_sync, so without that a power cut could leave torn
+   blocks in the image that the journal can't repair. Once the image has been
+   synced the journal is emptied again (a checkpoint). After a power cut, attach
+   replays the journal up to the last intact record, so the image always ends up
+   in a state the guest actually wrote. */
+
+#define DK_JNL_MAGIC    0x4C4E4A44          /* 'DJNL' */
+
+struct disk_jnl_hdr {
+    uint32              magic;
+    uint32              lba;                /* first sector */
+    uint32              sects;              /* sectors of data following the header */
+    uint32              sum;                /* checksum over lba, sects and data */
+    };
+
+/* Build the name of a file that lives beside the image, e.g. rq.dsk -> rq.jnl.
+   The SD card is mounted without long file name support, so the extension is
+   replaced rather than appended to. */
+
+static void sim_disk_sidecar_name (const char *image, const char *ext, char *name, size_t size) {
+	const char *slash = strrchr (image, '/');
+	const char *dot = strrchr (image, '.');
+	size_t len = (dot && (!slash || dot > slash)) ? (size_t)(dot - image) : strlen (image);
+	if (len > size - strlen (ext) - 2) len = size - strlen (ext) - 2;
+	memcpy (name, image, len);
+	sprintf (name + len, ".%s", ext);
+}
+
+static uint32 sim_disk_jnl_sum (uint32 sum, const uint8 *data, size_t len) {
+	while (len--) sum = ((sum << 5) + sum) ^ *data++;
+	return sum;
+}
+
+static uint32 sim_disk_jnl_hdr_sum (const struct disk_jnl_hdr *hdr, const uint8 *data, size_t len) {
+	uint32 sum = sim_disk_jnl_sum (5381, (const uint8 *)&hdr->lba, sizeof (hdr->lba));
+	sum = sim_disk_jnl_sum (sum, (const uint8 *)&hdr->sects, sizeof (hdr->sects));
+	return sim_disk_jnl_sum (sum, data, len);
+}
+
+/* Apply the intact prefix of an existing journal to the image. */
+
+static void sim_disk_jnl_replay (UNIT *uptr, struct disk_context *ctx, const char *name) {
+	struct disk_jnl_hdr hdr;
+	uint8 *data = NULL;
+	size_t len, alloced = 0;
+	uint32 recs = 0;
+	FILE *f = fopen (name, "rb");
+
+	if (f == NULL) return;
+	while (fread (&hdr, sizeof (hdr), 1, f) == 1) {
+		if ((hdr.magic != DK_JNL_MAGIC) || (hdr.sects == 0) || (hdr.sects > 0x10000)) break;
+		len = (size_t)hdr.sects * ctx->sector_size;
+		if (len > alloced) {
+			uint8 *n = (uint8 *)realloc (data, len);
+			if (n == NULL) break;
+			data = n;
+			alloced = len;
+		}
+		if (fread (data, 1, len, f) != len) break;				/* torn record */
+		if (sim_disk_jnl_hdr_sum (&hdr, data, len) != hdr.sum) break;
+		if (sim_os_disk_wrsect (uptr, (t_offset)hdr.lba * ctx->sector_size, data, NULL, (uint32)len) != SCPE_OK) break;
+		recs++;
+	}
+	free (data);
+	fclose (f);
+	if (recs) {
+		fflush (uptr->fileref);
+		fsync (fileno (uptr->fileref));
+		printf("sim_disk: replayed %d journal records from %s\n", (int)recs, name);
+	}
+}
+
+static t_stat sim_disk_jnl_open (UNIT *uptr, struct disk_context *ctx) {
+	char name[CBUFSIZE];
+	if (!sim_disk_journal) return SCPE_OK;
+	sim_disk_sidecar_name (uptr->filename, "jnl", name, sizeof (name));
+	sim_disk_jnl_replay (uptr, ctx, name);
+	ctx->jnl = fopen (name, "w+b");
+	if (ctx->jnl == NULL) {
+		printf("sim_disk: can't create journal %s, running without\n", name);
+		return SCPE_OPENERR;
+	}
+	ctx->jnl_size = 0;
+	return SCPE_OK;
+}
+
+/* Empty the journal. Only allowed once everything it holds is safely in the image. */
+
+static void sim_disk_jnl_reset (UNIT *uptr, struct disk_context *ctx) {
+	char name[CBUFSIZE];
+	if ((ctx->jnl == NULL) || (ctx->jnl_size == 0)) return;
+	sim_disk_sidecar_name (uptr->filename, "jnl", name, sizeof (name));
+	ctx->jnl = freopen (name, "w+b", ctx->jnl);
+	if (ctx->jnl == NULL) printf("sim_disk: can't reopen journal %s, running without\n", name);
+	ctx->jnl_size = 0;
+	ctx->jnl_unsynced = FALSE;
+}
+
+static t_stat sim_disk_jnl_append (struct disk_context *ctx, t_lba lba, const uint8 *buf, t_seccnt sects) {
+	struct disk_jnl_hdr hdr;
+	size_t len = (size_t)sects * ctx->sector_size;
+	hdr.magic = DK_JNL_MAGIC;
+	hdr.lba = lba;
+	hdr.sects = sects;
+	hdr.sum = sim_disk_jnl_hdr_sum (&hdr, buf, len);
+	if ((fwrite (&hdr, sizeof (hdr), 1, ctx->jnl) != 1) || (fwrite (buf, 1, len, ctx->jnl) != len)) return SCPE_IOERR;
+	if (fflush (ctx->jnl) != 0) return SCPE_IOERR;
+	ctx->jnl_size += sizeof (hdr) + len;
+	ctx->jnl_unsynced = TRUE;
+	return SCPE_OK;
+}
+
+/* Make the records appended so far durable. */
+
+static t_stat sim_disk_jnl_sync (struct disk_context *ctx) {
+	if ((ctx->jnl == NULL) || !ctx->jnl_unsynced) return SCPE_OK;
+	if (fflush (ctx->jnl) != 0) return SCPE_IOERR;
+	if (fsync (fileno (ctx->jnl)) != 0) return SCPE_IOERR;
+	ctx->jnl_unsynced = FALSE;
+	return SCPE_OK;
+}
+
+/* Get everything into the image, sync it and empty the journal. */
+
+static t_stat sim_disk_checkpoint (UNIT *uptr, struct disk_context *ctx) {
+	t_stat r = sim_disk_wc_flush (uptr, ctx);
+	if ((r != SCPE_OK) || (ctx->jnl == NULL) || (ctx->jnl_size == 0)) return r;
+	if (fflush (uptr->fileref) != 0) return SCPE_IOERR;
+	fsync (fileno (uptr->fileref));
+	sim_disk_jnl_reset (uptr, ctx);
+	return SCPE_OK;
+}
+
+/* Request tracing. When enabled, every read, write and flush is logged to a
+   binary trace (see struct sim_disk_trace_rec) so storage strategies can be
+   compared offline with hostbuild/disk_replay instead of booting the guest. */
+
+static FILE *sim_disk_trace_file = NULL;
+static t_uint64 sim_disk_trace_start;
+
+static t_uint64 sim_disk_wall_usec (void) {
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return (t_uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void sim_disk_trace_open (void) {
+	struct sim_disk_trace_hdr hdr;
+	const char *path = sim_disk_trace_path;
+#ifndef ESP_PLATFORM
+	if (path == NULL) path = getenv ("ESPPDP_DISK_TRACE");
+#endif
+	if ((path == NULL) || (sim_disk_trace_file != NULL)) return;
+	sim_disk_trace_file = fopen (path, "wb");
+	if (sim_disk_trace_file == NULL) {
+		printf("sim_disk: can't create trace file %s\n", path);
+		return;
+	}
+	hdr.magic = DK_TRACE_MAGIC;
+	hdr.version = DK_TRACE_VERSION;
+	hdr.rec_size = sizeof (struct sim_disk_trace_rec);
+	fwrite (&hdr, sizeof (hdr), 1, sim_disk_trace_file);
+	sim_disk_trace_start = sim_disk_wall_usec ();
+	printf("sim_disk: tracing requests to %s\n", path);
+}
+
+static void sim_disk_trace (UNIT *uptr, struct disk_context *ctx, int op, t_lba lba, t_seccnt sects) {
+	struct sim_disk_trace_rec rec;
+	if (sim_disk_trace_file == NULL) return;
+	rec.lba = lba;
+	rec.sects = (uint16)sects;
+	rec.unit = (uint8)(uptr - ctx->dptr->units);
+	rec.op = (uint8)op;
+	rec.vtime = (t_uint64)sim_gtime ();
+	rec.wtime = sim_disk_wall_usec () - sim_disk_trace_start;
+	fwrite (&rec, sizeof (rec), 1, sim_disk_trace_file);
+}
+
+/* Boot prefetch. Booting reads the same few thousand blocks in the same order
+   every time. On the first boot of an image the read requests are recorded (up
+   to sim_disk_prefetch_kb worth of data, within the first DK_PF_WINDOW msec) and
+   saved beside the image (rq.dsk -> rq.bpf). On later boots a thread reads those
+   extents into memory in that order while the guest still sits in the boot
+   loader, and matching reads are served from there. Mapped host images just get
+   a MADV_WILLNEED per extent instead. Delete the profile to make it re-learn. */
+
+#define DK_PF_MAGIC     0x46504244          /* 'DBPF' */
+#define DK_PF_WINDOW    (300*1000)          /* msec after attach that counts as booting */
+
+#define DK_PF_EMPTY     0                   /* not read yet */
+#define DK_PF_LOADING   1                   /* being read by the prefetch thread */
+#define DK_PF_READY     2                   /* data in pool */
+#define DK_PF_INVALID   3                   /* written by the guest since; don't use */
+
+struct disk_pf_extent {
+    t_lba               lba;                /* first sector */
+    uint32              sects;              /* sector count */
+    uint32              offset;             /* position of the data in pool */
+    uint32              state;              /* DK_PF_xxx */
+    };
+
+struct disk_pf {
+    struct disk_pf_extent *ext;             /* extents in boot order */
+    uint32              count;              /* extents in use */
+    uint32              alloced;            /* extents allocated */
+    uint32              bytes;              /* data covered by the extents */
+    uint32              hint;               /* extent the next read most likely hits */
+    uint32              served;             /* extents handed to the guest */
+    t_bool              recording;          /* learning a profile instead of prefetching */
+    uint32              start;              /* sim_os_msec() at attach */
+    uint8               *pool;              /* prefetched data */
+    FILE                *f;                 /* image, opened separately for the thread */
+    t_bool              thread_started;
+    volatile t_bool     stop;               /* ask the thread to quit */
+    pthread_t           thread;
+    pthread_mutex_t     lock;               /* protects extent states */
+    };
+
+static void *sim_disk_pf_thread (void *arg) {
+	struct disk_context *ctx = (struct disk_context *)arg;
+	struct disk_pf *pf = ctx->pf;
+	uint32 i;
+
+	for (i = 0; (i < pf->count) && !pf->stop; i++) {
+		struct disk_pf_extent *e = &pf->ext[i];
+		size_t len = (size_t)e->sects * ctx->sector_size, got = 0;
+		pthread_mutex_lock (&pf->lock);
+		if (e->state != DK_PF_EMPTY) {
+			pthread_mutex_unlock (&pf->lock);
+			continue;
+		}
+		e->state = DK_PF_LOADING;
+		pthread_mutex_unlock (&pf->lock);
+		if (fseek (pf->f, (t_offset)e->lba * ctx->sector_size, SEEK_SET) == 0)
+			got = fread (pf->pool + e->offset, 1, len, pf->f);
+		pthread_mutex_lock (&pf->lock);
+		if (e->state == DK_PF_LOADING) e->state = (got == len) ? DK_PF_READY : DK_PF_INVALID;
+		pthread_mutex_unlock (&pf->lock);
+	}
+	return NULL;
+}
+
+static void sim_disk_pf_free (struct disk_context *ctx) {
+	struct disk_pf *pf = ctx->pf;
+	if (pf == NULL) return;
+	if (pf->thread_started) {
+		pf->stop = TRUE;
+		pthread_join (pf->thread, NULL);
+		pthread_mutex_destroy (&pf->lock);
+	}
+	if (pf->f) fclose (pf->f);
+	free (pf->pool);
+	free (pf->ext);
+	free (pf);
+	ctx->pf = NULL;
+}
+
+static void sim_disk_pf_save (UNIT *uptr, struct disk_context *ctx) {
+	struct disk_pf *pf = ctx->pf;
+	char name[CBUFSIZE];
+	uint32 hdr[2], i;
+	FILE *f;
+
+	sim_disk_sidecar_name (uptr->filename, "bpf", name, sizeof (name));
+	f = fopen (name, "wb");
+	if (f == NULL) return;
+	hdr[0] = DK_PF_MAGIC;
+	hdr[1] = pf->count;
+	fwrite (hdr, sizeof (hdr), 1, f);
+	for (i = 0; i < pf->count; i++) {
+		uint32 rec[2] = { pf->ext[i].lba, pf->ext[i].sects };
+		fwrite (rec, sizeof (rec), 1, f);
+	}
+	fclose (f);
+	printf("sim_disk: saved boot profile of %d extents (%d KB) to %s\n", (int)pf->count, (int)(pf->bytes / 1024), name);
+}
+
+static void sim_disk_pf_open (UNIT *uptr, struct disk_context *ctx) {
+	struct disk_pf *pf;
+	char name[CBUFSIZE];
+	uint32 hdr[2], rec[2], i;
+	size_t limit = (size_t)sim_disk_prefetch_kb * 1024;
+	FILE *f;
+
+	if (sim_disk_prefetch_kb == 0) return;
+	pf = ctx->pf = (struct disk_pf *)calloc (1, sizeof (struct disk_pf));
+	if (pf == NULL) return;
+	pf->start = sim_os_msec ();
+	sim_disk_sidecar_name (uptr->filename, "bpf", name, sizeof (name));
+	f = fopen (name, "rb");
+	if ((f == NULL) || (fread (hdr, sizeof (hdr), 1, f) != 1) || (hdr[0] != DK_PF_MAGIC)) {
+		if (f) fclose (f);
+		pf->recording = TRUE;					/* no (usable) profile yet: learn one */
+		return;
+	}
+	pf->ext = (struct disk_pf_extent *)calloc (hdr[1], sizeof (struct disk_pf_extent));
+	if (pf->ext == NULL) hdr[1] = 0;
+#ifdef ESP_PLATFORM
+	//Whatever the guest memory, write buffers and packet buffers left over; keep half of
+	//it for everything else.
+	if (limit > heap_caps_get_largest_free_block (MALLOC_CAP_8BIT) / 2) {
+		limit = heap_caps_get_largest_free_block (MALLOC_CAP_8BIT) / 2;
+		printf("sim_disk: only %d KB free for boot prefetch\n", (int)(limit / 1024));
+	}
+#endif
+	for (i = 0; (i < hdr[1]) && (fread (rec, sizeof (rec), 1, f) == 1); i++) {
+		if (pf->bytes + rec[1] * ctx->sector_size > limit) break;
+		pf->ext[i].lba = rec[0];
+		pf->ext[i].sects = rec[1];
+		pf->ext[i].offset = pf->bytes;
+		pf->bytes += rec[1] * ctx->sector_size;
+	}
+	pf->count = i;
+	fclose (f);
+#if SIM_DISK_MMAP
+	if (ctx->map) {
+		for (i = 0; i < pf->count; i++) {
+			size_t pg = (size_t)sysconf (_SC_PAGESIZE);
+			t_offset da = (t_offset)pf->ext[i].lba * ctx->sector_size;
+			t_offset end = da + (t_offset)pf->ext[i].sects * ctx->sector_size;
+			da &= ~(t_offset)(pg - 1);
+			if (end > ctx->map_size) end = ctx->map_size;
+			if (da < end) madvise (ctx->map + da, end - da, MADV_WILLNEED);
+		}
+		sim_disk_pf_free (ctx);
+		return;
+	}
+#endif
+	pf->pool = (uint8 *)malloc (pf->bytes ? pf->bytes : 1);
+	if (pf->pool == NULL) printf("sim_disk: no memory for %d KB of boot prefetch, not prefetching\n", (int)(pf->bytes / 1024));
+	pf->f = fopen (uptr->filename, "rb");
+	if ((pf->count == 0) || (pf->pool == NULL) || (pf->f == NULL) || (pthread_mutex_init (&pf->lock, NULL) != 0)) {
+		sim_disk_pf_free (ctx);
+		return;
+	}
+	if (pthread_create (&pf->thread, NULL, sim_disk_pf_thread, ctx) != 0) {
+		pthread_mutex_destroy (&pf->lock);
+		sim_disk_pf_free (ctx);
+		return;
+	}
+	pf->thread_started = TRUE;
+	printf("sim_disk: prefetching %d KB of boot blocks from %s\n", (int)(pf->bytes / 1024), name);
+}
+
+/* Learning: remember a read request, merging it with the previous extent if it
+   continues it. */
+
+static void sim_disk_pf_record (UNIT *uptr, struct disk_context *ctx, t_lba lba, t_seccnt sects) {
+	struct disk_pf *pf = ctx->pf;
+	struct disk_pf_extent *e = pf->count ? &pf->ext[pf->count - 1] : NULL;
+
+	if ((pf->bytes + sects * ctx->sector_size > sim_disk_prefetch_kb * 1024) ||
+			((sim_os_msec () - pf->start) > DK_PF_WINDOW)) {
+		sim_disk_pf_save (uptr, ctx);			/* boot is over */
+		sim_disk_pf_free (ctx);
+		return;
+	}
+	pf->bytes += sects * ctx->sector_size;
+	if (e && (e->lba + e->sects == lba)) {
+		e->sects += sects;
+		return;
+	}
+	if (pf->count == pf->alloced) {
+		uint32 n = pf->alloced ? pf->alloced * 2 : 256;
+		struct disk_pf_extent *ne = (struct disk_pf_extent *)realloc (pf->ext, n * sizeof (struct disk_pf_extent));
+		if (ne == NULL) return;
+		pf->ext = ne;
+		pf->alloced = n;
+	}
+	e = &pf->ext[pf->count++];
+	e->lba = lba;
+	e->sects = sects;
+}
+
+/* Prefetching: serve a read from the pool if an extent holds all of it. */
+
+static t_bool sim_disk_pf_read (struct disk_context *ctx, t_lba lba, uint8 *buf, t_seccnt sects) {
+	struct disk_pf *pf = ctx->pf;
+	uint32 i, n;
+	t_bool hit = FALSE;
+
+	pthread_mutex_lock (&pf->lock);
+	for (n = 0, i = pf->hint; n < pf->count; n++, i = (i + 1 == pf->count) ? 0 : i + 1) {
+		struct disk_pf_extent *e = &pf->ext[i];
+		if ((lba < e->lba) || (lba + sects > e->lba + e->sects)) continue;
+		if (e->state != DK_PF_READY) break;
+		memcpy (buf, pf->pool + e->offset + (lba - e->lba) * ctx->sector_size, sects * ctx->sector_size);
+		if (lba + sects == e->lba + e->sects) {
+			pf->served++;
+			pf->hint = (i + 1 == pf->count) ? 0 : i + 1;
+		} else {
+			pf->hint = i;
+		}
+		hit = TRUE;
+		break;
+	}
+	pthread_mutex_unlock (&pf->lock);
+	return hit;
+}
+
+/* A guest write makes prefetched copies of those sectors stale. */
+
+static void sim_disk_pf_invalidate (struct disk_context *ctx, t_lba lba, t_seccnt sects) {
+	struct disk_pf *pf = ctx->pf;
+	uint32 i;
+
+	if (pf->recording) return;
+	pthread_mutex_lock (&pf->lock);
+	for (i = 0; i < pf->count; i++) {
+		struct disk_pf_extent *e = &pf->ext[i];
+		if ((lba < e->lba + e->sects) && (e->lba < lba + sects)) e->state = DK_PF_INVALID;
+	}
+	pthread_mutex_unlock (&pf->lock);
+}
+
+/* Called from sim_disk_tick: drop the pool once booting is over. */
+
+static void sim_disk_pf_tick (UNIT *uptr, struct disk_context *ctx) {
+	struct disk_pf *pf = ctx->pf;
+	if ((sim_os_msec () - pf->start) <= DK_PF_WINDOW) {
+		if (pf->recording || (pf->served < pf->count)) return;
+	}
+	if (pf->recording) sim_disk_pf_save (uptr, ctx);
+	sim_disk_pf_free (ctx);
+}
+
 /* Read Sectors */
 
-t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects) {
-	t_offset da;
-	uint32 err, tbc;
+static t_stat sim_os_disk_rdsect (UNIT *uptr, t_offset da, uint8 *buf, t_seccnt *sectsread, uint32 tbc) {
+	uint32 err;
 	size_t i;
 	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-//	printf("sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
-
-	da = ((t_offset)lba) * ctx->sector_size;
-	tbc = sects * ctx->sector_size;
-	if (sectsread) *sectsread = 0;
 
 	while (tbc) {
 		size_t sectbytes;
@@ -209,6 +969,46 @@ t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread,
 	return SCPE_OK;
 }
 
+t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects) {
+	t_offset da;
+	uint32 tbc;
+	t_stat r;
+	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+//	printf("sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+
+	da = ((t_offset)lba) * ctx->sector_size;
+	tbc = sects * ctx->sector_size;
+	if (sectsread) *sectsread = 0;
+	sim_disk_trace (uptr, ctx, DK_TRACE_RD, lba, sects);
+	if (ctx->pf && ctx->pf->recording) sim_disk_pf_record (uptr, ctx, lba, sects);
+
+#if SIM_DISK_MMAP
+	if (ctx->map) {
+		size_t i;
+		sim_disk_mmap_advise (ctx, lba, sects);
+		i = (da >= ctx->map_size) ? 0 : ctx->map_size - (size_t)da;
+		if (i > tbc) i = tbc;
+		memcpy (buf, ctx->map + da, i);
+		if (sectsread) *sectsread = i / ctx->sector_size;
+		if (i == tbc) return SCPE_OK;
+		//Writes past the mapping grew the image through stdio; read that part the same way.
+		return sim_os_disk_rdsect (uptr, da + i, buf + i, sectsread, tbc - (uint32)i);
+	}
+#endif
+
+	if (ctx->pf && !ctx->pf->recording && sim_disk_pf_read (ctx, lba, buf, sects)) {
+		if (sectsread) *sectsread = sects;
+		r = SCPE_OK;
+	} else {
+		r = sim_os_disk_rdsect (uptr, da, buf, sectsread, tbc);
+	}
+	if ((r == SCPE_OK) && ctx->wc) {
+		sim_disk_wc_overlay (ctx, da, buf, tbc);
+		if (sectsread) *sectsread = sects;
+	}
+	return r;
+}
+
 t_stat sim_disk_rdsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, DISK_PCALLBACK callback) {
 	t_stat r=sim_disk_rdsect(uptr, lba, buf, sectsread, sects);
 	callback(uptr, r);
@@ -217,17 +1017,11 @@ t_stat sim_disk_rdsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread
 
 /* Write Sectors */
 
-t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects) {
-	t_offset da;
-	uint32 err, tbc;
+static t_stat sim_os_disk_wrsect (UNIT *uptr, t_offset da, uint8 *buf, t_seccnt *sectswritten, uint32 tbc) {
+	uint32 err;
 	size_t i;
 	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-//	printf("_sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
-	
-	da = ((t_offset)lba) * ctx->sector_size;
-	tbc = sects * ctx->sector_size;
-	if (sectswritten) *sectswritten = 0;
 	err = fseek(uptr->fileref, da, SEEK_SET);          /* set pos */
 	if (err) return SCPE_IOERR;
 	i = fwrite(buf, ctx->xfer_element_size, tbc/ctx->xfer_element_size, uptr->fileref);
@@ -236,17 +1030,131 @@ t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritte
 	}
 	err = ferror (uptr->fileref);
 	if (err) return SCPE_IOERR;
+	if (da + tbc > ctx->file_size) ctx->file_size = da + tbc;
+#if SIM_DISK_MMAP
+	if (ctx->map) fflush (uptr->fileref);		/* keep the mapping coherent */
+#endif
 	return SCPE_OK;
 }
 
+t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects) {
+	t_offset da;
+	uint32 tbc;
+	t_stat r;
+	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+//	printf("_sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+	
+	da = ((t_offset)lba) * ctx->sector_size;
+	tbc = sects * ctx->sector_size;
+	if (sectswritten) *sectswritten = 0;
+	sim_disk_trace (uptr, ctx, DK_TRACE_WR, lba, sects);
+	if (ctx->pf) sim_disk_pf_invalidate (ctx, lba, sects);
+#if SIM_DISK_MMAP
+	//Writes past the end of the mapping (growing the image) go through stdio below.
+	if (ctx->map && (da + tbc <= ctx->map_size)) {
+		memcpy (ctx->map + da, buf, tbc);
+		if (sectswritten) *sectswritten = sects;
+		ctx->dirty = TRUE;
+		if ((sim_disk_msync_policy == DK_MSYNC_PERIODIC) &&
+				((sim_os_msec () - ctx->last_sync) >= sim_disk_msync_interval)) {
+			sim_disk_mmap_sync (ctx, MS_ASYNC);
+		}
+		return SCPE_OK;
+	}
+#endif
+	//The journal record goes in before the data, and the journal is synced before
+	//the image is touched (here when writing through, in sim_disk_wc_flush otherwise).
+	if (ctx->jnl) {
+		if (ctx->jnl_size == 0) ctx->jnl_first = sim_os_msec ();
+		r = sim_disk_jnl_append (ctx, lba, buf, sects);
+		if ((r == SCPE_OK) && (ctx->wc == NULL)) r = sim_disk_jnl_sync (ctx);
+		if (r != SCPE_OK) return r;
+	}
+	if (ctx->wc) {
+		if (sectswritten) *sectswritten = sects;
+		r = sim_disk_wc_write (uptr, ctx, da, buf, tbc);
+	} else {
+		r = sim_os_disk_wrsect (uptr, da, buf, sectswritten, tbc);
+	}
+	//Only checkpoint once the data is in the buffers or the image, or emptying the
+	//journal would throw this record away.
+	if ((r == SCPE_OK) && ctx->jnl && (ctx->jnl_size >= sim_disk_journal_max)) r = sim_disk_checkpoint (uptr, ctx);
+	return r;
+}
+
 t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback) {
 	t_stat r=sim_disk_wrsect(uptr, lba, buf, sectswritten, sects);
 	callback(uptr, r);
 	return SCPE_OK;
 }
 
+/* Flush written sectors to stable storage. This is the barrier for the guest's
+   synchronous writes (MSCP FLUSH): with a journal, syncing the journal is enough;
+   otherwise anything still in the coalescing buffers is written out and the
+   image is synced. On the host the msync policy decides
+   whether a mapped image is synced right away or only on detach. */
+
+t_stat sim_disk_flush (UNIT *uptr) {
+	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+	t_stat r;
+	if (!(uptr->flags & UNIT_ATT) || (ctx == NULL)) return SCPE_UNATT;
+	sim_disk_trace (uptr, ctx, DK_TRACE_FLUSH, 0, 0);
+#if SIM_DISK_MMAP
+	if (ctx->map) {
+		if (sim_disk_msync_policy != DK_MSYNC_DETACH) sim_disk_mmap_sync (ctx, MS_SYNC);
+		return SCPE_OK;
+	}
+#endif
+	if (ctx->jnl) return sim_disk_jnl_sync (ctx);			/* journal makes the writes durable */
+	r = sim_disk_wc_flush (uptr, ctx);
+	if (fflush (uptr->fileref) != 0) return SCPE_IOERR;
+	fsync (fileno (uptr->fileref));
+	return r;
+}
+
+/* Periodic housekeeping, called by the controller about once a second: write
+   back coalesced data, checkpoint the journal and msync mapped images that have
+   been dirty for too long even if the guest has stopped writing. */
+
+t_stat sim_disk_tick (UNIT *uptr) {
+	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+	if (!(uptr->flags & UNIT_ATT) || (ctx == NULL)) return SCPE_OK;
+	if (sim_disk_trace_file) fflush (sim_disk_trace_file);
+	if (ctx->pf) sim_disk_pf_tick (uptr, ctx);
+#if SIM_DISK_MMAP
+	if (ctx->map && ctx->dirty && (sim_disk_msync_policy == DK_MSYNC_PERIODIC) &&
+			((sim_os_msec () - ctx->last_sync) >= sim_disk_msync_interval)) {
+		sim_disk_mmap_sync (ctx, MS_ASYNC);
+	}
+#endif
+	if (ctx->jnl && ctx->jnl_size && ((sim_os_msec () - ctx->jnl_first) >= sim_disk_wc_interval))
+		return sim_disk_checkpoint (uptr, ctx);
+	if (ctx->wc_dirty && ((sim_os_msec () - ctx->wc_first_dirty) >= sim_disk_wc_interval))
+		return sim_disk_wc_flush (uptr, ctx);
+	return SCPE_OK;
+}
+
+/* Write everything back and release the buffers, mapping and journal. */
+
+static void sim_disk_close_ctx (UNIT *uptr, struct disk_context *ctx) {
+	sim_disk_checkpoint (uptr, ctx);
+	if (sim_disk_trace_file) fflush (sim_disk_trace_file);
+	if (ctx->pf && ctx->pf->recording) sim_disk_pf_save (uptr, ctx);
+	sim_disk_pf_free (ctx);
+	sim_disk_wc_close (ctx);
+	if (ctx->jnl) {
+		fclose (ctx->jnl);
+		ctx->jnl = NULL;
+	}
+#if SIM_DISK_MMAP
+	sim_disk_mmap_close (ctx);
+#endif
+}
+
 t_stat sim_disk_unload (UNIT *uptr) {
 	struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+	if (ctx) sim_disk_close_ctx (uptr, ctx);
 	fclose(uptr->fileref);  /* remove/eject disk */
 	return SCPE_OK;
 }
@@ -290,7 +1198,18 @@ t_stat sim_disk_attach_ex (UNIT *uptr, const char *cptr, size_t sector_size, siz
     uptr->fileref = fopen(cptr, "rb+");                 /* open r/w */
     if (uptr->fileref == NULL) return SCPE_OPENERR;
 	fseek(uptr->fileref, 0, SEEK_END);
-	ctx->container_size=ftell(uptr->fileref)/sector_size;
+	ctx->file_size=ftell(uptr->fileref);
+	ctx->container_size=ctx->file_size/sector_size;
+	sim_disk_trace_open ();
+#if SIM_DISK_MMAP
+	if (sim_disk_mmap) sim_disk_mmap_open (uptr, ctx, ctx->file_size);
+	if (ctx->map == NULL)
+#endif
+	{
+		sim_disk_jnl_open (uptr, ctx);
+		sim_disk_wc_open (ctx);
+	}
+	sim_disk_pf_open (uptr, ctx);
 
 	uptr->flags |= UNIT_ATT;
 	uptr->pos = 0;
@@ -316,15 +1235,16 @@ t_stat sim_disk_detach (UNIT *uptr) {
 	if (!(uptr->flags & UNIT_ATT)) return SCPE_OK;
 	if (NULL == find_dev_from_unit (uptr)) return SCPE_OK;
 
+	sim_disk_close_ctx (uptr, ctx);
 	uptr->flags &= ~(UNIT_ATT | UNIT_RO);
 	uptr->dynflags &= ~(UNIT_NO_FIO | UNIT_DISK_CHK);
 	free(uptr->filename);
 	uptr->filename = NULL;
+	fclose(uptr->fileref);
 	uptr->fileref = NULL;
 	free(uptr->disk_ctx);
 	uptr->disk_ctx = NULL;
 	uptr->io_flush = NULL;
-	fclose(uptr->fileref);
 
 	return SCPE_OK;
 }
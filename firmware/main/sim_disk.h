@@ -64,6 +64,56 @@ typedef uint32          t_lba;                          /* disk logical block ad
 
 #define DKSE_OK         0                               /* no error */
 
+/* msync() policies for memory-mapped images (host build only) */
+
+#define DK_MSYNC_DETACH     0                           /* only on detach */
+#define DK_MSYNC_FLUSH      1                           /* on MSCP flush and detach */
+#define DK_MSYNC_PERIODIC   2                           /* every sim_disk_msync_interval msec, flush, detach */
+
+extern int32 sim_disk_msync_policy;
+extern uint32 sim_disk_msync_interval;
+
+/* Write coalescing and journalling (stdio-backed images, i.e. the SD card) */
+
+extern uint32 sim_disk_wc_block;
+extern uint32 sim_disk_wc_slots;
+extern uint32 sim_disk_wc_interval;
+extern t_bool sim_disk_journal;
+extern uint32 sim_disk_journal_max;
+#if defined(__linux__) && !defined(ESP_PLATFORM)
+extern t_bool sim_disk_mmap;
+#endif
+
+/* Request trace file format (native byte order). A sim_disk_trace_hdr is
+   followed by one sim_disk_trace_rec per request. */
+
+#define DK_TRACE_MAGIC      0x43525444                  /* 'DTRC' */
+#define DK_TRACE_VERSION    1
+#define DK_TRACE_RD         0
+#define DK_TRACE_WR         1
+#define DK_TRACE_FLUSH      2
+
+struct sim_disk_trace_hdr {
+    uint32              magic;
+    uint16              version;
+    uint16              rec_size;                       /* sizeof (struct sim_disk_trace_rec) */
+    };
+
+struct sim_disk_trace_rec {
+    uint32              lba;                            /* first sector */
+    uint16              sects;                          /* sector count */
+    uint8               unit;                           /* unit number on the controller */
+    uint8               op;                             /* DK_TRACE_xx */
+    t_uint64            vtime;                          /* simulated time (instructions) */
+    t_uint64            wtime;                          /* wall clock, usec since trace start */
+    };
+
+extern const char *sim_disk_trace_path;
+
+/* Boot prefetch */
+
+extern uint32 sim_disk_prefetch_kb;
+
 typedef void (*DISK_PCALLBACK)(UNIT *unit, t_stat status);
 
 /* Prototypes */
@@ -94,6 +144,8 @@ t_stat sim_disk_rdsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread
 t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects);
 t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback);
 t_stat sim_disk_unload (UNIT *uptr);
+t_stat sim_disk_flush (UNIT *uptr);
+t_stat sim_disk_tick (UNIT *uptr);
 t_stat sim_disk_set_fmt (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat sim_disk_show_fmt (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat sim_disk_set_capac (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
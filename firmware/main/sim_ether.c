@@ -383,9 +383,24 @@
 #include <unistd.h>
 #include "hexdump.h"
 #include "wifi_if.h"
+#include "chksum.h"
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
 
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
 
+/*
+Everything the PDP11 sends and receives can be written to a pcap file, for looking at
+afterwards. On the host the file is named by the ESPPDP_NET_CAPTURE environment variable.
+*/
+#ifdef CONFIG_ESPPDP_NET_CAPTURE
+#define ETH_CAPTURE_PATH "/sdcard/net.pcap"
+#else
+#define ETH_CAPTURE_PATH NULL
+#endif
+static wifi_if_pcap_t *eth_capture=NULL;
+
 
 /*============================================================================*/
 /*                  OS-independant ethernet routines                          */
@@ -410,72 +425,9 @@ void eth_mac_fmt(ETH_MAC* const mac, char* buff) {
   return;
 }
 
-static const uint32 crcTable[256] = {
-  0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
-  0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
-  0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
-  0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-  0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
-  0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
-  0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
-  0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-  0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
-  0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
-  0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
-  0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-  0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
-  0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
-  0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
-  0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-  0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
-  0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
-  0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
-  0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-  0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
-  0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
-  0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
-  0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-  0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
-  0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
-  0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
-  0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-  0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
-  0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
-  0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
-  0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-  0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
-  0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
-  0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
-  0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-  0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
-  0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
-  0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
-  0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-  0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
-  0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
-  0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-};
-
 uint32 eth_crc32(uint32 crc, const void* vbuf, size_t len)
 {
-  const uint32 mask = 0xFFFFFFFF;
-  const unsigned char* buf = (const unsigned char*)vbuf;
-
-  crc ^= mask;
-  while (len > 8) {
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-    len -= 8;
-  }
-  while (0 != len--)
-    crc = (crc >> 8) ^ crcTable[ (crc ^ (*buf++)) & 0xFF ];
-  return(crc ^ mask);
+  return chksum_crc32(crc, vbuf, len);
 }
 
 int eth_get_packet_crc32_data(const uint8 *msg, int len, uint8 *crcdata)
@@ -599,12 +551,23 @@ t_stat eth_open(ETH_DEV* dev, const char* name, DEVICE* dptr, uint32 dbit) {
 	dev->dbit = dbit;
 
 	wifi_if_open();
+
+	const char *capture=ETH_CAPTURE_PATH;
+#ifndef ESP_PLATFORM
+	if (capture==NULL) capture=getenv("ESPPDP_NET_CAPTURE");
+#endif
+	if (capture && !eth_capture) {
+		eth_capture=wifi_if_pcap_create(capture);
+		if (eth_capture) printf("Capturing network traffic to %s\n", capture);
+	}
 	return SCPE_OK;
 }
 
 t_stat eth_close (ETH_DEV* dev) {
 //	printf("eth_close\n");
 	wifi_if_close();
+	wifi_if_pcap_close(eth_capture);
+	eth_capture=NULL;
 	return SCPE_NOFNC;
 }
 t_stat eth_attach_help(FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, const char *cptr) {
@@ -622,12 +585,37 @@ t_stat eth_set_throttle (ETH_DEV* dev, uint32 time, uint32 burst, uint32 delay)
 	return SCPE_OK;
 }
 
+/*
+Asynchronous receive. There's no reader thread here, but the WiFi rx callback (or the host
+backend's thread) tells us when a frame arrives, and we pass that on as a wakeup for the
+first unit of the device the NIC is attached to, which is its receive service routine.
+It then runs within 'latency' instructions, instead of whenever its next poll comes up.
+*/
+static volatile int32 eth_wake_id=-1;
+
+static void eth_rx_notify() {
+	sim_wake(eth_wake_id);
+}
+
 t_stat eth_set_async (ETH_DEV *dev, int latency) {
-//	printf("eth_set_async\n");
+	int32 id=sim_wake_register(dev->dptr->units, latency);
+	if (id<0) return SCPE_NOFNC;
+	dev->asynch_io=1;
+	dev->asynch_io_latency=latency;
+	eth_wake_id=id;
+	wifi_if_set_rx_notify(eth_rx_notify);
+	//Frames may have come in while nobody was listening
+	sim_wake(id);
 	return SCPE_OK;
 }
+
 t_stat eth_clr_async (ETH_DEV *dev) {
-//	printf("eth_clr_async\n");
+	if (dev->asynch_io) {
+		wifi_if_set_rx_notify(NULL);
+		sim_wake_unregister(eth_wake_id);
+		eth_wake_id=-1;
+		dev->asynch_io=0;
+	}
 	return SCPE_OK;
 }
 
@@ -659,6 +647,7 @@ t_stat eth_write (ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine) {
 	}
 
 //	printf("eth_write\n");
+	wifi_if_pcap_frame(eth_capture, packet->msg, packet->len);
 	wifi_if_write(packet->msg, packet->len);
 	++dev->packets_sent;
 	
@@ -666,21 +655,115 @@ t_stat eth_write (ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine) {
 	return SCPE_OK;
 }
 
+/*
+Receive address filter, as set by the DEQNA setup frame (eth_filter) or the DELQA-T init
+block (eth_filter_hash). Frames the filter rejects are dropped here instead of being
+handed to the NIC, which would only DMA them into the guest and interrupt it for nothing.
+The WiFi rx path checks the filter from its own task, so it's kept in two copies: a new
+filter is built in the spare one and then switched to. rx_filter_gen is bumped before a
+copy gets written (making it odd) and again after switching over, so the copy in use is
+rx_filter[(gen>>1)&1]. A reader that sees the generation move on by more than one update
+while it was looking may have read a copy that was being rewritten, and looks again.
+It never has to wait for the writer.
+*/
+typedef struct {
+	int valid;
+	int addr_count;
+	ETH_MAC addr[ETH_FILTER_MAX];
+	ETH_BOOL all_multicast;
+	ETH_BOOL promiscuous;
+	ETH_BOOL hash_filter;
+	ETH_MULTIHASH hash;
+} eth_rx_filter_t;
+
+static eth_rx_filter_t rx_filter[2];
+static uint32 rx_filter_gen=0;
+static uint32 rx_filtered=0;
+
+//DELQA multicast hash: 6 bits of the AUTODIN II CRC of the address pick a bit in the table
+static int eth_hash_lookup(ETH_MULTIHASH hash, const uint8 *dst) {
+	int key=0x3f & (eth_crc32(0, dst, 6) >> 26);
+	key^=0x3f;
+	return hash[key>>3] & (1<<(key&0x7));
+}
+
+static int eth_filter_match(const eth_rx_filter_t *f, const uint8_t *dst) {
+	int i;
+	if (!f->valid || f->promiscuous) return 1;
+	for (i=0; i<f->addr_count; i++) {
+		if (memcmp(dst, f->addr[i], sizeof(ETH_MAC))==0) return 1;
+	}
+	if (dst[0]&1) { //multicast or broadcast
+		if (f->all_multicast) return 1;
+		if (f->hash_filter && eth_hash_lookup((uint8 *)f->hash, dst)) return 1;
+	}
+	return 0;
+}
+
+int eth_filter_accepts(const uint8_t *dst) {
+	uint32 gen, now;
+	int r;
+	do {
+		gen=__atomic_load_n(&rx_filter_gen, __ATOMIC_ACQUIRE);
+		r=eth_filter_match(&rx_filter[(gen>>1)&1], dst);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		now=__atomic_load_n(&rx_filter_gen, __ATOMIC_RELAXED);
+	} while (now-(gen&~1)>2); //our copy has been (or is being) rewritten
+	return r;
+}
+
+static void eth_set_rx_filter(ETH_DEV* dev, int addr_count, ETH_MAC* const addresses, ETH_BOOL all_multicast, ETH_BOOL promiscuous, ETH_MULTIHASH* const hash) {
+	uint32 gen=rx_filter_gen; //only ever written from here
+	eth_rx_filter_t *f=&rx_filter[((gen>>1)&1)^1];
+	if (addr_count>ETH_FILTER_MAX) addr_count=ETH_FILTER_MAX;
+	__atomic_store_n(&rx_filter_gen, gen+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(f, 0, sizeof(*f));
+	f->addr_count=addr_count;
+	memcpy(f->addr, addresses, addr_count*sizeof(ETH_MAC));
+	f->all_multicast=all_multicast;
+	f->promiscuous=promiscuous;
+	if (hash) {
+		f->hash_filter=1;
+		memcpy(f->hash, *hash, sizeof(ETH_MULTIHASH));
+	}
+	f->valid=1;
+	__atomic_store_n(&rx_filter_gen, gen+2, __ATOMIC_RELEASE);
+	//keep the device's copy up to date as well, for anything that looks at it
+	dev->addr_count=addr_count;
+	memcpy(dev->filter_address, addresses, addr_count*sizeof(ETH_MAC));
+	dev->all_multicast=all_multicast;
+	dev->promiscuous=promiscuous;
+	dev->hash_filter=f->hash_filter;
+	if (hash) memcpy(dev->hash, *hash, sizeof(ETH_MULTIHASH));
+}
+
 //returns 1 when successful read, 0 otherwise
 //calls routine with arg 0 when successful
+//The frame isn't copied: packet->pbuf takes over the reference to the receive buffer, and
+//ethq_insert passes it on to the NIC's read queue. If the NIC didn't queue the previous
+//frame (receiver off, handled locally), that reference is dropped here.
 int eth_read (ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine) {
 //	printf("eth_read\n");
 	dev->read_packet=packet;
 	dev->read_callback=routine;
-	int r=wifi_if_read(packet->msg, ETH_FRAME_SIZE);
-	if (r>0) {
+	pktbuf_t *pb;
+	pktbuf_unref(packet->pbuf);
+	packet->pbuf=NULL;
+	while ((pb=wifi_if_read_buf())!=NULL && !eth_filter_accepts(pb->data)) {
+		pktbuf_unref(pb);
+		rx_filtered++; //not for us, try the next one
+	}
+	if (pb) {
 		//Packets smaller than Ethernet allows will get padded to minimum size (otherwise they'd be
 		//detected as runt packets)
-		if (r<ETH_MIN_PACKET) {
-			memset(((uint8_t*)packet->msg)+r, 0, (ETH_MIN_PACKET-r));
-			r=ETH_MIN_PACKET;
+		if (pb->len<ETH_MIN_PACKET) {
+			memset(pb->data+pb->len, 0, (ETH_MIN_PACKET-pb->len));
+			pb->len=ETH_MIN_PACKET;
 		}
-		packet->len=r;
+		wifi_if_pcap_frame(eth_capture, pb->data, pb->len);
+		packet->pbuf=pb;
+		packet->len=pb->len;
 		if (routine) routine(0);
 		return 1;
 	} else {
@@ -688,13 +771,22 @@ int eth_read (ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine) {
 	}
 }
 
+//Copies a frame held by reference into the packet's own buffer, for code that wants to
+//modify a received frame in place.
+void eth_pack_unshare(ETH_PACK* pack) {
+	if (!pack->pbuf) return;
+	memcpy(pack->msg, pack->pbuf->data, (pack->len < sizeof(pack->msg)) ? pack->len : sizeof(pack->msg));
+	pktbuf_unref(pack->pbuf);
+	pack->pbuf=NULL;
+}
+
 t_stat eth_filter (ETH_DEV* dev, int addr_count, ETH_MAC* const addresses, ETH_BOOL all_multicast, ETH_BOOL promiscuous) {
-//	printf("eth_filter\n");
+	eth_set_rx_filter(dev, addr_count, addresses, all_multicast, promiscuous, NULL);
 	return SCPE_OK;
 }
 
 t_stat eth_filter_hash (ETH_DEV* dev, int addr_count, ETH_MAC* const addresses, ETH_BOOL all_multicast, ETH_BOOL promiscuous, ETH_MULTIHASH* const hash) {
-//	printf("eth_filter_hash\n");
+	eth_set_rx_filter(dev, addr_count, addresses, all_multicast, promiscuous, hash);
 	return SCPE_OK;
 }
 int _eth_devices (int max, ETH_LIST* dev) {
@@ -717,6 +809,7 @@ void ethq_remove(ETH_QUE* que) {
 	if (que->count) {
  		if (item->packet.oversize)
 			free (item->packet.oversize);
+		pktbuf_unref(item->packet.pbuf);
 		memset(item, 0, sizeof(struct eth_item));
 		if (++que->head == que->max)
 			que->head = 0;
@@ -724,7 +817,9 @@ void ethq_remove(ETH_QUE* que) {
   	}
 }
 
-void ethq_insert_data(ETH_QUE* que, int32 type, const uint8 *data, int used, size_t len, size_t crc_len, const uint8 *crc_data, int32 status) {
+//Claims the next tail item of the queue (the oldest one if the queue is full) and sets
+//its header fields
+static struct eth_item *ethq_new_item(ETH_QUE* que, int32 type, int used, size_t len, size_t crc_len, int32 status) {
 	struct eth_item* item;
 
 	/* if queue empty, set pointers to beginning */
@@ -747,10 +842,19 @@ void ethq_insert_data(ETH_QUE* que, int32 type, const uint8 *data, int used, siz
 
 	/* set information in (new) tail item */
 	item = &que->item[que->tail];
+	pktbuf_unref(item->packet.pbuf);
+	item->packet.pbuf = NULL;
 	item->type = type;
 	item->packet.len = len;
 	item->packet.used = used;
 	item->packet.crc_len = crc_len;
+	item->packet.status = status;
+	return item;
+}
+
+void ethq_insert_data(ETH_QUE* que, int32 type, const uint8 *data, int used, size_t len, size_t crc_len, const uint8 *crc_data, int32 status) {
+	struct eth_item* item = ethq_new_item(que, type, used, len, crc_len, status);
+
 	if (MAX (len, crc_len) <= sizeof (item->packet.msg)) {
 		memcpy(item->packet.msg, data, ((len > crc_len) ? len : crc_len));
 		if (crc_data && (crc_len > len)) memcpy(&item->packet.msg[len], crc_data, ETH_CRC_SIZE);
@@ -759,10 +863,16 @@ void ethq_insert_data(ETH_QUE* que, int32 type, const uint8 *data, int used, siz
 		memcpy(item->packet.oversize, data, ((len > crc_len) ? len : crc_len));
 		if (crc_data && (crc_len > len)) memcpy(&item->packet.oversize[len], crc_data, ETH_CRC_SIZE);
 	}
-	item->packet.status = status;
 }
 
 void ethq_insert(ETH_QUE* que, int32 type, ETH_PACK* pack, int32 status) {
+	if (pack->pbuf) {
+		//received frame: the queue takes over the buffer instead of a copy of it
+		struct eth_item* item = ethq_new_item(que, type, pack->used, pack->len, pack->crc_len, status);
+		item->packet.pbuf = pack->pbuf;
+		pack->pbuf = NULL;
+		return;
+	}
 	ethq_insert_data(que, type, pack->oversize ? pack->oversize : pack->msg, pack->used, pack->len, pack->crc_len, NULL, status);
 }
 
@@ -796,10 +906,12 @@ void ethq_clear(ETH_QUE* que) {
 	int i;
 
 	/* free up any extended packets */
-	for (i=0; i<que->max; ++i)
-	if (que->item[i].packet.oversize) {
-		free (que->item[i].packet.oversize);
-		que->item[i].packet.oversize = NULL;
+	for (i=0; i<que->max; ++i) {
+		if (que->item[i].packet.oversize) {
+			free (que->item[i].packet.oversize);
+			que->item[i].packet.oversize = NULL;
+		}
+		pktbuf_unref(que->item[i].packet.pbuf);
 	}
 	/* clear packet array */
 	memset(que->item, 0, sizeof(struct eth_item) * que->max);
@@ -808,5 +920,6 @@ void ethq_clear(ETH_QUE* que) {
 }
 
 t_stat eth_show (FILE* st, UNIT* uptr, int32 val, CONST void* desc){
+	fprintf(st, "Frames dropped by address filter: %u\n", rx_filtered);
 	return SCPE_OK;
 }
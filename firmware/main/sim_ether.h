@@ -67,6 +67,7 @@
 #define SIM_ETHER_H
 
 #include "sim_defs.h"
+#include "pktbuf.h"
 
 #ifdef  __cplusplus
 extern "C" {
@@ -210,12 +211,16 @@ extern "C" {
 struct eth_packet {
   uint8   msg[ETH_FRAME_SIZE];                          /* ethernet frame (message) */
   uint8   *oversize;                                    /* oversized frame (message) */
+  pktbuf_t *pbuf;                                       /* received frame, held by reference */
   uint32  len;                                          /* packet length without CRC */
   uint32  used;                                         /* bytes processed (used in packet chaining) */
   int     status;                                       /* transmit/receive status */
   uint32  crc_len;                                      /* packet length with CRC */
 };
 
+/* frame data of a packet, wherever it lives */
+#define ETH_PACK_DATA(p) ((p)->pbuf ? (uint8 *)(p)->pbuf->data : (p)->oversize ? (p)->oversize : (p)->msg)
+
 struct eth_item {
   int                 type;                             /* receive (0=setup, 1=loopback, 2=normal) */
 #define ETH_ITM_SETUP    0
@@ -311,9 +316,9 @@ struct eth_device {
   uint32        throttle_events;                        /* keeps track of packet arrival values */
   uint32        throttle_packet_time;                   /* time last packet was transmitted */
   uint32        throttle_count;                         /* Total Throttle Delays */
-#if defined (USE_READER_THREAD)
   int           asynch_io;                              /* Asynchronous Interrupt scheduling enabled */
   int           asynch_io_latency;                      /* instructions to delay pending interrupt */
+#if defined (USE_READER_THREAD)
   ETH_QUE       read_queue;
   pthread_mutex_t     lock;
   pthread_t     reader_thread;                          /* Reader Thread Id */
@@ -340,6 +345,7 @@ t_stat eth_write  (ETH_DEV* dev, ETH_PACK* packet,      /* write sychronous pack
                    ETH_PCALLBACK routine);              /*  callback when done */
 int eth_read      (ETH_DEV* dev, ETH_PACK* packet,      /* read single packet; */
                    ETH_PCALLBACK routine);              /*  callback when done*/
+void eth_pack_unshare (ETH_PACK* packet);               /* copy referenced frame into msg */
 t_stat eth_filter (ETH_DEV* dev, int addr_count,        /* set filter on incoming packets */
                    ETH_MAC* const addresses,
                    ETH_BOOL all_multicast,
@@ -453,3 +453,83 @@ for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next)
     cnt++;
 return cnt;
 }
+
+/* Wakeups from outside the simulator thread
+
+   The event queue may only be touched from the thread running the
+   simulator.  Code that runs elsewhere (the WiFi receive callback, the
+   network reader threads of the host build) and needs a unit serviced
+   calls sim_wake, which only sets a bit.  The CPU loop tests the bits
+   through AIO_CHECK_EVENT and activates the units that asked for it,
+   so a device can sleep until there is work instead of polling.
+
+        sim_wake_register       bind a unit to a wakeup id (simulator thread)
+        sim_wake_unregister     release a wakeup id (simulator thread)
+        sim_wake                request service (any thread)
+        sim_wake_process        activate the requested units (simulator thread)
+*/
+
+volatile uint32 sim_wake_pending = 0;
+
+static struct {
+    UNIT *uptr;
+    int32 latency;
+    } sim_wake_units[SIM_WAKE_MAX];
+
+int32 sim_wake_register (UNIT *uptr, int32 latency)
+{
+int32 id;
+
+for (id = 0; id < SIM_WAKE_MAX; id++) {
+    if (sim_wake_units[id].uptr == uptr)
+        break;
+    }
+if (id == SIM_WAKE_MAX) {
+    for (id = 0; id < SIM_WAKE_MAX; id++) {
+        if (sim_wake_units[id].uptr == NULL)
+            break;
+        }
+    }
+if (id == SIM_WAKE_MAX)
+    return -1;
+sim_wake_units[id].latency = latency;
+sim_wake_units[id].uptr = uptr;
+return id;
+}
+
+void sim_wake_unregister (int32 id)
+{
+if ((id < 0) || (id >= SIM_WAKE_MAX))
+    return;
+sim_wake_units[id].uptr = NULL;
+__atomic_and_fetch (&sim_wake_pending, ~(1u << id), __ATOMIC_RELAXED);
+}
+
+void sim_wake (int32 id)
+{
+if ((id < 0) || (id >= SIM_WAKE_MAX))
+    return;
+__atomic_or_fetch (&sim_wake_pending, 1u << id, __ATOMIC_RELEASE);
+}
+
+void sim_wake_process (void)
+{
+uint32 pending = __atomic_exchange_n (&sim_wake_pending, 0, __ATOMIC_ACQUIRE);
+int32 id;
+
+for (id = 0; pending; id++, pending >>= 1) {
+    UNIT *uptr = sim_wake_units[id].uptr;
+    int32 latency = sim_wake_units[id].latency;
+
+    if (!(pending & 1) || (uptr == NULL))
+        continue;
+    /* a unit that is already due soon enough is left alone; one that
+       is only queued for its fallback poll is pulled forward */
+    if (sim_is_active (uptr)) {
+        if (sim_activate_time (uptr) <= latency + 1)
+            continue;
+        sim_cancel (uptr);
+        }
+    sim_activate (uptr, latency);
+    }
+}
@@ -27,4 +27,9 @@ double sim_gtime (void);
 uint32 sim_grtime (void);
 int32 sim_qcount (void);
 
+#define SIM_WAKE_MAX    8                               /* units that can be woken by other threads */
+int32 sim_wake_register (UNIT *uptr, int32 latency);
+void sim_wake_unregister (int32 id);
+void sim_wake (int32 id);
+
 extern int sim_is_running;
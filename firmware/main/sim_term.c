@@ -38,7 +38,6 @@
 #include <stdio.h>
 #include <sys/select.h>
 #include <termios.h>
-#include <sys/ioctl.h>
 #include <unistd.h>
 
 #ifdef ESP_PLATFORM
@@ -69,13 +68,47 @@ t_stat sim_set_pchar (int32 flag, CONST char *cptr) {
 }
 
 
-t_stat sim_poll_kbd (void) {
+/*
+On the host, stdin is read by a thread of its own, in as big chunks as fit in the ring
+between it and sim_poll_kbd; polling the keyboard then is just looking in the ring, without
+a system call. When something comes in, the thread wakes up the console input unit, so
+typed characters don't wait for its next poll and piped input goes in as fast as the
+PDP11 takes it.
+*/
 #ifndef ESP_PLATFORM
-	int bytesWaiting;
-	ioctl(0, FIONREAD, &bytesWaiting);
-	if (bytesWaiting!=0) {
-		return getchar() | SCPE_KFLAG;
+#include <errno.h>
+#include "conring.h"
+
+//Instructions between input arriving and tti_svc looking at it
+#define CONIN_WAKE_LATENCY 100
+
+static conring_t conin;
+static volatile int32 conin_wake_id=-1;
+
+static void *conin_thread(void *arg) {
+	char buf[CONRING_SIZE];
+	while (1) {
+		int space=conring_space(&conin);
+		if (space==0) {
+			//The PDP11 isn't keeping up; leave the rest in the pipe for now.
+			usleep(1000);
+			continue;
+		}
+		int n=read(0, buf, space);
+		if (n<0 && errno==EINTR) continue;
+		if (n<=0) break; //end of input
+		//We're the only writer and the space can only have grown, so this takes it all.
+		conring_write(&conin, buf, n);
+		sim_wake(conin_wake_id);
 	}
+	return NULL;
+}
+#endif
+
+t_stat sim_poll_kbd (void) {
+#ifndef ESP_PLATFORM
+	uint8_t c;
+	if (conring_read(&conin, &c, 1)) return c|SCPE_KFLAG;
 #else
 	int c=getchar();
 //If tracing is enabled, '|' dumps the trace.
@@ -156,19 +189,62 @@ int32 sim_tt_outcvt (int32 c, uint32 mode) {
 t_stat tmxr_set_console_units (UNIT *rxuptr, UNIT *txuptr) {
 	//tmxr_set_line_unit (&sim_con_tmxr, 0, rxuptr);
 	//tmxr_set_line_output_unit (&sim_con_tmxr, 0, txuptr);
+#ifndef ESP_PLATFORM
+	conin_wake_id=sim_wake_register(rxuptr, CONIN_WAKE_LATENCY);
+	//Input may have come in before the unit was there to be woken
+	sim_wake(conin_wake_id);
+#endif
 	return SCPE_OK;
 }
 
-#ifdef ESP_PLATFORM
-#include "ie15lcd.h"
+/*
+Console output goes into a ring that's emptied by another task: the IE15 terminal on the
+ESP32, a thread writing to stdout on the host. If the ring is full, SCPE_STALL makes tto_svc
+try again later without setting the done bit, so the PDP11 sees a busy terminal rather than
+the emulator blocking on it.
+*/
+#ifndef ESP_PLATFORM
+#include <pthread.h>
+
+static conring_t conout;
+static pthread_mutex_t conout_mux=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t conout_cond=PTHREAD_COND_INITIALIZER;
+
+static void *conout_thread(void *arg) {
+	char buf[512];
+	while (1) {
+		int n=conring_read(&conout, buf, sizeof(buf));
+		if (n) {
+			fwrite(buf, 1, n, stdout);
+			fflush(stdout);
+		} else {
+			pthread_mutex_lock(&conout_mux);
+			if (conring_prepare_sleep(&conout)) pthread_cond_wait(&conout_cond, &conout_mux);
+			pthread_mutex_unlock(&conout_mux);
+		}
+	}
+	return NULL;
+}
+
+//Don't lose the last bit of output when the emulator exits.
+static void conout_drain(void) {
+	for (int i=0; i<1000 && conring_used(&conout)!=0; i++) usleep(1000);
+}
 #endif
 
 t_stat sim_putchar_s (int32 c) {
+	char ch=c;
 #ifdef ESP_PLATFORM
-	ie15_sendchar(c);
+	if (ie15_write(&ch, 1)==0) return SCPE_STALL;
 	if (c!=' ') last_char=c;
+#else
+	if (conring_write(&conout, &ch, 1)==0) return SCPE_STALL;
+	if (conring_need_wake(&conout)) {
+		pthread_mutex_lock(&conout_mux);
+		pthread_cond_signal(&conout_cond);
+		pthread_mutex_unlock(&conout_mux);
+	}
 #endif
-	putchar(c);
 	return SCPE_OK;
 }
 
@@ -197,7 +273,12 @@ t_stat sim_ttinit (void) {
 	tcgetattr(0, &term);
 	term.c_lflag &= ~ICANON;
 	tcsetattr(0, TCSANOW, &term);
-	setbuf(stdin, NULL);
+	pthread_t thread;
+	pthread_create(&thread, NULL, conout_thread, NULL);
+	pthread_detach(thread);
+	pthread_create(&thread, NULL, conin_thread, NULL);
+	pthread_detach(thread);
+	atexit(conout_drain);
 #else
 	autoboot_next_evt=0;
 #endif
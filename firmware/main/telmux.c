@@ -0,0 +1,315 @@
+/*
+Terminal multiplexer: TCP connections as serial lines. Everything runs in the emulator
+thread, from the poll service of the device using it, so there's no locking.
+
+The sockets are non-blocking and all registered with one epoll instance, so a poll is one
+epoll_wait that only returns what's ready. Ready connections are read with one read()
+of as much as fits in the line's buffer. What the guest writes to a line collects in the
+line's tx buffer, and lines with something in it are put on a list that the poll goes
+through, sending each buffer with one write(). Idle lines cost nothing.
+
+Connections talk telnet: we ask the client to let us do the echoing and to go to
+character-at-a-time mode, and take the telnet commands out of the received data.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "telmux.h"
+
+#define TN_IAC 255
+#define TN_DONT 254
+#define TN_DO 253
+#define TN_WONT 252
+#define TN_WILL 251
+#define TN_SB 250
+#define TN_SE 240
+#define TN_ECHO 1
+#define TN_SGA 3
+
+//Telnet parser states
+enum {
+	TN_DATA=0,
+	TN_GOT_IAC,		//had IAC
+	TN_GOT_OPT,		//had IAC WILL/WONT/DO/DONT, option comes next
+	TN_GOT_SB,		//in a subnegotiation
+	TN_GOT_SB_IAC,	//had IAC in a subnegotiation
+	TN_GOT_CR,		//had CR; a following LF or NUL belongs to it
+};
+
+//The epoll user data for the listening socket; connections use their line number.
+#define LISTEN_ID -1
+
+#define MAX_EVENTS 64
+
+static const uint8_t tn_hello[]={TN_IAC, TN_WILL, TN_SGA, TN_IAC, TN_WILL, TN_ECHO, TN_IAC, TN_DO, TN_SGA};
+
+telmux_t *telmux_open(const char *name, int port, int lines) {
+	telmux_t *m=calloc(1, sizeof(telmux_t));
+	if (!m) return NULL;
+	m->name=name;
+	m->lines=lines;
+	m->line=calloc(lines, sizeof(telmux_line_t));
+	m->txq=calloc(lines, sizeof(int));
+	m->listen_fd=-1;
+	m->epoll_fd=-1;
+	if (!m->line || !m->txq) goto err;
+	for (int i=0; i<lines; i++) m->line[i].fd=-1;
+
+	m->listen_fd=socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (m->listen_fd<0) goto err;
+	int one=1;
+	setsockopt(m->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	struct sockaddr_in sa={0};
+	sa.sin_family=AF_INET;
+	sa.sin_port=htons(port);
+	sa.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	if (bind(m->listen_fd, (struct sockaddr*)&sa, sizeof(sa))!=0) goto err;
+	if (listen(m->listen_fd, 16)!=0) goto err;
+	m->epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+	if (m->epoll_fd<0) goto err;
+	struct epoll_event ev={.events=EPOLLIN, .data.u32=(uint32_t)LISTEN_ID};
+	if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->listen_fd, &ev)!=0) goto err;
+	printf("%s: %d lines, telnet to 127.0.0.1 port %d\n", name, lines, port);
+	return m;
+err:
+	printf("%s: can't listen on port %d: %s\n", name, port, strerror(errno));
+	telmux_close(m);
+	return NULL;
+}
+
+static void hangup(telmux_t *m, int ln) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->fd<0) return;
+	epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, l->fd, NULL);
+	close(l->fd);
+	l->fd=-1;
+	if (l->rx_paused) m->rx_paused--;
+	l->rx_paused=0;
+	l->rx_pos=l->rx_len=0;
+	l->tx_len=0;
+	printf("%s: line %d disconnected (%ld bytes in, %ld out)\n", m->name, ln, l->rx_bytes, l->tx_bytes);
+}
+
+void telmux_close(telmux_t *m) {
+	if (!m) return;
+	if (m->line) {
+		for (int i=0; i<m->lines; i++) hangup(m, i);
+	}
+	if (m->epoll_fd>=0) close(m->epoll_fd);
+	if (m->listen_fd>=0) close(m->listen_fd);
+	free(m->line);
+	free(m->txq);
+	free(m);
+}
+
+//Sends as much of the tx buffer as the socket takes. Returns 0 if the line got hung up.
+static int send_tx(telmux_t *m, int ln) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->fd<0 || l->tx_len==0) return 1;
+	ssize_t n=send(l->fd, l->tx, l->tx_len, MSG_NOSIGNAL);
+	if (n<0) {
+		if (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR) return 1;
+		hangup(m, ln);
+		return 0;
+	}
+	l->tx_bytes+=n;
+	l->tx_len-=n;
+	if (l->tx_len) memmove(l->tx, l->tx+n, l->tx_len);
+	return 1;
+}
+
+static void queue_tx(telmux_t *m, int ln) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->tx_queued) return;
+	l->tx_queued=1;
+	m->txq[m->txq_len++]=ln;
+}
+
+static void accept_conn(telmux_t *m) {
+	int fd;
+	while ((fd=accept4(m->listen_fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC))>=0) {
+		int ln;
+		for (ln=0; ln<m->lines; ln++) {
+			if (m->line[ln].fd<0) break;
+		}
+		if (ln==m->lines) {
+			const char *msg="All lines are busy\r\n";
+			if (write(fd, msg, strlen(msg))<0) {
+				//nothing we can do about it
+			}
+			close(fd);
+			continue;
+		}
+		int one=1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		struct epoll_event ev={.events=EPOLLIN, .data.u32=ln};
+		if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, fd, &ev)!=0) {
+			close(fd);
+			continue;
+		}
+		telmux_line_t *l=&m->line[ln];
+		l->fd=fd;
+		l->tn_state=TN_DATA;
+		l->rx_pos=l->rx_len=0;
+		l->rx_paused=0;
+		l->rx_bytes=l->tx_bytes=0;
+		memcpy(l->tx, tn_hello, sizeof(tn_hello));
+		l->tx_len=sizeof(tn_hello);
+		queue_tx(m, ln);
+		printf("%s: line %d connected\n", m->name, ln);
+	}
+}
+
+//Reads what's there into the rx buffer and takes out the telnet commands.
+static void read_rx(telmux_t *m, int ln) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->rx_pos==l->rx_len) l->rx_pos=l->rx_len=0;
+	if (l->rx_pos) {
+		memmove(l->rx, l->rx+l->rx_pos, l->rx_len-l->rx_pos);
+		l->rx_len-=l->rx_pos;
+		l->rx_pos=0;
+	}
+	int space=TELMUX_RXBUF-l->rx_len;
+	if (space==0) {
+		//The guest isn't keeping up; leave it in the socket. EPOLLIN is level triggered, so
+		//stop asking for it until the guest has made room, or every poll would return here.
+		struct epoll_event ev={.events=0, .data.u32=ln};
+		epoll_ctl(m->epoll_fd, EPOLL_CTL_MOD, l->fd, &ev);
+		l->rx_paused=1;
+		m->rx_paused++;
+		return;
+	}
+	uint8_t buf[TELMUX_RXBUF];
+	ssize_t n=read(l->fd, buf, space);
+	if (n==0 || (n<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR)) {
+		hangup(m, ln);
+		return;
+	}
+	if (n<0) return;
+	l->rx_bytes+=n;
+	uint8_t *out=l->rx+l->rx_len;
+	for (int i=0; i<n; i++) {
+		uint8_t c=buf[i];
+		switch (l->tn_state) {
+		case TN_GOT_CR:
+			l->tn_state=TN_DATA;
+			if (c==0 || c=='\n') break;
+			//fall through
+		case TN_DATA:
+			if (c==TN_IAC) {
+				l->tn_state=TN_GOT_IAC;
+			} else {
+				*out++=c;
+				if (c=='\r') l->tn_state=TN_GOT_CR;
+			}
+			break;
+		case TN_GOT_IAC:
+			if (c==TN_IAC) {
+				*out++=c;
+				l->tn_state=TN_DATA;
+			} else if (c>=TN_WILL && c<=TN_DONT) {
+				l->tn_state=TN_GOT_OPT;
+			} else if (c==TN_SB) {
+				l->tn_state=TN_GOT_SB;
+			} else {
+				l->tn_state=TN_DATA;
+			}
+			break;
+		case TN_GOT_OPT:
+			//We said what we want; whatever the client answers, we just go on.
+			l->tn_state=TN_DATA;
+			break;
+		case TN_GOT_SB:
+			if (c==TN_IAC) l->tn_state=TN_GOT_SB_IAC;
+			break;
+		case TN_GOT_SB_IAC:
+			l->tn_state=(c==TN_SE)?TN_DATA:TN_GOT_SB;
+			break;
+		}
+	}
+	l->rx_len=out-l->rx;
+}
+
+//Starts polling paused lines for input again once the guest has read from their rx buffer.
+static void resume_rx(telmux_t *m) {
+	for (int ln=0; ln<m->lines && m->rx_paused; ln++) {
+		telmux_line_t *l=&m->line[ln];
+		if (!l->rx_paused || (l->rx_pos==0 && l->rx_len==TELMUX_RXBUF)) continue;
+		struct epoll_event ev={.events=EPOLLIN, .data.u32=ln};
+		epoll_ctl(m->epoll_fd, EPOLL_CTL_MOD, l->fd, &ev);
+		l->rx_paused=0;
+		m->rx_paused--;
+	}
+}
+
+void telmux_poll(telmux_t *m) {
+	struct epoll_event ev[MAX_EVENTS];
+	if (m->rx_paused) resume_rx(m);
+	int n=epoll_wait(m->epoll_fd, ev, MAX_EVENTS, 0);
+	for (int i=0; i<n; i++) {
+		int id=(int32_t)ev[i].data.u32;
+		if (id==LISTEN_ID) {
+			accept_conn(m);
+		} else if (m->line[id].rx_paused) {
+			//Without EPOLLIN, only errors and hangups are reported
+			hangup(m, id);
+		} else if (m->line[id].fd>=0) {
+			read_rx(m, id);
+		}
+	}
+	//Send what the guest wrote. Lines the socket didn't take everything from stay queued.
+	int j=0;
+	for (int i=0; i<m->txq_len; i++) {
+		int ln=m->txq[i];
+		if (send_tx(m, ln) && m->line[ln].tx_len) {
+			m->txq[j++]=ln;
+		} else {
+			m->line[ln].tx_queued=0;
+		}
+	}
+	m->txq_len=j;
+}
+
+int telmux_tx_space(telmux_t *m, int ln) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->fd<0) return TELMUX_TXBUF;
+	//worst case, every character needs to be escaped
+	return (TELMUX_TXBUF-l->tx_len)/2;
+}
+
+void telmux_putc(telmux_t *m, int ln, uint8_t c) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->fd<0) return;
+	if (l->tx_len>TELMUX_TXBUF-2) {
+		//Full; make room right away rather than dropping anything.
+		send_tx(m, ln);
+		if (l->fd<0 || l->tx_len>TELMUX_TXBUF-2) return;
+	}
+	if (c==TN_IAC) l->tx[l->tx_len++]=TN_IAC;
+	l->tx[l->tx_len++]=c;
+	queue_tx(m, ln);
+}
+
+void telmux_disconnect(telmux_t *m, int ln) {
+	send_tx(m, ln);
+	hangup(m, ln);
+}
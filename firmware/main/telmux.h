@@ -0,0 +1,71 @@
+//Terminal multiplexer for the host build: serial lines of an emulated multiplexer (the
+//DZ11) that are reached by telnetting to a TCP port on the loopback interface.
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+#pragma once
+#include <stdint.h>
+
+//Per line buffers. The tx buffer holds what the guest writes between two polls.
+#define TELMUX_RXBUF 1024
+#define TELMUX_TXBUF 4096
+
+typedef struct {
+	int fd;					//-1 if nobody is connected
+	int tn_state;			//telnet command parser state
+	uint8_t rx[TELMUX_RXBUF];	//received data, telnet commands already taken out
+	int rx_pos, rx_len;
+	int rx_paused;			//rx buffer was full; not polled for input until there's room
+	uint8_t tx[TELMUX_TXBUF];	//data for the socket, telnet escaping already done
+	int tx_len;
+	int tx_queued;			//on the list of lines with data to send
+	long rx_bytes, tx_bytes;
+} telmux_line_t;
+
+typedef struct {
+	int listen_fd;
+	int epoll_fd;
+	const char *name;
+	int lines;
+	telmux_line_t *line;
+	int *txq;				//lines with data to send
+	int txq_len;
+	int rx_paused;			//number of lines with rx_paused set
+} telmux_t;
+
+/*
+Starts listening on 127.0.0.1:port for connections to one of 'lines' lines. 'name' is used
+in messages. Returns NULL on error.
+*/
+telmux_t *telmux_open(const char *name, int port, int lines);
+void telmux_close(telmux_t *m);
+
+/*
+Does all the socket I/O: accepts new connections, reads from the connections that have
+data and sends what has been written to the lines. One epoll_wait call plus one read or
+write per line that actually has something to do, however many lines there are.
+*/
+void telmux_poll(telmux_t *m);
+
+static inline int telmux_connected(telmux_t *m, int ln) {
+	return m->line[ln].fd>=0;
+}
+
+//Returns the next received character on a line, or -1 if there's none.
+static inline int telmux_getc(telmux_t *m, int ln) {
+	telmux_line_t *l=&m->line[ln];
+	if (l->rx_pos==l->rx_len) return -1;
+	return l->rx[l->rx_pos++];
+}
+
+//Number of characters telmux_putc is guaranteed to take.
+int telmux_tx_space(telmux_t *m, int ln);
+//Queues a character to be sent. If nobody is connected, it's dropped.
+void telmux_putc(telmux_t *m, int ln, uint8_t c);
+//Sends what's still queued and hangs up.
+void telmux_disconnect(telmux_t *m, int ln);
@@ -1,11 +1,55 @@
 #include <stdint.h>
+#include "pktbuf.h"
 
 void wifi_if_open();
 void wifi_if_close();
 int wifi_if_write(uint8_t *packet, int len);
-int wifi_if_read(uint8_t *packet, int maxlen);
+//Returns the next received frame, or NULL if there is none. The caller gets the reference
+//to the buffer and has to pktbuf_unref() it when done.
+pktbuf_t *wifi_if_read_buf();
+//Sets a function to be called every time a received frame becomes available to
+//wifi_if_read_buf(), so the reader doesn't need to poll. It's called from whatever task or
+//thread received the frame, so it can't do much more than flag the emulator; NULL stops
+//the calls.
+typedef void (*wifi_if_rx_notify_t)();
+void wifi_if_set_rx_notify(wifi_if_rx_notify_t cb);
+//Used by the receive side to call the above.
+void wifi_if_rx_notify();
 void wifi_if_get_mac(char *txtmac);
 
+//Implemented in sim_ether.c: returns nonzero if the emulated NIC's address filter wants
+//a frame with this destination MAC.
+int eth_filter_accepts(const uint8_t *dst);
+
 void wifi_if_wifid_send_to_pdp(void *buffer, uint16_t len);
 
 void wifi_if_ena_auto_reconnect();
+
+//Writes frames to a pcap file (Ethernet link type), for looking at with Wireshark and
+//friends. Used for capturing the PDP11's traffic (see sim_ether.c) and by the pcap backend.
+typedef struct wifi_if_pcap wifi_if_pcap_t;
+wifi_if_pcap_t *wifi_if_pcap_create(const char *path);
+void wifi_if_pcap_frame(wifi_if_pcap_t *p, const uint8_t *frame, int len);
+void wifi_if_pcap_close(wifi_if_pcap_t *p);
+
+#ifndef ESP_PLATFORM
+/*
+The host build can connect the PDP11 to different kinds of network. wifi_if_host.c picks
+one by the ESPPDP_NET environment variable, which holds a backend name optionally followed
+by a colon and an argument for it (e.g. "pcap:in.pcap,out.pcap"); the default is "tap".
+*/
+typedef struct {
+	const char *name;
+	const char *help;
+	int (*open)(const char *arg);	//returns 0 on success
+	void (*close)();
+	int (*write)(uint8_t *packet, int len);
+	pktbuf_t *(*read_buf)();
+	void (*get_mac)(char *txtmac);	//optional; called before open
+} wifi_if_backend_t;
+
+extern const wifi_if_backend_t wifi_if_backend_tap;
+extern const wifi_if_backend_t wifi_if_backend_pcap;
+extern const wifi_if_backend_t wifi_if_backend_echo;
+extern const wifi_if_backend_t wifi_if_backend_switch;
+#endif
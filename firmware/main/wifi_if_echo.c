@@ -0,0 +1,155 @@
+/*
+Echo network backend for the host build. There's no network at all: a fake host on the
+other end of the wire answers ARP requests for any address, ping, and echoes back UDP
+datagrams sent to it, so the PDP11's network stack can be tested and benchmarked
+without a tap device or root.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "wifi_if.h"
+#include "chksum.h"
+
+#define ETH_HDR_LEN 14
+#define ETH_MIN_LEN 60
+#define ETHERTYPE_IP 0x0800
+#define ETHERTYPE_ARP 0x0806
+#define IP_PROTO_ICMP 1
+#define IP_PROTO_UDP 17
+
+//Locally administered address for the fake host
+static const uint8_t echo_mac[6]={0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+//Replies are made in wifi_if_write and picked up by wifi_if_read_buf; both run in the
+//emulator thread.
+static pktring_t replies;
+static long arp_count, ping_count, udp_count;
+
+static uint16_t get16(const uint8_t *p) {
+	return (p[0]<<8)|p[1];
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+	p[0]=v>>8;
+	p[1]=v;
+}
+
+static void swap_bytes(uint8_t *a, uint8_t *b, int len) {
+	uint8_t t[6];
+	memcpy(t, a, len);
+	memcpy(a, b, len);
+	memcpy(b, t, len);
+}
+
+static void queue_reply(pktbuf_t *pb) {
+	if (pb->len<ETH_MIN_LEN) {
+		memset(pb->data+pb->len, 0, ETH_MIN_LEN-pb->len);
+		pb->len=ETH_MIN_LEN;
+	}
+	if (!pktring_put(&replies, pb)) pktbuf_unref(pb);
+	wifi_if_rx_notify();
+}
+
+static void echo_arp(const uint8_t *packet, int len) {
+	const uint8_t *arp=packet+ETH_HDR_LEN;
+	if (len<ETH_HDR_LEN+28) return;
+	if (get16(arp)!=1 || get16(arp+2)!=ETHERTYPE_IP || arp[4]!=6 || arp[5]!=4) return;
+	if (get16(arp+6)!=1) return; //only requests
+	if (memcmp(arp+14, arp+24, 4)==0) return; //gratuitous ARP / address probe
+	pktbuf_t *pb=pktbuf_alloc();
+	if (!pb) return;
+	uint8_t *r=pb->data;
+	memcpy(r, packet+6, 6);
+	memcpy(r+6, echo_mac, 6);
+	put16(r+12, ETHERTYPE_ARP);
+	memcpy(r+ETH_HDR_LEN, arp, 6); //htype, ptype, hlen, plen
+	put16(r+ETH_HDR_LEN+6, 2); //reply
+	memcpy(r+ETH_HDR_LEN+8, echo_mac, 6);
+	memcpy(r+ETH_HDR_LEN+14, arp+24, 4); //we're whoever they asked for
+	memcpy(r+ETH_HDR_LEN+18, arp+8, 10); //their hw and protocol address
+	pb->len=ETH_HDR_LEN+28;
+	arp_count++;
+	queue_reply(pb);
+}
+
+static void echo_ip(const uint8_t *packet, int len) {
+	const uint8_t *ip=packet+ETH_HDR_LEN;
+	if (len<ETH_HDR_LEN+20) return;
+	int ihl=(ip[0]&0xf)*4;
+	int iplen=get16(ip+2);
+	if ((ip[0]>>4)!=4 || ihl<20 || iplen<ihl || ETH_HDR_LEN+iplen>len) return;
+	if (get16(ip+6)&0x3fff) return; //fragment
+	if (ip[9]!=IP_PROTO_ICMP && ip[9]!=IP_PROTO_UDP) return;
+	if (ip[9]==IP_PROTO_ICMP && (iplen<ihl+8 || ip[ihl]!=8)) return; //only echo requests
+	if (ip[9]==IP_PROTO_UDP && iplen<ihl+8) return;
+
+	pktbuf_t *pb=pktbuf_alloc();
+	if (!pb) return;
+	uint8_t *r=pb->data;
+	memcpy(r, packet, ETH_HDR_LEN+iplen);
+	swap_bytes(r, r+6, 6);
+	uint8_t *rip=r+ETH_HDR_LEN;
+	swap_bytes(rip+12, rip+16, 4);
+	rip[8]=64; //ttl
+	uint8_t *l4=rip+ihl;
+	if (ip[9]==IP_PROTO_ICMP) {
+		l4[0]=0; //echo reply
+		put16(l4+2, 0);
+		put16(l4+2, chksum_inet(l4, iplen-ihl));
+		ping_count++;
+	} else {
+		swap_bytes(l4, l4+2, 2);
+		put16(l4+6, 0); //no checksum; allowed for UDP over IPv4
+		udp_count++;
+	}
+	put16(rip+10, 0);
+	put16(rip+10, chksum_inet(rip, ihl));
+	pb->len=ETH_HDR_LEN+iplen;
+	queue_reply(pb);
+}
+
+static int echo_open(const char *arg) {
+	printf("Network: echo responder (%02X:%02X:%02X:%02X:%02X:%02X)\n", echo_mac[0], echo_mac[1],
+			echo_mac[2], echo_mac[3], echo_mac[4], echo_mac[5]);
+	return 0;
+}
+
+static void echo_close() {
+	pktbuf_t *pb;
+	while ((pb=pktring_get(&replies))!=NULL) pktbuf_unref(pb);
+	printf("Network: echo responder answered %ld ARP, %ld ping, %ld UDP\n", arp_count, ping_count, udp_count);
+}
+
+static int echo_write(uint8_t *packet, int len) {
+	if (len<ETH_HDR_LEN) return len;
+	uint16_t type=get16(packet+12);
+	int bcast=(memcmp(packet, "\xff\xff\xff\xff\xff\xff", 6)==0);
+	if (type==ETHERTYPE_ARP && (bcast || memcmp(packet, echo_mac, 6)==0)) {
+		echo_arp(packet, len);
+	} else if (type==ETHERTYPE_IP && memcmp(packet, echo_mac, 6)==0) {
+		echo_ip(packet, len);
+	}
+	return len;
+}
+
+static pktbuf_t *echo_read_buf() {
+	return pktring_get(&replies);
+}
+
+const wifi_if_backend_t wifi_if_backend_echo={
+	.name="echo",
+	.help="echo  no network; answer ARP, ping and UDP locally",
+	.open=echo_open,
+	.close=echo_close,
+	.write=echo_write,
+	.read_buf=echo_read_buf,
+};
@@ -53,19 +53,32 @@ should be forwarded to the PDP11, the LWIP stack, both, or neither.
 
 #define MAX_RETRY 10
 #define TAG "wifi_if"
-#define PDP11_IN_FLIGHT_PACKETS 32
 
 //#define DBG_DUMP_PACKETS
 
-typedef struct {
-	int len;
-	uint8_t *buffer;
-	void *eb;
-} rx_packet_t;
-
-QueueHandle_t rxqueue;
+/*
+Frames for the PDP11 are copied out of the WiFi driver buffer into a pool buffer right in
+the rx callback, and the driver buffer is handed back straight away: the driver only has a
+handful of them (see ESP32_WIFI_*_RX_BUFFER_NUM) and holding on to them until the guest
+gets around to reading stalls the radio. From there on the pool buffer is passed by
+reference through sim_ether and the XQ read queue until it's DMA'ed into guest memory.
+rxring is only filled by the WiFi task; wifid can send from both the event task and the
+emulator, so its packets go through their own ring with the producer side locked.
+*/
+static pktring_t rxring, wifid_ring;
+static portMUX_TYPE wifid_ring_mux=portMUX_INITIALIZER_UNLOCKED;
 
 static esp_netif_t *netif;
+static volatile wifi_if_rx_notify_t rx_notify_cb=NULL;
+
+void wifi_if_set_rx_notify(wifi_if_rx_notify_t cb) {
+	rx_notify_cb=cb;
+}
+
+void wifi_if_rx_notify() {
+	wifi_if_rx_notify_t cb=rx_notify_cb;
+	if (cb) cb();
+}
 
 //Gets called whenever the local tcp/ip stack wants to transmit something
 static esp_err_t wifi_netif_tx(void *driver, void *buffer, size_t len) {
@@ -105,27 +118,20 @@ int wifi_if_write(uint8_t *packet, int len) {
 }
 
 
-static esp_err_t wlan_send_to_pdp(void *buffer, uint16_t len, void *eb, int do_copy) {
-	rx_packet_t p={};
-	p.len=len;
-	if (do_copy) {
-		//Note: we can theoretically also solve this by incrementing the refcount on eb...
-		p.buffer=malloc(len);
-		if (!p.buffer) {
-			printf("wlan_send_to_pdp: out of memory for copied packet\n");
-			return ESP_ERR_NO_MEM;
-		}
-		memcpy(p.buffer, buffer, len);
-	} else {
-		p.buffer=buffer;
-		p.eb=eb;
+static esp_err_t wlan_send_to_pdp(void *buffer, uint16_t len) {
+	if (len>PKTBUF_SIZE) return ESP_ERR_INVALID_SIZE;
+	pktbuf_t *pb=pktbuf_alloc();
+	if (!pb) {
+		printf("WiFi: out of packet buffers\n");
+		return ESP_ERR_NO_MEM;
 	}
-
-	int ret = xQueueSend(rxqueue, &p, 0);
-	if (ret != pdTRUE) {
-		if (!p.eb) free(p.buffer);
+	memcpy(pb->data, buffer, len);
+	pb->len=len;
+	if (!pktring_put(&rxring, pb)) {
+		pktbuf_unref(pb);
 		printf("WiFi: rx queue full...\n");
 	}
+	wifi_if_rx_notify();
 	return ESP_OK;
 }
 
@@ -135,14 +141,22 @@ void wifi_if_wifid_send_to_pdp(void *buffer, uint16_t len) {
 	hexdump(buffer, len);
 #endif
 	//injects a malloc()'ed packet for wifid into the packet stream to the pdp11
-	rx_packet_t p={};
-	p.len=len;
-	p.buffer=buffer;
-	int ret = xQueueSend(rxqueue, &p, 0);
-	if (ret != pdTRUE) {
-		if (!p.eb) free(p.buffer);
-		printf("WiFi: wifid: rx queue full...\n");
+	pktbuf_t *pb=(len<=PKTBUF_SIZE)?pktbuf_alloc():NULL;
+	if (pb) {
+		memcpy(pb->data, buffer, len);
+		pb->len=len;
+		portENTER_CRITICAL(&wifid_ring_mux);
+		int ok=pktring_put(&wifid_ring, pb);
+		portEXIT_CRITICAL(&wifid_ring_mux);
+		if (!ok) {
+			pktbuf_unref(pb);
+			printf("WiFi: wifid: rx queue full...\n");
+		}
+		wifi_if_rx_notify();
+	} else {
+		printf("WiFi: wifid: out of packet buffers\n");
 	}
+	free(buffer);
 }
 
 
@@ -156,16 +170,18 @@ static esp_err_t wlan_sta_rx_callback(void *buffer, uint16_t len, void *eb) {
 	}
 	
 	int dest=wifi_if_filter_find_packet_dest(buffer, len);
+	//Don't queue up frames the PDP11 NIC would throw away anyway
+	if ((dest&PACKET_DEST_PDP11) && !eth_filter_accepts(buffer)) dest&=~PACKET_DEST_PDP11;
+	if (dest==0) goto ERROR;
 	if (dest&PACKET_DEST_PDP11) {
-		int do_copy=dest&(~PACKET_DEST_PDP11); //see if the packet is also sent to other dests
-		esp_err_t res=wlan_send_to_pdp(buffer, len, eb, do_copy);
-		if (res!=ESP_OK) {
-			if (do_copy) goto ERROR;
-		}
+		wlan_send_to_pdp(buffer, len);
 	}
 	if (dest&PACKET_DEST_LWIP) {
+		//LWIP takes over eb
 		ESP_ERROR_CHECK(esp_netif_receive(netif, buffer, len, eb));
+		return ESP_OK;
 	}
+	esp_wifi_internal_free_rx_buffer(eb);
 	return ESP_OK;
 ERROR:
 	esp_wifi_internal_free_rx_buffer(eb);
@@ -184,25 +200,10 @@ void wifi_netif_free_buffer(void *h, void* buffer) {
 */
 
 //Gets called when the PDP11 tries to read a packet
-int wifi_if_read(uint8_t *packet, int maxlen) {
-	rx_packet_t p;
-	if (xQueueReceive(rxqueue, &p, 0)==pdPASS) {
-		if (p.len>maxlen) {
-			printf("wifi_if_read: received packet len=%d, larger than maxlen %d\n", p.len, maxlen);
-			esp_wifi_internal_free_rx_buffer(p.eb);
-			return 0;
-		}
-		memcpy(packet, p.buffer, p.len);
-		if (p.eb) {
-			esp_wifi_internal_free_rx_buffer(p.eb);
-		} else {
-			//copied packet
-			free(p.buffer);
-		}
-		return(p.len);
-	} else {
-		return 0;
-	}
+pktbuf_t *wifi_if_read_buf() {
+	pktbuf_t *pb=pktring_get(&wifid_ring);
+	if (!pb) pb=pktring_get(&rxring);
+	return pb;
 }
 
 
@@ -213,6 +214,8 @@ static void sta_event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data) {
 	if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
 //		esp_netif_dhcpc_stop(netif);
+		//The next AP may well be a different network
+		wifi_if_filter_forget();
 		if (s_retry_num < MAX_RETRY) {
 			s_retry_num++;
 			ESP_LOGI(TAG, "Disconnected from AP, retrying...");
@@ -235,6 +238,8 @@ static void sta_event_handler(void* arg, esp_event_base_t event_base,
 		ESP_LOGI(TAG,"got IP");
 		esp_netif_action_got_ip(netif, event_base, event_id, event_data);
 		ip_event_got_ip_t *ip=(ip_event_got_ip_t*)event_data;
+		//wifid hands this address to the PDP11
+		wifi_if_filter_set_pdp_ip((uint8_t*)&ip->ip_info.ip.addr);
 		wifid_signal_connected(ip->esp_netif, &ip->ip_info);
 	} else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
 		wifid_signal_scan_done();
@@ -316,7 +321,7 @@ void wifi_if_open() {
 	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
 	ESP_LOGI(TAG,"STA mode set");
 
-	rxqueue=xQueueCreate(PDP11_IN_FLIGHT_PACKETS, sizeof(rx_packet_t));
+	pktbuf_init();
 
 	esp_netif_init();
 	esp_event_loop_create_default();
@@ -9,6 +9,8 @@
  * ----------------------------------------------------------------------------
  */
 
+#include <string.h>
+#include <stdlib.h>
 #include "wifi_if_esp32_packet_filter.h"
 #include "lwip/prot/ethernet.h"
 #include "lwip/prot/ieee.h"
@@ -20,25 +22,208 @@
 #include "wifid_iface.h"
 #include "wifid.h"
 #include "hexdump.h"
+#include "esp_timer.h"
+#include "esp_private/wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #define PACKET_DEST_PDP11 1
 #define PACKET_DEST_LWIP 2
 
+/*
+ARP offload. Left alone, every ARP request on the WLAN goes into the PDP11, which takes
+an XQ DMA, an interrupt and a trip through the 2.11BSD ARP code for each of them, only to
+find out that almost all are for someone else. Instead, we keep track of the PDP11's IP
+and MAC address (from wifid and from what it sends) and answer requests for it right here,
+and drop requests for other addresses. In the other direction, replies and requests seen
+on the network go into a small ARP cache, and if the PDP11 asks for an address that's in
+there and was heard from only moments ago, the answer is handed to it straight away without
+going out on the air. Anything older is asked on the network as the guest would have done,
+so an address that moved to another MAC isn't answered with the old one.
+*/
+#define ARP_CACHE_SIZE 16
+//Entries this old aren't used to answer the PDP11 anymore
+#define ARP_CACHE_MAX_AGE_US (3*1000000LL)
+#define ARP_FRAME_LEN 60
+
+typedef struct {
+	uint8_t ip[4];
+	uint8_t mac[6];
+	int64_t stamp; //0 if unused
+} arp_entry_t;
+
+//The cache is updated from the WiFi task and used from the emulator task
+static portMUX_TYPE arp_mux=portMUX_INITIALIZER_UNLOCKED;
+static arp_entry_t arp_cache[ARP_CACHE_SIZE];
+static uint8_t pdp_ip[4];
+static uint8_t pdp_mac[6];
+static int pdp_ip_known=0, pdp_mac_known=0;
+//Set once pdp_ip comes from the guest's own ARP packets rather than from the lease
+static int pdp_ip_learned=0;
+static uint8_t lease_ip[4];
+
+static const uint8_t bcast_mac[6]={0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+//The lease is only a guess at the guest's address. Once the guest has shown it uses something
+//else (e.g. a static address), that wins; if it's using the old lease, it will move to the new one.
+void wifi_if_filter_set_pdp_ip(const uint8_t *ip) {
+	portENTER_CRITICAL(&arp_mux);
+	if (!pdp_ip_learned || memcmp(pdp_ip, lease_ip, 4)==0) {
+		memcpy(pdp_ip, ip, 4);
+		pdp_ip_known=(ip[0]|ip[1]|ip[2]|ip[3])!=0;
+		pdp_ip_learned=0;
+	}
+	memcpy(lease_ip, ip, 4);
+	portEXIT_CRITICAL(&arp_mux);
+}
+
+void wifi_if_filter_forget() {
+	portENTER_CRITICAL(&arp_mux);
+	memset(arp_cache, 0, sizeof(arp_cache));
+	portEXIT_CRITICAL(&arp_mux);
+}
+
+static void arp_cache_learn(const uint8_t *ip, const uint8_t *mac) {
+	if ((ip[0]|ip[1]|ip[2]|ip[3])==0 || (mac[0]&1)) return;
+	int64_t now=esp_timer_get_time();
+	portENTER_CRITICAL(&arp_mux);
+	arp_entry_t *e=NULL;
+	for (int i=0; i<ARP_CACHE_SIZE; i++) {
+		if (arp_cache[i].stamp && memcmp(arp_cache[i].ip, ip, 4)==0) {
+			e=&arp_cache[i];
+			break;
+		}
+		//otherwise re-use the least recently refreshed entry
+		if (e==NULL || arp_cache[i].stamp<e->stamp) e=&arp_cache[i];
+	}
+	memcpy(e->ip, ip, 4);
+	memcpy(e->mac, mac, 6);
+	e->stamp=now;
+	portEXIT_CRITICAL(&arp_mux);
+}
+
+static int arp_cache_lookup(const uint8_t *ip, uint8_t *mac) {
+	int64_t now=esp_timer_get_time();
+	int found=0;
+	portENTER_CRITICAL(&arp_mux);
+	for (int i=0; i<ARP_CACHE_SIZE; i++) {
+		if (arp_cache[i].stamp && now-arp_cache[i].stamp<ARP_CACHE_MAX_AGE_US &&
+				memcmp(arp_cache[i].ip, ip, 4)==0) {
+			memcpy(mac, arp_cache[i].mac, 6);
+			found=1;
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&arp_mux);
+	return found;
+}
+
+//Builds an ARP reply telling 'to' that 'ip' is at 'mac'
+static void arp_make_reply(uint8_t *buffer, const struct etharp_hdr *to, const uint8_t *ip, const uint8_t *mac) {
+	struct eth_hdr *eth=(struct eth_hdr*)buffer;
+	struct etharp_hdr *arp=(struct etharp_hdr*)(buffer+sizeof(struct eth_hdr));
+	memset(buffer, 0, ARP_FRAME_LEN);
+	memcpy(&eth->dest, &to->shwaddr, 6);
+	memcpy(&eth->src, mac, 6);
+	eth->type=htons(ETHTYPE_ARP);
+	arp->hwtype=htons(1);
+	arp->proto=htons(ETHTYPE_IP);
+	arp->hwlen=6;
+	arp->protolen=4;
+	arp->opcode=htons(ARP_REPLY);
+	memcpy(&arp->shwaddr, mac, 6);
+	memcpy(&arp->sipaddr, ip, 4);
+	memcpy(&arp->dhwaddr, &to->shwaddr, 6);
+	memcpy(&arp->dipaddr, &to->sipaddr, 4);
+}
+
+static int arp_is_ipv4_ether(const struct etharp_hdr *arp) {
+	return ntohs(arp->hwtype)==1 && ntohs(arp->proto)==ETHTYPE_IP && arp->hwlen==6 && arp->protolen==4;
+}
+
+//Handles an ARP packet from the network; returns where it should go from here.
+static int arp_from_network(uint8_t *buffer, uint16_t len) {
+	struct etharp_hdr *arp=(struct etharp_hdr*)(buffer+sizeof(struct eth_hdr));
+	if (len<sizeof(struct eth_hdr)+sizeof(struct etharp_hdr) || !arp_is_ipv4_ether(arp)) {
+		return PACKET_DEST_PDP11;
+	}
+	uint8_t sip[4], dip[4], ip[4], mac[6];
+	memcpy(sip, &arp->sipaddr, 4);
+	memcpy(dip, &arp->dipaddr, 4);
+	arp_cache_learn(sip, arp->shwaddr.addr);
+	if (ntohs(arp->opcode)!=ARP_REQUEST) {
+		//Replies go to both stacks
+		return PACKET_DEST_PDP11|PACKET_DEST_LWIP;
+	}
+
+	//Requests are answered by the PDP11 only. Until we know who it is, it gets them all.
+	portENTER_CRITICAL(&arp_mux);
+	int known=pdp_ip_known && pdp_mac_known;
+	memcpy(ip, pdp_ip, 4);
+	memcpy(mac, pdp_mac, 6);
+	portEXIT_CRITICAL(&arp_mux);
+	if (!known) return PACKET_DEST_PDP11;
+	//Not for the PDP11; it would only look at it and throw it away.
+	if (memcmp(dip, ip, 4)!=0) return 0;
+	//Someone else claiming our address; let the guest deal with that as it always did.
+	if (memcmp(sip, ip, 4)==0) return PACKET_DEST_PDP11;
+	uint8_t reply[ARP_FRAME_LEN];
+	arp_make_reply(reply, arp, ip, mac);
+	esp_wifi_internal_tx(ESP_IF_WIFI_STA, reply, ARP_FRAME_LEN);
+	return 0;
+}
+
+//Handles an ARP packet from the PDP11. Returns 1 if it's been taken care of.
+static int arp_from_pdp11(uint8_t *buffer, uint16_t len) {
+	struct eth_hdr *eth=(struct eth_hdr*)buffer;
+	struct etharp_hdr *arp=(struct etharp_hdr*)(buffer+sizeof(struct eth_hdr));
+	if (len<sizeof(struct eth_hdr)+sizeof(struct etharp_hdr) || !arp_is_ipv4_ether(arp)) return 0;
+	uint8_t sip[4], dip[4], mac[6];
+	memcpy(sip, &arp->sipaddr, 4);
+	memcpy(dip, &arp->dipaddr, 4);
+	//This tells us who the PDP11 is
+	if ((sip[0]|sip[1]|sip[2]|sip[3])!=0) {
+		portENTER_CRITICAL(&arp_mux);
+		memcpy(pdp_ip, sip, 4);
+		memcpy(pdp_mac, arp->shwaddr.addr, 6);
+		pdp_ip_known=1;
+		pdp_mac_known=1;
+		pdp_ip_learned=1;
+		portEXIT_CRITICAL(&arp_mux);
+	}
+	if (ntohs(arp->opcode)!=ARP_REQUEST || memcmp(&eth->dest, bcast_mac, 6)!=0) return 0;
+	if (memcmp(sip, dip, 4)==0) return 0; //gratuitous ARP, that has to go out
+	if (!arp_cache_lookup(dip, mac)) return 0;
+	//Answer from the cache. The injected packet is freed by wifi_if_wifid_send_to_pdp.
+	uint8_t *reply=malloc(ARP_FRAME_LEN);
+	if (!reply) return 0;
+	arp_make_reply(reply, arp, dip, mac);
+	wifi_if_wifid_send_to_pdp(reply, ARP_FRAME_LEN);
+	return 1;
+}
+
+//Broadcasts in protocols the PDP11 doesn't speak. It has IP and ARP, and the NIC itself
+//understands the DEC protocols (MOP and friends, 60-xx) and Ethernet loopback.
+static int is_useless_broadcast(uint8_t *buffer) {
+	struct eth_hdr *eth=(struct eth_hdr*)buffer;
+	int type=ntohs(eth->type);
+	if (memcmp(&eth->dest, bcast_mac, 6)!=0) return 0;
+	if (type==ETHTYPE_IP || type==ETHTYPE_ARP) return 0;
+	if ((type&0xff00)==0x6000 || type==0x9000) return 0;
+	return 1;
+}
+
 //Because we have a split personality TCP/IP stack (both the PDP11 and the LWIP
 //stack think that they own the interface), we need to nicely divy up where we send
 //received packets.
 int wifi_if_filter_find_packet_dest(uint8_t *buffer, uint16_t len) {
 	struct eth_hdr *eth=(struct eth_hdr*)buffer;
 	if (ntohs(eth->type)==ETHTYPE_ARP) {
-		//Arp packet. We only let one stack respond to requests, but we send responses to
-		//all stacks.
-		struct etharp_hdr *arp=(struct etharp_hdr*)(buffer+sizeof(struct eth_hdr));
-		if (ntohs(arp->opcode)==ARP_REQUEST) {
-			return PACKET_DEST_PDP11;
-		} else {
-			return PACKET_DEST_PDP11|PACKET_DEST_LWIP;
-		}
+		//Arp packet. We only let one stack respond to requests (or answer them ourselves),
+		//but we send responses to all stacks.
+		return arp_from_network(buffer, len);
 	}
+	if (is_useless_broadcast(buffer)) return 0;
 	if (ntohs(eth->type)==ETHTYPE_IP || ntohs(eth->type)<1500) {
 		struct ip_hdr *iphdr=(struct ip_hdr*)(buffer+sizeof(struct eth_hdr));
 		if (IP_HDR_GET_VERSION(iphdr)==4) {
@@ -56,10 +241,11 @@ int wifi_if_filter_find_packet_dest(uint8_t *buffer, uint16_t len) {
 }
 
 //The wifid daemon on the PDP11 will use broadcast packets to port 67/68 to communicate with the WiFi
-//part of the simulator. Returns 1 if the packet should not be forwarded to the WiFi interface,
-//0 otherwise.
+//part of the simulator. ARP requests the ARP cache can answer also stay here. Returns 1 if the
+//packet should not be forwarded to the WiFi interface, 0 otherwise.
 int wifi_if_filter_pdp11_packet(uint8_t *buffer, uint16_t len) {
 	struct eth_hdr *eth=(struct eth_hdr*)buffer;
+	if (ntohs(eth->type)==ETHTYPE_ARP) return arp_from_pdp11(buffer, len);
 	if (ntohs(eth->type)==ETHTYPE_IP || ntohs(eth->type)<1500) {
 		struct ip_hdr *iphdr=(struct ip_hdr*)(buffer+sizeof(struct eth_hdr));
 		if (IP_HDR_GET_VERSION(iphdr)==4) {
@@ -6,3 +6,8 @@
 
 int wifi_if_filter_find_packet_dest(uint8_t *buffer, uint16_t len);
 int wifi_if_filter_pdp11_packet(uint8_t *buffer, uint16_t len);
+//Tells the filter the IP address the PDP11 got from wifid (network byte order). Only used
+//until the guest's own ARP traffic shows which address it really has.
+void wifi_if_filter_set_pdp_ip(const uint8_t *ip);
+//Forgets everything learned about the network, e.g. after losing the AP.
+void wifi_if_filter_forget();
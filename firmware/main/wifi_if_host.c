@@ -0,0 +1,145 @@
+/*
+'Wifi' interface for host emulation. Hands the wifi_if calls to one of a few network
+backends, selected with the ESPPDP_NET environment variable:
+
+ESPPDP_NET=tap[:ifname]          Linux tap interface (default; needs /dev/net/tun)
+ESPPDP_NET=pcap:in.pcap[,out.pcap]  replay in.pcap as received traffic, write what the
+                                 PDP11 sends to out.pcap
+ESPPDP_NET=echo                  answer ARP, ping and UDP from the PDP11 locally
+ESPPDP_NET=switch[:name]         plug into a virtual switch shared with other emulators
+
+The last three need no network or privileges, so they also work on CI machines.
+
+Like the packet filter on the ESP32, this takes the UDP packets the wifid program on the
+PDP11 sends to port 67/68 out of the stream and hands them to wifid.c, which talks to the
+stand-in WiFi in wifid_host.c. Its answers get to the PDP11 ahead of the backend's frames.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wifi_if.h"
+#include "wifid.h"
+
+static const wifi_if_backend_t *backends[]={
+	&wifi_if_backend_tap,
+	&wifi_if_backend_pcap,
+	&wifi_if_backend_echo,
+	&wifi_if_backend_switch,
+	NULL
+};
+
+static const wifi_if_backend_t *backend=NULL;
+static volatile wifi_if_rx_notify_t rx_notify_cb=NULL;
+//Packets from wifid.c. Both filled and emptied from the emulator thread.
+static pktring_t wifid_ring;
+
+//Finds the backend ESPPDP_NET asks for and returns it; *arg is set to its argument.
+static const wifi_if_backend_t *find_backend(const char **arg) {
+	const char *spec=getenv("ESPPDP_NET");
+	char name[32];
+	*arg=NULL;
+	if (spec==NULL || spec[0]==0) spec="tap";
+	const char *colon=strchr(spec, ':');
+	int nlen=colon?(colon-spec):strlen(spec);
+	if (nlen>=sizeof(name)) nlen=sizeof(name)-1;
+	memcpy(name, spec, nlen);
+	name[nlen]=0;
+	if (colon) *arg=colon+1;
+
+	for (int i=0; backends[i]; i++) {
+		if (strcmp(backends[i]->name, name)==0) return backends[i];
+	}
+	printf("ESPPDP_NET: unknown network backend '%s'. Known backends:\n", name);
+	for (int i=0; backends[i]; i++) printf("  %s\n", backends[i]->help);
+	exit(1);
+}
+
+void wifi_if_open() {
+	const char *arg;
+	pktbuf_init();
+	backend=find_backend(&arg);
+	if (backend->open(arg)!=0) {
+		printf("Could not open %s network backend.\n", backend->name);
+		exit(1);
+	}
+}
+
+void wifi_if_close() {
+	pktbuf_t *pb;
+	while ((pb=pktring_get(&wifid_ring))!=NULL) pktbuf_unref(pb);
+	if (backend) backend->close();
+	backend=NULL;
+}
+
+//Returns 1 if the packet is an IPv4 UDP packet to the wifid ports, and hands its payload
+//to wifid.c if so.
+static int wifid_filter(uint8_t *packet, int len) {
+	if (len<14+20 || packet[12]!=0x08 || packet[13]!=0x00) return 0;
+	uint8_t *ip=packet+14;
+	int ihl=(ip[0]&0xf)*4;
+	if ((ip[0]>>4)!=4 || ip[9]!=17 || len<14+ihl+8) return 0;
+	uint8_t *udp=ip+ihl;
+	int port=(udp[2]<<8)|udp[3];
+	if (port!=PORT_RECV && port!=PORT_SEND) return 0;
+	wifid_parse_packet(udp+8, len-(14+ihl+8));
+	return 1;
+}
+
+int wifi_if_write(uint8_t *packet, int len) {
+	if (!backend) return 0;
+	if (wifid_filter(packet, len)) return len;
+	return backend->write(packet, len);
+}
+
+pktbuf_t *wifi_if_read_buf() {
+	if (!backend) return NULL;
+	pktbuf_t *pb=pktring_get(&wifid_ring);
+	if (pb) return pb;
+	return backend->read_buf();
+}
+
+void wifi_if_wifid_send_to_pdp(void *buffer, uint16_t len) {
+	//injects a malloc()'ed packet for wifid into the packet stream to the pdp11
+	pktbuf_t *pb=(len<=PKTBUF_SIZE)?pktbuf_alloc():NULL;
+	if (pb) {
+		memcpy(pb->data, buffer, len);
+		pb->len=len;
+		if (!pktring_put(&wifid_ring, pb)) {
+			pktbuf_unref(pb);
+			printf("WiFi: wifid: rx queue full...\n");
+		}
+		wifi_if_rx_notify();
+	} else {
+		printf("WiFi: wifid: out of packet buffers\n");
+	}
+	free(buffer);
+}
+
+void wifi_if_set_rx_notify(wifi_if_rx_notify_t cb) {
+	rx_notify_cb=cb;
+}
+
+void wifi_if_rx_notify() {
+	wifi_if_rx_notify_t cb=rx_notify_cb;
+	if (cb) cb();
+}
+
+void wifi_if_get_mac(char *txtmac) {
+	const char *arg;
+	const wifi_if_backend_t *b=find_backend(&arg);
+	if (b->get_mac) {
+		b->get_mac(txtmac);
+	} else {
+		sprintf(txtmac, "11:22:33:44:55:66");
+	}
+}
@@ -0,0 +1,210 @@
+/*
+Reading and writing pcap files. The writer is used on both the ESP32 and the host to
+capture what goes in and out of the PDP11's NIC; the host build additionally has a
+network backend that feeds the PDP11 the frames from a capture file and records
+everything it sends in another one.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "wifi_if.h"
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_SNAPLEN 65535
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t network;
+} pcap_hdr_t;
+
+typedef struct {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+} pcap_rec_t;
+
+struct wifi_if_pcap {
+	FILE *f;
+};
+
+wifi_if_pcap_t *wifi_if_pcap_create(const char *path) {
+	pcap_hdr_t hdr={
+		.magic=PCAP_MAGIC,
+		.version_major=2,
+		.version_minor=4,
+		.snaplen=PCAP_SNAPLEN,
+		.network=PCAP_LINKTYPE_ETHERNET
+	};
+	FILE *f=fopen(path, "wb");
+	if (!f) {
+		printf("pcap: can't create %s\n", path);
+		return NULL;
+	}
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	wifi_if_pcap_t *p=calloc(1, sizeof(wifi_if_pcap_t));
+	p->f=f;
+	return p;
+}
+
+void wifi_if_pcap_frame(wifi_if_pcap_t *p, const uint8_t *frame, int len) {
+	struct timeval tv;
+	if (!p) return;
+	gettimeofday(&tv, NULL);
+	pcap_rec_t rec={
+		.ts_sec=tv.tv_sec,
+		.ts_usec=tv.tv_usec,
+		.incl_len=len,
+		.orig_len=len
+	};
+	fwrite(&rec, sizeof(rec), 1, p->f);
+	fwrite(frame, len, 1, p->f);
+	//The emulator usually stops by being killed or powered off; keep what we have on disk.
+	fflush(p->f);
+}
+
+void wifi_if_pcap_close(wifi_if_pcap_t *p) {
+	if (!p) return;
+	fclose(p->f);
+	free(p);
+}
+
+#ifndef ESP_PLATFORM
+
+/*
+Replay backend. Received frames are handed out as fast as the NIC asks for them, without
+regard for the timestamps in the file, so a capture of a bulk transfer can be used to see
+how fast the emulated NIC and guest network stack can take it in. Once the file runs out
+the network just goes quiet.
+*/
+
+static FILE *rx_file=NULL;
+static int rx_swapped=0;
+static wifi_if_pcap_t *tx_pcap=NULL;
+static long rx_frames=0, tx_frames=0;
+
+static uint32_t pcap_u32(uint32_t v) {
+	if (!rx_swapped) return v;
+	return (v>>24)|((v>>8)&0xff00)|((v<<8)&0xff0000)|(v<<24);
+}
+
+//arg is "in.pcap[,out.pcap]"
+static int pcap_open(const char *arg) {
+	char inpath[256];
+	const char *outpath=NULL;
+	pcap_hdr_t hdr;
+	if (!arg || !arg[0]) {
+		printf("pcap backend needs a capture file to read, e.g. ESPPDP_NET=pcap:in.pcap\n");
+		return -1;
+	}
+	const char *comma=strchr(arg, ',');
+	int len=comma?(comma-arg):strlen(arg);
+	if (len>=sizeof(inpath)) len=sizeof(inpath)-1;
+	memcpy(inpath, arg, len);
+	inpath[len]=0;
+	if (comma) outpath=comma+1;
+
+	rx_file=fopen(inpath, "rb");
+	if (!rx_file) {
+		perror(inpath);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, rx_file)!=1) {
+		printf("%s: not a pcap file\n", inpath);
+		fclose(rx_file);
+		return -1;
+	}
+	rx_swapped=(hdr.magic!=PCAP_MAGIC && hdr.magic!=PCAP_MAGIC_NSEC);
+	if (rx_swapped && pcap_u32(hdr.magic)!=PCAP_MAGIC && pcap_u32(hdr.magic)!=PCAP_MAGIC_NSEC) {
+		printf("%s: not a pcap file\n", inpath);
+		fclose(rx_file);
+		return -1;
+	}
+	if (pcap_u32(hdr.network)!=PCAP_LINKTYPE_ETHERNET) {
+		printf("%s: not an Ethernet capture (link type %u)\n", inpath, pcap_u32(hdr.network));
+		fclose(rx_file);
+		return -1;
+	}
+	if (outpath && outpath[0]) {
+		tx_pcap=wifi_if_pcap_create(outpath);
+		if (!tx_pcap) {
+			fclose(rx_file);
+			return -1;
+		}
+	}
+	printf("pcap: replaying %s%s%s\n", inpath, tx_pcap?", writing sent frames to ":"", tx_pcap?outpath:"");
+	//The whole capture is ready to be received; don't wait for the fallback poll to find out
+	wifi_if_rx_notify();
+	return 0;
+}
+
+static void pcap_close() {
+	printf("pcap: %ld frames replayed, %ld sent\n", rx_frames, tx_frames);
+	if (rx_file) fclose(rx_file);
+	rx_file=NULL;
+	wifi_if_pcap_close(tx_pcap);
+	tx_pcap=NULL;
+}
+
+static int pcap_write(uint8_t *packet, int len) {
+	tx_frames++;
+	wifi_if_pcap_frame(tx_pcap, packet, len);
+	return len;
+}
+
+static pktbuf_t *pcap_read_buf() {
+	pcap_rec_t rec;
+	pktbuf_t *pb;
+	if (!rx_file) return NULL;
+	pb=pktbuf_alloc();
+	if (!pb) return NULL;
+	while (fread(&rec, sizeof(rec), 1, rx_file)==1) {
+		uint32_t len=pcap_u32(rec.incl_len);
+		//Frames that don't fit a packet buffer can't have come off an Ethernet; skip them
+		if (len>PKTBUF_SIZE) {
+			fseek(rx_file, len, SEEK_CUR);
+			continue;
+		}
+		if (fread(pb->data, 1, len, rx_file)!=len) break;
+		pb->len=len;
+		rx_frames++;
+		//There's more where this came from
+		wifi_if_rx_notify();
+		return pb;
+	}
+	//end of file
+	fclose(rx_file);
+	rx_file=NULL;
+	pktbuf_unref(pb);
+	printf("pcap: end of capture after %ld frames\n", rx_frames);
+	return NULL;
+}
+
+const wifi_if_backend_t wifi_if_backend_pcap={
+	.name="pcap",
+	.help="pcap:in.pcap[,out.pcap]  replay in.pcap as rx traffic, save tx traffic in out.pcap",
+	.open=pcap_open,
+	.close=pcap_close,
+	.write=pcap_write,
+	.read_buf=pcap_read_buf,
+};
+
+#endif
@@ -0,0 +1,360 @@
+/*
+Virtual Ethernet switch backend for the host build. Any number of emulators (up to
+SW_PORTS) that use the same switch name get plugged into one learning L2 switch that lives
+in a POSIX shared memory segment, so several PDP11s can talk to each other without a tap
+device, root or any traffic on the host network:
+
+ESPPDP_NET=switch[:name]
+
+Each emulator owns one port. A port has a ring of frame slots that the other ports write
+into and the owner reads from. Sending a frame copies it into the slot of the port(s) it
+goes to; receiving copies it out into a pool buffer; no system calls are involved unless
+the receiving side is asleep. Like a real switch, it learns which MAC lives on which port
+from the source addresses of the frames that pass, and floods broadcasts, multicasts and
+frames for unknown addresses to every other port.
+
+The shared memory segment (/dev/shm/esppdp-switch-<name>) outlives the emulators; ports of
+emulators that died without closing are reclaimed when another one connects.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wifi_if.h"
+
+#define SW_MAGIC 0x50445357		//'PDSW'
+#define SW_VERSION 1
+#define SW_PORTS 8
+#define SW_RING_SLOTS 64		//must be a power of two
+#define SW_MACS 64
+
+typedef struct {
+	uint32_t len;
+	uint8_t data[PKTBUF_SIZE];
+} sw_slot_t;
+
+typedef struct {
+	pthread_mutex_t lock;		//serializes the senders to this port
+	pthread_cond_t cond;		//wakes up the owner's reader thread
+	pid_t pid;					//owner, 0 if the port is free
+	uint32_t head;				//written by senders, under lock
+	uint32_t tail;				//written by the owner
+	uint32_t seq;				//bumped for every frame put in the ring
+	uint32_t dropped;			//frames lost because the ring was full
+	sw_slot_t slot[SW_RING_SLOTS];
+} sw_port_t;
+
+typedef struct {
+	uint8_t mac[6];
+	int16_t port;				//-1 if the entry is unused
+	uint32_t seen;				//switch clock when last seen as a source
+} sw_mac_t;
+
+typedef struct {
+	uint32_t magic;				//set last, once everything else is initialized
+	uint32_t version;
+	uint32_t size;
+	pthread_mutex_t lock;		//port allocation and the MAC table
+	uint32_t clock;
+	sw_mac_t macs[SW_MACS];
+	sw_port_t port[SW_PORTS];
+} sw_shm_t;
+
+static sw_shm_t *sw=NULL;
+static int my_port=-1;
+static char shm_name[64];
+static pthread_t notify_thread;
+static volatile int notify_running=0;
+static long tx_frames, rx_frames, flooded;
+
+//Mutexes are robust: an emulator that gets killed while holding one doesn't take the
+//whole switch down with it.
+static void sw_lock(pthread_mutex_t *m) {
+	if (pthread_mutex_lock(m)==EOWNERDEAD) pthread_mutex_consistent(m);
+}
+
+static void sw_unlock(pthread_mutex_t *m) {
+	pthread_mutex_unlock(m);
+}
+
+static void sw_init_mutex(pthread_mutex_t *m) {
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(m, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static void sw_init(sw_shm_t *s) {
+	pthread_condattr_t cattr;
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	memset(s, 0, sizeof(sw_shm_t));
+	s->version=SW_VERSION;
+	s->size=sizeof(sw_shm_t);
+	sw_init_mutex(&s->lock);
+	for (int i=0; i<SW_MACS; i++) s->macs[i].port=-1;
+	for (int i=0; i<SW_PORTS; i++) {
+		sw_init_mutex(&s->port[i].lock);
+		pthread_cond_init(&s->port[i].cond, &cattr);
+	}
+	pthread_condattr_destroy(&cattr);
+	__atomic_store_n(&s->magic, SW_MAGIC, __ATOMIC_RELEASE);
+}
+
+static sw_shm_t *sw_map(const char *name) {
+	int created=1;
+	int fd=shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+	if (fd<0 && errno==EEXIST) {
+		created=0;
+		fd=shm_open(name, O_RDWR, 0600);
+	}
+	if (fd<0) {
+		perror(name);
+		return NULL;
+	}
+	if (created && ftruncate(fd, sizeof(sw_shm_t))!=0) {
+		perror("ftruncate");
+		close(fd);
+		return NULL;
+	}
+	//Whoever created the segment may still be setting it up
+	struct stat st;
+	for (int i=0; i<100 && fstat(fd, &st)==0 && st.st_size<sizeof(sw_shm_t); i++) usleep(10000);
+	if (fstat(fd, &st)!=0 || st.st_size!=sizeof(sw_shm_t)) {
+		printf("switch: %s has the wrong size; is it from another version? Remove /dev/shm%s.\n", name, name);
+		close(fd);
+		return NULL;
+	}
+	sw_shm_t *s=mmap(NULL, sizeof(sw_shm_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s==MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	if (created) {
+		sw_init(s);
+	} else {
+		for (int i=0; i<100 && __atomic_load_n(&s->magic, __ATOMIC_ACQUIRE)!=SW_MAGIC; i++) usleep(10000);
+		if (s->magic!=SW_MAGIC || s->version!=SW_VERSION || s->size!=sizeof(sw_shm_t)) {
+			printf("switch: %s is not usable; remove /dev/shm%s.\n", name, name);
+			munmap(s, sizeof(sw_shm_t));
+			return NULL;
+		}
+	}
+	return s;
+}
+
+//Needs the switch lock
+static void sw_forget_port(int port) {
+	for (int i=0; i<SW_MACS; i++) {
+		if (sw->macs[i].port==port) sw->macs[i].port=-1;
+	}
+}
+
+//Needs the switch lock; other emulators rewrite entries under it
+static int sw_find_mac(const uint8_t *mac) {
+	for (int i=0; i<SW_MACS; i++) {
+		if (sw->macs[i].port>=0 && memcmp(sw->macs[i].mac, mac, 6)==0) return i;
+	}
+	return -1;
+}
+
+//Needs the switch lock
+static void sw_learn(const uint8_t *mac) {
+	if (mac[0]&1) return; //multicast source addresses are bogus
+	int i=sw_find_mac(mac);
+	if (i<0) {
+		//take a free entry, or else the one that was quiet the longest
+		uint32_t oldest=0;
+		for (int j=0; j<SW_MACS; j++) {
+			if (sw->macs[j].port<0) {
+				i=j;
+				break;
+			}
+			if (i<0 || sw->clock-sw->macs[j].seen>oldest) {
+				i=j;
+				oldest=sw->clock-sw->macs[j].seen;
+			}
+		}
+		memcpy(sw->macs[i].mac, mac, 6);
+	}
+	sw->macs[i].port=my_port; //also handles a host that moved to another port
+	sw->macs[i].seen=++sw->clock;
+}
+
+static void sw_deliver(int port, const uint8_t *packet, int len) {
+	sw_port_t *p=&sw->port[port];
+	sw_lock(&p->lock);
+	if (p->pid!=0) {
+		uint32_t tail=__atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+		if (p->head-tail>=SW_RING_SLOTS) {
+			p->dropped++;
+		} else {
+			sw_slot_t *slot=&p->slot[p->head&(SW_RING_SLOTS-1)];
+			memcpy(slot->data, packet, len);
+			slot->len=len;
+			__atomic_store_n(&p->head, p->head+1, __ATOMIC_RELEASE);
+			p->seq++;
+			pthread_cond_signal(&p->cond);
+		}
+	}
+	sw_unlock(&p->lock);
+}
+
+//Waits for frames to arrive in our port and tells the emulator about them
+static void *sw_notify_thread(void *arg) {
+	sw_port_t *p=&sw->port[my_port];
+	uint32_t seen;
+	struct timespec ts;
+	sw_lock(&p->lock);
+	seen=p->seq;
+	while (notify_running) {
+		if (p->seq==seen) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_nsec+=100000000;
+			if (ts.tv_nsec>=1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec-=1000000000;
+			}
+			if (pthread_cond_timedwait(&p->cond, &p->lock, &ts)==EOWNERDEAD) pthread_mutex_consistent(&p->lock);
+			continue;
+		}
+		seen=p->seq;
+		sw_unlock(&p->lock);
+		wifi_if_rx_notify();
+		sw_lock(&p->lock);
+	}
+	sw_unlock(&p->lock);
+	return NULL;
+}
+
+//arg is the name of the switch, 'default' if not given
+static int switch_open(const char *arg) {
+	snprintf(shm_name, sizeof(shm_name), "/esppdp-switch-%s", (arg && arg[0])?arg:"default");
+	sw=sw_map(shm_name);
+	if (!sw) return -1;
+
+	sw_lock(&sw->lock);
+	for (int i=0; i<SW_PORTS; i++) {
+		sw_port_t *p=&sw->port[i];
+		if (p->pid!=0 && kill(p->pid, 0)!=0 && errno==ESRCH) {
+			printf("switch: reclaiming port %d of dead process %d\n", i, (int)p->pid);
+			sw_forget_port(i);
+			p->pid=0;
+		}
+		if (p->pid==0 && my_port<0) my_port=i;
+	}
+	if (my_port>=0) {
+		sw_port_t *p=&sw->port[my_port];
+		sw_lock(&p->lock);
+		p->head=p->tail=p->seq=p->dropped=0;
+		p->pid=getpid();
+		sw_unlock(&p->lock);
+	}
+	sw_unlock(&sw->lock);
+	if (my_port<0) {
+		printf("switch: all %d ports of %s are in use\n", SW_PORTS, shm_name);
+		munmap(sw, sizeof(sw_shm_t));
+		sw=NULL;
+		return -1;
+	}
+	notify_running=1;
+	pthread_create(&notify_thread, NULL, sw_notify_thread, NULL);
+	printf("Network: port %d of virtual switch %s\n", my_port, shm_name);
+	return 0;
+}
+
+static void switch_close() {
+	if (!sw) return;
+	sw_port_t *p=&sw->port[my_port];
+	if (notify_running) {
+		notify_running=0;
+		sw_lock(&p->lock);
+		pthread_cond_broadcast(&p->cond);
+		sw_unlock(&p->lock);
+		pthread_join(notify_thread, NULL);
+	}
+	printf("Network: switch port %d: %ld frames sent (%ld flooded), %ld received, %u dropped\n",
+			my_port, tx_frames, flooded, rx_frames, p->dropped);
+	sw_lock(&sw->lock);
+	sw_forget_port(my_port);
+	sw_lock(&p->lock);
+	p->pid=0;
+	sw_unlock(&p->lock);
+	sw_unlock(&sw->lock);
+	munmap(sw, sizeof(sw_shm_t));
+	sw=NULL;
+	my_port=-1;
+}
+
+static int switch_write(uint8_t *packet, int len) {
+	if (len<14 || len>PKTBUF_SIZE) return 0;
+	tx_frames++;
+	sw_lock(&sw->lock);
+	sw_learn(packet+6);
+	int i=(packet[0]&1)?-1:sw_find_mac(packet);
+	int port=(i>=0)?sw->macs[i].port:-1;
+	sw_unlock(&sw->lock);
+	if (port>=0) {
+		//known unicast address; it being on our own port means nobody else wants it
+		if (port!=my_port) sw_deliver(port, packet, len);
+	} else {
+		flooded++;
+		for (int j=0; j<SW_PORTS; j++) {
+			if (j!=my_port && sw->port[j].pid!=0) sw_deliver(j, packet, len);
+		}
+	}
+	return len;
+}
+
+static pktbuf_t *switch_read_buf() {
+	if (!sw) return NULL;
+	sw_port_t *p=&sw->port[my_port];
+	uint32_t tail=p->tail;
+	if (__atomic_load_n(&p->head, __ATOMIC_ACQUIRE)==tail) return NULL;
+	pktbuf_t *pb=pktbuf_alloc();
+	if (!pb) return NULL; //leave it in the ring until the emulator frees up a buffer
+	sw_slot_t *slot=&p->slot[tail&(SW_RING_SLOTS-1)];
+	memcpy(pb->data, slot->data, slot->len);
+	pb->len=slot->len;
+	__atomic_store_n(&p->tail, tail+1, __ATOMIC_RELEASE);
+	rx_frames++;
+	return pb;
+}
+
+//Emulators on the same switch each need their own MAC; make one up from the process id,
+//as a locally administered address.
+static void switch_get_mac(char *txtmac) {
+	uint32_t pid=getpid();
+	sprintf(txtmac, "02:50:44:%02X:%02X:%02X", (pid>>16)&0xff, (pid>>8)&0xff, pid&0xff);
+}
+
+const wifi_if_backend_t wifi_if_backend_switch={
+	.name="switch",
+	.help="switch[:name]  virtual Ethernet switch shared with other emulators (default 'default')",
+	.open=switch_open,
+	.close=switch_close,
+	.write=switch_write,
+	.read_buf=switch_read_buf,
+	.get_mac=switch_get_mac,
+};
@@ -1,12 +1,14 @@
 /*
 'Wifi' interface for host emulation. Uses a tap to shuttle the Ethernet packets out on.
+Like the WiFi rx callback on the ESP32, a separate thread reads frames from the tap into
+pool buffers and hands them to the emulator through the rx ring.
 */
 /*
  * ----------------------------------------------------------------------------
  * "THE BEER-WARE LICENSE" (Revision 42):
- * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain 
- * this notice you can do whatever you want with this stuff. If we meet some day, 
- * and you think this stuff is worth it, you can buy me a beer in return. 
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
  * ----------------------------------------------------------------------------
  */
 
@@ -14,7 +16,6 @@
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <stdio.h>
-#include <sys/select.h>
 #include "hexdump.h"
 #include "wifi_if.h"
 #include <unistd.h>
@@ -22,70 +23,107 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+#include <pthread.h>
 
-int openTun(const char *name) {
+//#define DBG_DUMP_PACKETS
+
+static int openTun(const char *name) {
 	struct ifreq ifr;
 	int fd, r;
 	memset(&ifr, 0, sizeof(ifr));
 	ifr.ifr_flags=IFF_TAP|IFF_NO_PI;
-	strcpy(ifr.ifr_name, name);
+	strncpy(ifr.ifr_name, name, IFNAMSIZ-1);
 	fd=open("/dev/net/tun", O_RDWR);
-	if (fd<=0) {
+	if (fd<0) {
 		perror("/dev/net/tun");
-		exit(1);
+		return -1;
 	}
 	r=ioctl(fd, TUNSETIFF, (void*)&ifr);
 	if (r) {
 		perror("TUNSETIFF");
-		exit(1);
+		close(fd);
+		return -1;
 	}
 	if(ioctl(fd, TUNSETPERSIST, 1) < 0){
 		perror("enabling TUNSETPERSIST");
-		exit(1);
+		close(fd);
+		return -1;
 	}
 	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 	return fd;
 }
 
-static int tapfd=0;
+static int tapfd=-1;
+static pktring_t rxring;
+static pthread_t rx_thread;
+static volatile int rx_running=0;
+
+static void *tap_rx_thread(void *arg) {
+	struct pollfd pfd={.fd=tapfd, .events=POLLIN};
+	pktbuf_t *pb=NULL;
+	while (rx_running) {
+		if (poll(&pfd, 1, 100)<=0) continue;
+		if (!pb) pb=pktbuf_alloc();
+		if (!pb) {
+			//pool used up; the emulator will hand buffers back eventually
+			usleep(1000);
+			continue;
+		}
+		int len=read(tapfd, pb->data, PKTBUF_SIZE);
+		if (len<=0) continue;
+#ifdef DBG_DUMP_PACKETS
+		printf("Read from tap:\n");
+		hexdump(pb->data, len);
+#endif
+		pb->len=len;
+		if (pktring_put(&rxring, pb)) {
+			pb=NULL;
+		} else {
+			printf("Tap: rx queue full...\n"); //re-use pb for the next frame
+		}
+		wifi_if_rx_notify();
+	}
+	pktbuf_unref(pb);
+	return NULL;
+}
 
-void wifi_if_open() {
-	tapfd=openTun("pdptap");
+//arg is the name of the tap interface, pdptap by default
+static int tap_open(const char *arg) {
+	tapfd=openTun(arg?arg:"pdptap");
+	if (tapfd<0) return -1;
 	printf("Tap device opened.\n");
+	rx_running=1;
+	pthread_create(&rx_thread, NULL, tap_rx_thread, NULL);
+	return 0;
 }
 
-void wifi_if_close() {
-	close(tapfd);
+static void tap_close() {
+	if (rx_running) {
+		rx_running=0;
+		pthread_join(rx_thread, NULL);
+	}
+	if (tapfd>=0) close(tapfd);
+	tapfd=-1;
 }
 
-int wifi_if_write(uint8_t *packet, int len) {
+static int tap_write(uint8_t *packet, int len) {
+#ifdef DBG_DUMP_PACKETS
 	printf("Writing to tap:\n");
 	hexdump(packet, len);
+#endif
 	return write(tapfd, packet, len);
 }
 
-/*
-00000000  00 00 08 06 ff ff ff ff  ff ff a6 0f 06 0c 67 94  |..............g.|
-00000010  08 06 00 01 08 00 06 04  00 01 a6 0f 06 0c 67 94  |..............g.|
-00000020  ce 8b ca 01 00 00 00 00  00 00 ce 8b ca c9        |..............|
-0000002e
-*/
-
-int wifi_if_read(uint8_t *packet, int maxlen) {
-	fd_set rfds;
-	FD_ZERO(&rfds);
-	FD_SET(tapfd, &rfds);
-	struct timeval timeout={};
-	int r=select(tapfd+1, &rfds, NULL, NULL, &timeout);
-	if (r) {
-		int len=read(tapfd, packet, maxlen);
-		printf("Read from tap:\n");
-		hexdump(packet, len);
-		return len;
-	}
-	return 0;
+static pktbuf_t *tap_read_buf() {
+	return pktring_get(&rxring);
 }
 
-void wifi_if_get_mac(char *txtmac) {
-	sprintf(txtmac, "11:22:33:44:55:66");
-}
+const wifi_if_backend_t wifi_if_backend_tap={
+	.name="tap",
+	.help="tap[:ifname]  bridge to a Linux tap interface (default pdptap)",
+	.open=tap_open,
+	.close=tap_close,
+	.write=tap_write,
+	.read_buf=tap_read_buf,
+};
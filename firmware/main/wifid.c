@@ -2,84 +2,89 @@
 /*
  * ----------------------------------------------------------------------------
  * "THE BEER-WARE LICENSE" (Revision 42):
- * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain 
- * this notice you can do whatever you want with this stuff. If we meet some day, 
- * and you think this stuff is worth it, you can buy me a beer in return. 
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
  * ----------------------------------------------------------------------------
  */
 
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "lwip/prot/ethernet.h"
-#include "lwip/prot/ieee.h"
-#include "lwip/prot/etharp.h"
-#include "lwip/prot/ip.h"
-#include "lwip/prot/ip4.h"
-#include "lwip/ip4_addr.h"
-#include "lwip/inet_chksum.h"
-#include "lwip/prot/udp.h"
+#ifdef ESP_PLATFORM
 #include <esp_wifi.h>
-#include "wifid.h"
 #include "esp_netif_ip_addr.h"
 #include "esp_netif_types.h"
+#endif
+#include "wifid.h"
 #include "wifid_iface.h"
 #include "wifi_if.h"
 #include "hexdump.h"
+#include "chksum.h"
+
+//The packets to wifid are built by hand rather than with the lwip structs, so this file
+//also builds for the host, where wifid_host.c stands in for the ESP WiFi API.
+#define ETH_HDR_LEN 14
+#define IP_HDR_LEN 20
+#define UDP_HDR_LEN 8
+#define WIFID_HDR_LEN (ETH_HDR_LEN+IP_HDR_LEN+UDP_HDR_LEN)
 
-#define WIFID_EVENT_ETHER_PKT_SZ (sizeof(struct eth_hdr)+sizeof(struct ip_hdr)+sizeof(struct udp_hdr)+sizeof(wifid_event_t))
+static void put16(uint8_t *p, uint16_t v) {
+	p[0]=v>>8;
+	p[1]=v;
+}
 
-static wifid_event_t *prepare_return_packet(char **pkt) {
-	char *buffer=calloc(WIFID_EVENT_ETHER_PKT_SZ, 1);
+//Allocates a broadcast UDP packet to wifid with room for a payload of len bytes, and
+//returns a pointer to the payload.
+static void *prepare_return_packet(char **pkt, int len) {
+	uint8_t *buffer=calloc(WIFID_HDR_LEN+len, 1);
 	if (!buffer) return NULL;
-	struct eth_hdr *eth=(struct eth_hdr*)buffer;
-	memset(eth->dest.addr, 0xff, ETH_HWADDR_LEN); //bcast addr
-	memset(eth->src.addr, 0xAA, ETH_HWADDR_LEN); //src addr, not really relevant
-	eth->type=lwip_htons(0x0800); //ipv4
-	struct ip_hdr *iphdr=(struct ip_hdr*)(buffer+sizeof(struct eth_hdr));
-	IPH_VHL_SET(iphdr, 4, sizeof(struct ip_hdr) / 4);
-	IPH_TOS_SET(iphdr, 0);
-	IPH_LEN_SET(iphdr, lwip_htons(sizeof(struct ip_hdr)+sizeof(struct udp_hdr)+sizeof(wifid_event_t)));
-	IPH_OFFSET_SET(iphdr, 0);
-	IPH_TTL_SET(iphdr, 255);
-	IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
-	IP4_ADDR(&iphdr->src, 192,168,254,254); //'from nowhere'
-	IP4_ADDR(&iphdr->dest, 255,255,255,255);
-	IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, sizeof(struct ip_hdr)));
-	struct udp_hdr *uh=(struct udp_hdr*)(buffer+sizeof(struct eth_hdr)+sizeof(struct ip_hdr));
-	uh->chksum=0;
-	uh->dest=lwip_htons(PORT_RECV); //src/dst inverted as we send stuff _to_ wifid
-	uh->src=lwip_htons(PORT_SEND);
-	uh->len=lwip_htons(sizeof(struct udp_hdr)+sizeof(wifid_event_t));
-	*pkt=buffer;
-	return (wifid_event_t*)(buffer+sizeof(struct eth_hdr)+sizeof(struct ip_hdr)+sizeof(struct udp_hdr));
+	memset(buffer, 0xff, 6); //bcast addr
+	memset(buffer+6, 0xAA, 6); //src addr, not really relevant
+	put16(buffer+12, 0x0800); //ipv4
+	uint8_t *iphdr=buffer+ETH_HDR_LEN;
+	iphdr[0]=0x45; //v4, no options
+	put16(iphdr+2, IP_HDR_LEN+UDP_HDR_LEN+len);
+	iphdr[8]=255; //ttl
+	iphdr[9]=17; //udp
+	memcpy(iphdr+12, "\xC0\xA8\xFE\xFE", 4); //192.168.254.254, 'from nowhere'
+	memset(iphdr+16, 0xff, 4);
+	put16(iphdr+10, chksum_inet(iphdr, IP_HDR_LEN));
+	uint8_t *uh=iphdr+IP_HDR_LEN;
+	put16(uh, PORT_SEND); //src/dst inverted as we send stuff _to_ wifid
+	put16(uh+2, PORT_RECV);
+	put16(uh+4, UDP_HDR_LEN+len);
+	//udp checksum stays 0, meaning 'none'
+	*pkt=(char*)buffer;
+	return buffer+WIFID_HDR_LEN;
 }
 
-static void send_return_packet(char *ethpkt) {
-	wifi_if_wifid_send_to_pdp(ethpkt, WIFID_EVENT_ETHER_PKT_SZ);
+//Sends (and frees) a packet from prepare_return_packet; len is the payload length.
+static void send_return_packet(char *ethpkt, int len) {
+	wifi_if_wifid_send_to_pdp(ethpkt, WIFID_HDR_LEN+len);
 }
 
 static void send_error_msg(const char *err) {
 	char *resp_pkt;
-	wifid_event_t *wev=prepare_return_packet(&resp_pkt);
+	wifid_event_t *wev=prepare_return_packet(&resp_pkt, sizeof(wifid_event_t));
+	if (!wev) return;
 	wev->resp=EV_ERROR;
-	strcpy(wev->error.msg, err);
-	send_return_packet(resp_pkt);
+	strncpy(wev->error.msg, err, sizeof(wev->error.msg)-1);
+	send_return_packet(resp_pkt, sizeof(wifid_event_t));
 }
 
-void wifid_signal_connected(esp_netif_t *netif, esp_netif_ip_info_t *ip) {
+void wifid_signal_got_ip(const uint8_t *ip, const uint8_t *netmask, const uint8_t *gw, const uint8_t dns[3][4]) {
 	char *resp_pkt;
 	printf("wifid: signal connected\n");
-	wifid_event_t *wev=prepare_return_packet(&resp_pkt);
+	wifid_event_t *wev=prepare_return_packet(&resp_pkt, sizeof(wifid_event_t));
+	if (!wev) return;
 	wev->resp=EV_GOT_IP;
-	memcpy(&wev->connected.ip, &ip->ip.addr, 4);
-	memcpy(&wev->connected.netmask, &ip->netmask.addr, 4);
-	memcpy(&wev->connected.gw, &ip->gw.addr, 4);
-	esp_netif_dns_info_t dns[3]={};
-	esp_netif_get_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns[0]);
-	esp_netif_get_dns_info(netif, ESP_NETIF_DNS_BACKUP, &dns[1]);
-	esp_netif_get_dns_info(netif, ESP_NETIF_DNS_FALLBACK, &dns[2]);
-	for (int i=0; i<3; i++) memcpy(&wev->connected.nameserver[i], &dns[i].ip, 4);
-	send_return_packet(resp_pkt);
+	memcpy(&wev->connected.ip, ip, 4);
+	memcpy(&wev->connected.netmask, netmask, 4);
+	memcpy(&wev->connected.gw, gw, 4);
+	for (int i=0; i<3; i++) memcpy(&wev->connected.nameserver[i], dns[i], 4);
+	send_return_packet(resp_pkt, sizeof(wifid_event_t));
 }
 
 static int send_error_on_disconnect=0;
@@ -88,23 +93,59 @@ void wifid_signal_noconnect() {
 	if (send_error_on_disconnect) send_error_msg("Couldn't connect to AP");
 }
 
-void wifid_signal_scan_done() {
+//Set by whichever scan command started the current scan.
+static int scan_batched=0;
+
+//Legacy (CMD_SCAN) results: one packet per AP, and nothing at all if there are none.
+static void send_scan_results_single(const wifid_ap_t *aps, int ap_count) {
 	char *resp_pkt;
-	uint16_t ap_count;
-	ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
-	printf("Scan done, %d results.\n", (int)ap_count);
-	wifi_ap_record_t *ap_info=calloc(sizeof(wifi_ap_record_t), ap_count);
-	ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&ap_count, ap_info));
 	for (int i=0; i<ap_count; i++) {
-		wifid_event_t *wev=prepare_return_packet(&resp_pkt);
+		wifid_event_t *wev=prepare_return_packet(&resp_pkt, sizeof(wifid_event_t));
+		if (!wev) return;
 		wev->resp=(i==ap_count-1)?EV_SCAN_RES_END:EV_SCAN_RES;
-		memcpy(wev->scan_res.ssid, ap_info[i].ssid, 32);
-		wev->scan_res.rssi=ap_info[i].rssi;
-		wev->scan_res.authmode=ap_info[i].authmode;
-		printf("%d/%d\n", i, (int)ap_count);
-		send_return_packet(resp_pkt);
+		memcpy(wev->scan_res.ssid, aps[i].ssid, 32);
+		wev->scan_res.rssi=aps[i].rssi;
+		wev->scan_res.authmode=aps[i].authmode;
+		printf("%d/%d\n", i, ap_count);
+		send_return_packet(resp_pkt, sizeof(wifid_event_t));
+#ifdef ESP_PLATFORM
 		vTaskDelay(2);
+#endif
+	}
+}
+
+//CMD_SCAN_BATCH results: WIFID_SCAN_BATCH_MAX APs per packet, so a typical scan fits in
+//one or two packets that can go out back to back. There's always at least one packet, so
+//an empty scan result also ends the scan on the wifid side.
+static void send_scan_results_batched(const wifid_ap_t *aps, int ap_count) {
+	char *resp_pkt;
+	int pos=0;
+	do {
+		int n=ap_count-pos;
+		if (n>WIFID_SCAN_BATCH_MAX) n=WIFID_SCAN_BATCH_MAX;
+		int len=WIFID_SCAN_BATCH_LEN(n);
+		wifid_scan_batch_t *b=prepare_return_packet(&resp_pkt, len);
+		if (!b) return;
+		b->resp=EV_SCAN_BATCH;
+		b->version=WIFID_PROTO_VERSION;
+		b->count=n;
+		b->last=(pos+n==ap_count);
+		if (n) memcpy(b->ap, &aps[pos], n*sizeof(wifid_ap_t));
+		send_return_packet(resp_pkt, len);
+		pos+=n;
+	} while (pos<ap_count);
+}
+
+void wifid_signal_scan_done() {
+	wifid_ap_t *aps=NULL;
+	int ap_count=wifid_plat_scan_results(&aps);
+	printf("Scan done, %d results.\n", ap_count);
+	if (scan_batched) {
+		send_scan_results_batched(aps, ap_count);
+	} else {
+		send_scan_results_single(aps, ap_count);
 	}
+	free(aps);
 }
 
 //Called when a packet from the PDP11 generated by wifid is called
@@ -112,41 +153,79 @@ void wifid_parse_packet(uint8_t *buffer, int len) {
 	printf("wifid_parse_packet:\n");
 	hexdump(buffer, len);
 	wifid_cmd_t *wcmd=(wifid_cmd_t*)(buffer);
-	if (wcmd->cmd == CMD_SCAN) {
-		printf("WiFiD: Got SCAN commmand\n");
-		esp_err_t r=esp_wifi_scan_start(NULL, false);
-		if (r!=ESP_OK) {
-			send_error_msg(esp_err_to_name(r));
-		}
-		//will generate WIFI_EVENT_SCAN_DONE event when done
+	if (wcmd->cmd == CMD_SCAN || wcmd->cmd == CMD_SCAN_BATCH) {
+		printf("WiFiD: Got SCAN%s commmand\n", (wcmd->cmd==CMD_SCAN_BATCH)?"_BATCH":"");
+		scan_batched=(wcmd->cmd==CMD_SCAN_BATCH);
+		const char *err=wifid_plat_scan_start();
+		if (err) send_error_msg(err);
+		//will call wifid_signal_scan_done when done
 	} else if (wcmd->cmd == CMD_CONNECT) {
 		printf("WiFiD: Got CONNECT commmand: SSID `%s` pass `%s`\n", wcmd->connect.ssid, wcmd->connect.pass);
-		wifi_config_t wifi_cfg = {};
-		strncpy((char*)wifi_cfg.sta.ssid, wcmd->connect.ssid, sizeof(wifi_cfg.sta.ssid));
-		strncpy((char*)wifi_cfg.sta.password, wcmd->connect.pass, sizeof(wifi_cfg.sta.password));
-		wifi_cfg.sta.pmf_cfg.capable = true;
-		wifi_cfg.sta.pmf_cfg.required = false;
-		esp_err_t r=esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_cfg);
-		if (r==ESP_OK) {
-			send_error_on_disconnect=0;
-			wifi_if_ena_auto_reconnect(0);
-			esp_wifi_disconnect();
-			vTaskDelay(1000/portTICK_PERIOD_MS); //hacky, should perhaps use a callback from the disconnect event?
-			printf("connect\n");
-			wifi_if_ena_auto_reconnect(1);
-			send_error_on_disconnect=1;
-			r=esp_wifi_connect();
-		}
-		if (r!=ESP_OK) {
-			send_error_msg(esp_err_to_name(r));
-		}
-		//will generate IP_EVENT_STA_GOT_IP when done
+		const char *err=wifid_plat_connect(wcmd->connect.ssid, wcmd->connect.pass);
+		if (err) send_error_msg(err);
+		//will call wifid_signal_got_ip when done
 	} else if (wcmd->cmd == CMD_QUIT) {
 		//Ignore, we aren't the one needing to quit here.
 	} else {
-		printf("WiFiD: Got unknown commmand %d\n", wcmd->cmd);
+		printf("WiFiD: Got unknown commmand %d\n", (int)wcmd->cmd);
 		char buff[32];
-		sprintf(buff, "Unknown cmd %d", wcmd->cmd);
+		sprintf(buff, "Unknown cmd %d", (int)wcmd->cmd);
 		send_error_msg(buff);
 	}
 }
+
+#ifdef ESP_PLATFORM
+
+void wifid_signal_connected(esp_netif_t *netif, esp_netif_ip_info_t *ip) {
+	uint8_t dns_addr[3][4];
+	esp_netif_dns_info_t dns[3]={};
+	esp_netif_get_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns[0]);
+	esp_netif_get_dns_info(netif, ESP_NETIF_DNS_BACKUP, &dns[1]);
+	esp_netif_get_dns_info(netif, ESP_NETIF_DNS_FALLBACK, &dns[2]);
+	for (int i=0; i<3; i++) memcpy(dns_addr[i], &dns[i].ip, 4);
+	wifid_signal_got_ip((uint8_t*)&ip->ip.addr, (uint8_t*)&ip->netmask.addr, (uint8_t*)&ip->gw.addr, dns_addr);
+}
+
+const char *wifid_plat_scan_start() {
+	esp_err_t r=esp_wifi_scan_start(NULL, false);
+	//will generate WIFI_EVENT_SCAN_DONE event when done
+	return (r==ESP_OK)?NULL:esp_err_to_name(r);
+}
+
+int wifid_plat_scan_results(wifid_ap_t **aps) {
+	uint16_t ap_count;
+	ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
+	wifi_ap_record_t *ap_info=calloc(sizeof(wifi_ap_record_t), ap_count);
+	ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&ap_count, ap_info));
+	*aps=calloc(sizeof(wifid_ap_t), ap_count);
+	for (int i=0; i<ap_count; i++) {
+		memcpy((*aps)[i].ssid, ap_info[i].ssid, 32);
+		(*aps)[i].rssi=ap_info[i].rssi;
+		(*aps)[i].authmode=ap_info[i].authmode;
+	}
+	free(ap_info);
+	return ap_count;
+}
+
+const char *wifid_plat_connect(const char *ssid, const char *pass) {
+	wifi_config_t wifi_cfg = {};
+	strncpy((char*)wifi_cfg.sta.ssid, ssid, sizeof(wifi_cfg.sta.ssid));
+	strncpy((char*)wifi_cfg.sta.password, pass, sizeof(wifi_cfg.sta.password));
+	wifi_cfg.sta.pmf_cfg.capable = true;
+	wifi_cfg.sta.pmf_cfg.required = false;
+	esp_err_t r=esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_cfg);
+	if (r==ESP_OK) {
+		send_error_on_disconnect=0;
+		wifi_if_ena_auto_reconnect(0);
+		esp_wifi_disconnect();
+		vTaskDelay(1000/portTICK_PERIOD_MS); //hacky, should perhaps use a callback from the disconnect event?
+		printf("connect\n");
+		wifi_if_ena_auto_reconnect(1);
+		send_error_on_disconnect=1;
+		r=esp_wifi_connect();
+	}
+	//will generate IP_EVENT_STA_GOT_IP when done
+	return (r==ESP_OK)?NULL:esp_err_to_name(r);
+}
+
+#endif
@@ -1,8 +1,22 @@
+#include <stdint.h>
+#include "wifid_iface.h"
+#ifdef ESP_PLATFORM
 #include "esp_event.h"
 #include "esp_netif_ip_addr.h"
 #include "esp_netif_types.h"
+#endif
 
 void wifid_parse_packet(uint8_t *buffer, int len);
 void wifid_signal_scan_done();
-void wifid_signal_connected(esp_netif_t *netif, esp_netif_ip_info_t *ip);
+void wifid_signal_got_ip(const uint8_t *ip, const uint8_t *netmask, const uint8_t *gw, const uint8_t dns[3][4]);
 void wifid_signal_noconnect();
+#ifdef ESP_PLATFORM
+void wifid_signal_connected(esp_netif_t *netif, esp_netif_ip_info_t *ip);
+#endif
+
+//What wifid needs from the WiFi side. Implemented at the bottom of wifid.c for the ESP32, and
+//by wifid_host.c for the host build. The functions that can fail return an error message
+//for wifid, or NULL if all is well.
+const char *wifid_plat_scan_start();	//calls wifid_signal_scan_done when done
+int wifid_plat_scan_results(wifid_ap_t **aps);	//returns the count; *aps is to be free()d
+const char *wifid_plat_connect(const char *ssid, const char *pass);	//wifid_signal_got_ip on success
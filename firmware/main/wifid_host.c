@@ -0,0 +1,86 @@
+/*
+Stand-in for the ESP32 WiFi API behind wifid, for the host build. There's no radio, so a
+scan 'finds' a fixed list of access points and connecting to any of them immediately hands
+out a slirp-style address. wifi_if_host.c feeds this the wifid packets the PDP11 sends, so
+the wifid protocol can be tested without an ESP32.
+
+The access points can be set with ESPPDP_WIFI_APS, a comma-separated list of SSIDs (empty
+for none); otherwise there are enough of them to need more than one scan result batch.
+*/
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Jeroen Domburg <jeroen@spritesmods.com> wrote this file. As long as you retain
+ * this notice you can do whatever you want with this stuff. If we meet some day,
+ * and you think this stuff is worth it, you can buy me a beer in return.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wifid.h"
+
+#define DEFAULT_AP_COUNT 24
+
+//Values of the ESP-IDF wifi_auth_mode_t
+#define AUTH_OPEN 0
+#define AUTH_WPA2_PSK 3
+
+static int get_aps(wifid_ap_t **aps) {
+	const char *spec=getenv("ESPPDP_WIFI_APS");
+	int count=0;
+	if (spec && spec[0]==0) {
+		count=0;
+	} else if (spec) {
+		count=1;
+		for (const char *p=spec; *p; p++) if (*p==',') count++;
+	} else {
+		count=DEFAULT_AP_COUNT;
+	}
+	*aps=calloc(sizeof(wifid_ap_t), count);
+	for (int i=0; i<count; i++) {
+		wifid_ap_t *ap=&(*aps)[i];
+		if (spec) {
+			const char *end=strchr(spec, ',');
+			int len=end?(end-spec):strlen(spec);
+			if (len>sizeof(ap->ssid)) len=sizeof(ap->ssid);
+			memcpy(ap->ssid, spec, len);
+			spec=end?end+1:spec+strlen(spec);
+		} else {
+			snprintf(ap->ssid, sizeof(ap->ssid), "esppdp-test-%02d", i);
+		}
+		ap->rssi=(uint16_t)(-40-i*2);
+		ap->authmode=(i==0)?AUTH_OPEN:AUTH_WPA2_PSK;
+	}
+	return count;
+}
+
+const char *wifid_plat_scan_start() {
+	//The ESP32 reports a scan done from its event task much later; here the results are
+	//there right away. They only get queued up for the PDP11 anyway.
+	wifid_signal_scan_done();
+	return NULL;
+}
+
+int wifid_plat_scan_results(wifid_ap_t **aps) {
+	return get_aps(aps);
+}
+
+const char *wifid_plat_connect(const char *ssid, const char *pass) {
+	static const uint8_t ip[4]={10, 0, 2, 15};
+	static const uint8_t netmask[4]={255, 255, 255, 0};
+	static const uint8_t gw[4]={10, 0, 2, 2};
+	static const uint8_t dns[3][4]={{10, 0, 2, 3}};
+	wifid_ap_t *aps;
+	int count=get_aps(&aps);
+	int found=0;
+	for (int i=0; i<count; i++) {
+		if (strncmp(aps[i].ssid, ssid, sizeof(aps[i].ssid))==0) found=1;
+	}
+	free(aps);
+	if (!found) return "Couldn't connect to AP";
+	wifid_signal_got_ip(ip, netmask, gw, dns);
+	return NULL;
+}
@@ -1,4 +1,5 @@
 //Common definitions between the wifid esp32 and 2.11bsd code.
+#pragma once
 #define PORT_RECV	67
 #define PORT_SEND	68
 
@@ -63,3 +64,38 @@ typedef struct __attribute__((packed)) {
 	};
 } wifid_event_t;
 
+/*
+Protocol version 2: scan results in bulk. Instead of one event packet per access point,
+the results of a CMD_SCAN_BATCH come back packed WIFID_SCAN_BATCH_MAX at a time in
+EV_SCAN_BATCH packets, the last of which has 'last' set (and possibly a count of 0).
+Firmware that predates this answers CMD_SCAN_BATCH with EV_ERROR; wifid then falls
+back to CMD_SCAN. CMD_SCAN itself still works as before.
+*/
+#define WIFID_PROTO_VERSION 2
+
+#define CMD_SCAN_BATCH 3
+#define EV_SCAN_BATCH 5
+
+#define WIFID_SCAN_BATCH_MAX 16
+
+typedef struct __attribute__((packed)) {
+	char ssid[32];		//not necessarily zero-terminated
+	uint16_t rssi;
+	uint16_t authmode;
+} wifid_ap_t;
+
+typedef struct __attribute__((packed)) {
+#ifdef PDP
+	uint8_t resp;
+	uint8_t unused[3];
+#else
+	uint32_t resp;		//EV_SCAN_BATCH
+#endif
+	uint8_t version;	//WIFID_PROTO_VERSION of the sender
+	uint8_t count;		//number of valid entries in ap[]; only those are sent
+	uint8_t last;		//nonzero on the last packet of this scan
+	uint8_t unused2;
+	wifid_ap_t ap[WIFID_SCAN_BATCH_MAX];
+} wifid_scan_batch_t;
+
+#define WIFID_SCAN_BATCH_LEN(count) (sizeof(wifid_scan_batch_t)-sizeof(wifid_ap_t)*(WIFID_SCAN_BATCH_MAX-(count)))
@@ -113,24 +113,31 @@ void printhex(uint8_t p) {
 	putchar(' ');
 }
 
-void recv_wifid_evt(int sockfd, wifid_event_t *ev) {
+//Receives whatever the ESP32 sends next into buf, which has room for size bytes. Returns
+//the number of bytes received.
+int recv_wifid_msg(int sockfd, void *buf, int size) {
 	int n, len;
 	struct sockaddr_in servaddr; 
-	n = recvfrom(sockfd, (char *)ev, sizeof(wifid_event_t),  
+	n = recvfrom(sockfd, (char *)buf, size,  
 				0, (struct sockaddr *) &servaddr, 
 				&len);
-	if (n!=sizeof(wifid_event_t)) {
-		printf("Huh? weirdly-sized event received. (Ex %d got %d)\n", sizeof(wifid_event_t), n);
-		return;
-	}
 #if 0
-	char *p=(char*)ev;
-	for (int i=0; i<sizeof(wifid_event_t); i++) {
+	char *p=(char*)buf;
+	for (int i=0; i<n; i++) {
 		printhex(*p++);
 		if ((i&15)==15) printf("\n");
 	}
 	printf("\n");
 #endif
+	return n;
+}
+
+void recv_wifid_evt(int sockfd, wifid_event_t *ev) {
+	int n=recv_wifid_msg(sockfd, ev, sizeof(wifid_event_t));
+	if (n!=sizeof(wifid_event_t)) {
+		printf("Huh? weirdly-sized event received. (Ex %d got %d)\n", sizeof(wifid_event_t), n);
+		return;
+	}
 } 
 
 void send_wifid_cmd(int sockfd, wifid_cmd_t *cmd) {
@@ -178,6 +185,63 @@ void configure_interface(const char *interface, wifid_event_t *ev) {
 	system(buff);
 }
 
+void print_network(const char *ssid, uint16_t rssi) {
+	printf("Found network: %-32.32s (%d dBm)\n", ssid, (int16_t)rssi);
+}
+
+//Scans with the batched protocol. Returns 0 if the ESP32 firmware doesn't know it.
+int scan_batched(int sockfd) {
+	static wifid_scan_batch_t batch;
+	wifid_cmd_t cmd={
+		.cmd=CMD_SCAN_BATCH
+	};
+	send_wifid_cmd(sockfd, &cmd);
+	while(1) {
+		int n=recv_wifid_msg(sockfd, &batch, sizeof(batch));
+		if (batch.resp==EV_ERROR && n==sizeof(wifid_event_t)) {
+			wifid_event_t *ev=(wifid_event_t*)&batch;
+			//Older firmware doesn't know the command; anything else is a real error.
+			if (strncmp(ev->error.msg, "Unknown cmd", 11)==0) return 0;
+			printf("Scan failed: %.32s\n", ev->error.msg);
+			exit(1);
+		} else if (batch.resp==EV_SCAN_BATCH && batch.count<=WIFID_SCAN_BATCH_MAX &&
+					n==WIFID_SCAN_BATCH_LEN(batch.count)) {
+			for (int i=0; i<batch.count; i++) {
+				print_network(batch.ap[i].ssid, batch.ap[i].rssi);
+			}
+			if (batch.last) {
+				printf("Scan done.\n");
+				return 1;
+			}
+		} else {
+			printf("Huh? Unexpected response %d\n", batch.resp);
+			exit(1);
+		}
+	}
+}
+
+//Scans with the original one-packet-per-network protocol.
+void scan_single(int sockfd) {
+	wifid_cmd_t cmd={
+		.cmd=CMD_SCAN
+	};
+	send_wifid_cmd(sockfd, &cmd);
+	while(1) {
+		wifid_event_t ev;
+		recv_wifid_evt(sockfd, &ev);
+		if (ev.resp==EV_SCAN_RES || ev.resp==EV_SCAN_RES_END) {
+			print_network(ev.scan_res.ssid, ev.scan_res.rssi);
+			if (ev.resp==EV_SCAN_RES_END) {
+				printf("Scan done.\n");
+				break;
+			}
+		} else {
+			printf("Huh? Unexpected response %d\n", ev.resp);
+			exit(1);
+		}
+	}
+}
+
 #define MODE_NONE 0
 #define MODE_SCAN 1
 #define MODE_CONNECT 2
@@ -239,24 +303,7 @@ int main(int argc, char **argv) {
 
 	if (mode==MODE_SCAN) {
 		printf("Scanning...\n");
-		wifid_cmd_t cmd={
-			.cmd=CMD_SCAN
-		};
-		send_wifid_cmd(sockfd, &cmd);
-		while(1) {
-			wifid_event_t ev;
-			recv_wifid_evt(sockfd, &ev);
-			if (ev.resp==EV_SCAN_RES || ev.resp==EV_SCAN_RES_END) {
-				printf("Found network: %s\n", ev.scan_res.ssid);
-				if (ev.resp==EV_SCAN_RES_END) {
-					printf("Scan done.\n");
-					break;
-				}
-			} else {
-				printf("Huh? Unexpected response %d\n", ev.resp);
-				exit(1);
-			}
-		}
+		if (!scan_batched(sockfd)) scan_single(sockfd);
 	} else if (mode==MODE_CONNECT) {
 		wifid_cmd_t cmd={
 			.cmd=CMD_CONNECT